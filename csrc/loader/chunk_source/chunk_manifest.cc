@@ -0,0 +1,241 @@
+#include "loader/chunk_source/chunk_manifest.h"
+
+#include <absl/log/log.h>
+#include <absl/strings/str_cat.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+
+namespace lczero {
+namespace training {
+namespace {
+
+// File layout: kMagic, then records of
+//   u32 payload size, u32 crc32 of payload, payload
+// where the payload is
+//   u16 path length, path, u64 file size, i64 mtime (ns),
+//   u16 sort key length, sort key, u32 chunk count,
+//   chunk count * (u64 offset, u64 size, u8 flags, u32 frame count).
+// A frame count of 0 means it's not known.
+// Integers are stored in host byte order; the manifest is a local cache and
+// is not meant to be moved between machines.
+constexpr std::string_view kMagic = "LCZMAN02";
+// Earlier versions, which are started over rather than read.
+constexpr std::string_view kOldMagics[] = {"LCZMAN01"};
+constexpr uint8_t kGzipFlag = 1;
+
+template <typename T>
+void Put(std::string& out, T value) {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void PutString(std::string& out, std::string_view value) {
+  Put<uint16_t>(out, static_cast<uint16_t>(value.size()));
+  out.append(value);
+}
+
+// Sequential reader over a record payload. Every getter returns false once the
+// payload is exhausted.
+class PayloadReader {
+ public:
+  explicit PayloadReader(std::string_view data) : data_(data) {}
+
+  template <typename T>
+  bool Get(T& value) {
+    if (data_.size() < sizeof(T)) return false;
+    std::memcpy(&value, data_.data(), sizeof(T));
+    data_.remove_prefix(sizeof(T));
+    return true;
+  }
+
+  bool GetString(std::string& value) {
+    uint16_t size;
+    if (!Get(size) || data_.size() < size) return false;
+    value.assign(data_.substr(0, size));
+    data_.remove_prefix(size);
+    return true;
+  }
+
+  bool empty() const { return data_.empty(); }
+
+ private:
+  std::string_view data_;
+};
+
+std::string EncodeEntry(const ChunkManifest::Entry& entry) {
+  std::string payload;
+  PutString(payload, entry.path);
+  Put<uint64_t>(payload, entry.file_size);
+  Put<int64_t>(payload, entry.mtime_ns);
+  PutString(payload, entry.sort_key);
+  Put<uint32_t>(payload, static_cast<uint32_t>(entry.chunks.size()));
+  for (const auto& chunk : entry.chunks) {
+    Put<uint64_t>(payload, static_cast<uint64_t>(chunk.offset));
+    Put<uint64_t>(payload, static_cast<uint64_t>(chunk.size));
+    Put<uint8_t>(payload, chunk.is_gzip ? kGzipFlag : 0);
+    Put<uint32_t>(payload, chunk.frame_count);
+  }
+
+  std::string record;
+  Put<uint32_t>(record, static_cast<uint32_t>(payload.size()));
+  Put<uint32_t>(record, static_cast<uint32_t>(crc32(
+                            0, reinterpret_cast<const Bytef*>(payload.data()),
+                            payload.size())));
+  record.append(payload);
+  return record;
+}
+
+std::optional<ChunkManifest::Entry> DecodeEntry(std::string_view payload) {
+  PayloadReader reader(payload);
+  ChunkManifest::Entry entry;
+  uint32_t chunk_count;
+  if (!reader.GetString(entry.path) || !reader.Get(entry.file_size) ||
+      !reader.Get(entry.mtime_ns) || !reader.GetString(entry.sort_key) ||
+      !reader.Get(chunk_count)) {
+    return std::nullopt;
+  }
+  entry.chunks.reserve(chunk_count);
+  for (uint32_t i = 0; i < chunk_count; ++i) {
+    uint64_t offset;
+    uint64_t size;
+    uint8_t flags;
+    uint32_t frame_count;
+    if (!reader.Get(offset) || !reader.Get(size) || !reader.Get(flags) ||
+        !reader.Get(frame_count)) {
+      return std::nullopt;
+    }
+    entry.chunks.push_back({.offset = static_cast<long int>(offset),
+                            .size = static_cast<long int>(size),
+                            .is_gzip = (flags & kGzipFlag) != 0,
+                            .frame_count = frame_count});
+  }
+  if (!reader.empty()) return std::nullopt;
+  return entry;
+}
+
+}  // namespace
+
+ChunkManifest::ChunkManifest(const std::filesystem::path& path) {
+  absl::MutexLock lock(&mutex_);
+  Load(path);
+  file_ = fopen(path.c_str(), "ab");
+  if (!file_) {
+    throw std::runtime_error(absl::StrCat("Failed to open manifest ",
+                                          path.string(), ": ",
+                                          strerror(errno)));
+  }
+  if (ftell(file_) == 0) {
+    fwrite(kMagic.data(), 1, kMagic.size(), file_);
+    fflush(file_);
+  }
+  LOG(INFO) << "ChunkManifest " << path << " holds " << entries_.size()
+            << " indexed file(s).";
+}
+
+ChunkManifest::~ChunkManifest() {
+  absl::MutexLock lock(&mutex_);
+  if (file_) fclose(file_);
+}
+
+void ChunkManifest::Load(const std::filesystem::path& path) {
+  std::ifstream input(path, std::ios::binary);
+  if (!input) return;
+  const std::string contents((std::istreambuf_iterator<char>(input)),
+                             std::istreambuf_iterator<char>());
+  input.close();
+
+  std::string_view data(contents);
+  for (std::string_view old_magic : kOldMagics) {
+    if (data.starts_with(old_magic)) {
+      LOG(INFO) << "Manifest " << path
+                << " has an older format, starting a new one.";
+      std::filesystem::resize_file(path, 0);
+      return;
+    }
+  }
+  // Never overwrite a file that is not known to be a manifest, e.g. when
+  // manifest_path points at a data or config file by mistake.
+  if (!data.empty() && !data.starts_with(kMagic)) {
+    throw std::runtime_error(absl::StrCat(
+        "Not a chunk manifest, refusing to overwrite: ", path.string()));
+  }
+  if (data.empty()) return;
+  size_t valid_size = kMagic.size();
+  data.remove_prefix(kMagic.size());
+
+  while (data.size() >= 2 * sizeof(uint32_t)) {
+    uint32_t payload_size;
+    uint32_t checksum;
+    std::memcpy(&payload_size, data.data(), sizeof(payload_size));
+    std::memcpy(&checksum, data.data() + sizeof(payload_size),
+                sizeof(checksum));
+    if (data.size() - 2 * sizeof(uint32_t) < payload_size) break;
+    const std::string_view payload =
+        data.substr(2 * sizeof(uint32_t), payload_size);
+    if (crc32(0, reinterpret_cast<const Bytef*>(payload.data()),
+              payload.size()) != checksum) {
+      break;
+    }
+    auto entry = DecodeEntry(payload);
+    if (!entry) break;
+    std::string key = entry->path;
+    entries_.insert_or_assign(std::move(key), std::move(*entry));
+    valid_size += 2 * sizeof(uint32_t) + payload_size;
+    data.remove_prefix(2 * sizeof(uint32_t) + payload_size);
+  }
+
+  if (valid_size != contents.size()) {
+    LOG(WARNING) << "Discarding " << (contents.size() - valid_size)
+                 << " byte(s) of truncated or corrupted manifest tail in "
+                 << path;
+    std::filesystem::resize_file(path, valid_size);
+  }
+}
+
+std::optional<ChunkManifest::FileStat> ChunkManifest::Stat(
+    const std::filesystem::path& path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) return std::nullopt;
+  return FileStat{
+      .size = static_cast<uint64_t>(st.st_size),
+      .mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+                  st.st_mtim.tv_nsec};
+}
+
+std::optional<ChunkManifest::Entry> ChunkManifest::Lookup(
+    const std::filesystem::path& path, const FileStat& stat) {
+  absl::MutexLock lock(&mutex_);
+  auto it = entries_.find(path.string());
+  if (it == entries_.end() || it->second.file_size != stat.size ||
+      it->second.mtime_ns != stat.mtime_ns) {
+    ++misses_;
+    return std::nullopt;
+  }
+  ++hits_;
+  return it->second;
+}
+
+void ChunkManifest::Append(Entry entry) {
+  const std::string record = EncodeEntry(entry);
+  absl::MutexLock lock(&mutex_);
+  if (fwrite(record.data(), 1, record.size(), file_) != record.size() ||
+      fflush(file_) != 0) {
+    LOG(WARNING) << "Failed to append manifest record for " << entry.path;
+  }
+  std::string key = entry.path;
+  entries_.insert_or_assign(std::move(key), std::move(entry));
+}
+
+size_t ChunkManifest::size() const {
+  absl::MutexLock lock(&mutex_);
+  return entries_.size();
+}
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "loader/chunk_source/tar_chunk_source.h"
+
+namespace lczero {
+namespace training {
+
+// Persistent record of indexed chunk source files, so that a restarted loader
+// can build sources without parsing tar headers again.
+//
+// The manifest is an append-only file of checksummed records, one per indexed
+// file. A record is only trusted while the file on disk still has the recorded
+// size and modification time. A later record for the same path replaces an
+// earlier one. A truncated or corrupted tail (e.g. after a crash mid-append) is
+// cut off when the manifest is opened. Thread-safe.
+class ChunkManifest {
+ public:
+  struct Entry {
+    std::string path;
+    uint64_t file_size = 0;
+    int64_t mtime_ns = 0;
+    std::string sort_key;
+    std::vector<TarChunkSource::FileEntry> chunks;
+  };
+
+  // Loads the manifest at `path`, creating an empty one if it does not exist.
+  // A manifest of an older format version is started over. Throws
+  // std::runtime_error if the file is not a manifest, or cannot be opened for
+  // appending.
+  explicit ChunkManifest(const std::filesystem::path& path);
+  ~ChunkManifest();
+
+  ChunkManifest(const ChunkManifest&) = delete;
+  ChunkManifest& operator=(const ChunkManifest&) = delete;
+
+  struct FileStat {
+    uint64_t size;
+    int64_t mtime_ns;
+  };
+
+  // Returns the size and modification time of `path`, or nullopt if stat()
+  // fails.
+  static std::optional<FileStat> Stat(const std::filesystem::path& path);
+
+  // Returns the recorded entry for `path` if it was recorded with the given
+  // size and modification time. Counts a hit or a miss.
+  std::optional<Entry> Lookup(const std::filesystem::path& path,
+                              const FileStat& stat);
+
+  // Records an entry in memory and appends it to the manifest file.
+  void Append(Entry entry);
+
+  // Number of distinct paths currently recorded.
+  size_t size() const;
+
+  // Returns and resets the Lookup() hit and miss counters.
+  uint64_t FlushHits() { return hits_.exchange(0); }
+  uint64_t FlushMisses() { return misses_.exchange(0); }
+
+ private:
+  void Load(const std::filesystem::path& path);
+
+  mutable absl::Mutex mutex_;
+  absl::flat_hash_map<std::string, Entry> entries_ ABSL_GUARDED_BY(mutex_);
+  FILE* file_ ABSL_GUARDED_BY(mutex_) = nullptr;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+};
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,179 @@
+#include "loader/chunk_source/chunk_manifest.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace lczero {
+namespace training {
+
+namespace {
+
+ChunkManifest::Entry MakeEntry(const std::string& path, uint64_t file_size,
+                               int64_t mtime_ns) {
+  return {.path = path,
+          .file_size = file_size,
+          .mtime_ns = mtime_ns,
+          .sort_key = std::filesystem::path(path).filename().string(),
+          .chunks = {{.offset = 512, .size = 100, .is_gzip = true},
+                     {.offset = 1536,
+                      .size = 2000,
+                      .is_gzip = false,
+                      .frame_count = 7}}};
+}
+
+}  // namespace
+
+class ChunkManifestTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    test_dir_ =
+        std::filesystem::temp_directory_path() /
+        ("chunk_manifest_test_" +
+         std::to_string(
+             std::chrono::steady_clock::now().time_since_epoch().count()));
+    std::filesystem::create_directories(test_dir_);
+    manifest_path_ = test_dir_ / "manifest";
+  }
+
+  void TearDown() override {
+    if (std::filesystem::exists(test_dir_)) {
+      std::filesystem::remove_all(test_dir_);
+    }
+  }
+
+  std::filesystem::path test_dir_;
+  std::filesystem::path manifest_path_;
+};
+
+TEST_F(ChunkManifestTest, StartsEmpty) {
+  ChunkManifest manifest(manifest_path_);
+  EXPECT_EQ(manifest.size(), 0);
+  EXPECT_TRUE(std::filesystem::exists(manifest_path_));
+  EXPECT_FALSE(manifest.Lookup("/data/a.tar", {.size = 1, .mtime_ns = 1}));
+  EXPECT_EQ(manifest.FlushMisses(), 1);
+}
+
+TEST_F(ChunkManifestTest, PersistsAcrossReopen) {
+  {
+    ChunkManifest manifest(manifest_path_);
+    manifest.Append(MakeEntry("/data/a.tar", 4096, 123));
+    manifest.Append(MakeEntry("/data/b.tar", 8192, 456));
+  }
+  ChunkManifest manifest(manifest_path_);
+  EXPECT_EQ(manifest.size(), 2);
+  auto entry = manifest.Lookup("/data/a.tar", {.size = 4096, .mtime_ns = 123});
+  ASSERT_TRUE(entry);
+  EXPECT_EQ(entry->sort_key, "a.tar");
+  ASSERT_EQ(entry->chunks.size(), 2);
+  EXPECT_EQ(entry->chunks[0].offset, 512);
+  EXPECT_EQ(entry->chunks[0].size, 100);
+  EXPECT_TRUE(entry->chunks[0].is_gzip);
+  EXPECT_EQ(entry->chunks[0].frame_count, 0);
+  EXPECT_EQ(entry->chunks[1].offset, 1536);
+  EXPECT_EQ(entry->chunks[1].size, 2000);
+  EXPECT_FALSE(entry->chunks[1].is_gzip);
+  EXPECT_EQ(entry->chunks[1].frame_count, 7);
+  EXPECT_EQ(manifest.FlushHits(), 1);
+}
+
+TEST_F(ChunkManifestTest, RejectsChangedFile) {
+  ChunkManifest manifest(manifest_path_);
+  manifest.Append(MakeEntry("/data/a.tar", 4096, 123));
+  EXPECT_FALSE(manifest.Lookup("/data/a.tar", {.size = 4097, .mtime_ns = 123}));
+  EXPECT_FALSE(manifest.Lookup("/data/a.tar", {.size = 4096, .mtime_ns = 124}));
+  EXPECT_EQ(manifest.FlushMisses(), 2);
+  EXPECT_EQ(manifest.FlushHits(), 0);
+}
+
+TEST_F(ChunkManifestTest, LaterRecordReplacesEarlier) {
+  {
+    ChunkManifest manifest(manifest_path_);
+    manifest.Append(MakeEntry("/data/a.tar", 4096, 123));
+    manifest.Append(MakeEntry("/data/a.tar", 9000, 789));
+  }
+  ChunkManifest manifest(manifest_path_);
+  EXPECT_EQ(manifest.size(), 1);
+  EXPECT_FALSE(manifest.Lookup("/data/a.tar", {.size = 4096, .mtime_ns = 123}));
+  EXPECT_TRUE(manifest.Lookup("/data/a.tar", {.size = 9000, .mtime_ns = 789}));
+}
+
+TEST_F(ChunkManifestTest, DropsTruncatedTail) {
+  {
+    ChunkManifest manifest(manifest_path_);
+    manifest.Append(MakeEntry("/data/a.tar", 4096, 123));
+    manifest.Append(MakeEntry("/data/b.tar", 8192, 456));
+  }
+  const auto full_size = std::filesystem::file_size(manifest_path_);
+  std::filesystem::resize_file(manifest_path_, full_size - 5);
+  {
+    ChunkManifest manifest(manifest_path_);
+    EXPECT_EQ(manifest.size(), 1);
+    EXPECT_TRUE(
+        manifest.Lookup("/data/a.tar", {.size = 4096, .mtime_ns = 123}));
+    // Appending after recovery must produce a readable manifest.
+    manifest.Append(MakeEntry("/data/c.tar", 100, 1));
+  }
+  ChunkManifest manifest(manifest_path_);
+  EXPECT_EQ(manifest.size(), 2);
+  EXPECT_TRUE(manifest.Lookup("/data/c.tar", {.size = 100, .mtime_ns = 1}));
+}
+
+TEST_F(ChunkManifestTest, DropsCorruptedRecord) {
+  {
+    ChunkManifest manifest(manifest_path_);
+    manifest.Append(MakeEntry("/data/a.tar", 4096, 123));
+  }
+  {
+    std::fstream file(manifest_path_,
+                      std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(-3, std::ios::end);
+    file.put('\xff');
+  }
+  ChunkManifest manifest(manifest_path_);
+  EXPECT_EQ(manifest.size(), 0);
+}
+
+TEST_F(ChunkManifestTest, RefusesUnknownFile) {
+  const std::string contents = "definitely not a manifest";
+  {
+    std::ofstream file(manifest_path_);
+    file << contents;
+  }
+  EXPECT_THROW(ChunkManifest manifest(manifest_path_), std::runtime_error);
+  EXPECT_EQ(std::filesystem::file_size(manifest_path_), contents.size());
+}
+
+TEST_F(ChunkManifestTest, StartsOverOlderVersion) {
+  {
+    std::ofstream file(manifest_path_);
+    file << "LCZMAN01 and some records";
+  }
+  {
+    ChunkManifest manifest(manifest_path_);
+    EXPECT_EQ(manifest.size(), 0);
+    manifest.Append(MakeEntry("/data/a.tar", 4096, 123));
+  }
+  ChunkManifest manifest(manifest_path_);
+  EXPECT_EQ(manifest.size(), 1);
+}
+
+TEST_F(ChunkManifestTest, StatReportsSizeAndMtime) {
+  const auto path = test_dir_ / "file.tar";
+  {
+    std::ofstream file(path);
+    file << "12345";
+  }
+  auto stat = ChunkManifest::Stat(path);
+  ASSERT_TRUE(stat);
+  EXPECT_EQ(stat->size, 5);
+  EXPECT_GT(stat->mtime_ns, 0);
+  EXPECT_FALSE(ChunkManifest::Stat(test_dir_ / "missing.tar"));
+}
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,54 @@
+#include "loader/chunk_source/chunk_source.h"
+
+#include <chrono>
+
+namespace lczero {
+namespace training {
+
+ChunkSourceIoStats& ChunkSourceIoStats::operator+=(
+    const ChunkSourceIoStats& other) {
+  bytes_read += other.bytes_read;
+  bytes_decoded += other.bytes_decoded;
+  read_calls += other.read_calls;
+  decode_nanos += other.decode_nanos;
+  failed_decodes += other.failed_decodes;
+  return *this;
+}
+
+void ChunkSourceIoCounters::Add(const ChunkSourceIoStats& stats) {
+  bytes_read_.fetch_add(stats.bytes_read, std::memory_order_relaxed);
+  bytes_decoded_.fetch_add(stats.bytes_decoded, std::memory_order_relaxed);
+  read_calls_.fetch_add(stats.read_calls, std::memory_order_relaxed);
+  decode_nanos_.fetch_add(stats.decode_nanos, std::memory_order_relaxed);
+  failed_decodes_.fetch_add(stats.failed_decodes, std::memory_order_relaxed);
+}
+
+ChunkSourceIoStats ChunkSourceIoCounters::Flush() {
+  return {
+      .bytes_read = bytes_read_.exchange(0, std::memory_order_relaxed),
+      .bytes_decoded = bytes_decoded_.exchange(0, std::memory_order_relaxed),
+      .read_calls = read_calls_.exchange(0, std::memory_order_relaxed),
+      .decode_nanos = decode_nanos_.exchange(0, std::memory_order_relaxed),
+      .failed_decodes = failed_decodes_.exchange(0, std::memory_order_relaxed),
+  };
+}
+
+std::optional<std::vector<FrameType>> ChunkSource::CountedDecode(
+    absl::FunctionRef<std::optional<std::vector<FrameType>>()> decode) {
+  const auto start = std::chrono::steady_clock::now();
+  auto frames = decode();
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  ChunkSourceIoStats stats;
+  stats.decode_nanos = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  if (frames) {
+    stats.bytes_decoded = frames->size() * sizeof(FrameType);
+  } else {
+    stats.failed_decodes = 1;
+  }
+  io_counters_.Add(stats);
+  return frames;
+}
+
+}  // namespace training
+}  // namespace lczero
@@ -1,15 +1,54 @@
 #pragma once
 
+#include <absl/functional/function_ref.h>
+#include <sys/types.h>
+
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "loader/frame_type.h"
+#include "utils/fd_cache.h"
 
 namespace lczero {
 namespace training {
 
+// What reading chunks of a source cost, see ChunkSource::FlushIoStats().
+struct ChunkSourceIoStats {
+  // Stored (usually compressed) bytes of the chunks, whether they came from
+  // the file, a mapping or memory.
+  uint64_t bytes_read = 0;
+  // Bytes of the decoded frames.
+  uint64_t bytes_decoded = 0;
+  // Read calls issued to files. Chunks taken from a mapping or from memory
+  // don't add any.
+  uint64_t read_calls = 0;
+  // Wall time spent decoding chunks, inflate included.
+  uint64_t decode_nanos = 0;
+  uint64_t failed_decodes = 0;
+
+  ChunkSourceIoStats& operator+=(const ChunkSourceIoStats& other);
+};
+
+// ChunkSourceIoStats that can be added to concurrently.
+class ChunkSourceIoCounters {
+ public:
+  void Add(const ChunkSourceIoStats& stats);
+  // Returns the stats accumulated since the previous call, and resets them.
+  ChunkSourceIoStats Flush();
+
+ private:
+  std::atomic<uint64_t> bytes_read_{0};
+  std::atomic<uint64_t> bytes_decoded_{0};
+  std::atomic<uint64_t> read_calls_{0};
+  std::atomic<uint64_t> decode_nanos_{0};
+  std::atomic<uint64_t> failed_decodes_{0};
+};
+
 // Interface for providing training data chunks.
 // A chunk source provides access to one or more chunks of training data.
 // It's assumed that all chunks in a source for one group for sorting purposes,
@@ -27,8 +66,62 @@ class ChunkSource {
 
   // Returns the data for the chunk at the given index. Returns std::nullopt if
   // the chunk could not be read or if the data size is not a multiple of the
-  // expected frame size.
+  // expected frame size. Implementations must allow concurrent calls from
+  // multiple threads.
   virtual std::optional<std::vector<FrameType>> GetChunkData(size_t index) = 0;
+
+  // Loads the stored (compressed) chunk data into memory, so that subsequent
+  // GetChunkData() calls don't touch the file. Returns false if the source
+  // doesn't support it or reading fails. Must not be called concurrently with
+  // other methods.
+  virtual bool MakeResident() { return false; }
+
+  // Number of bytes held in memory by MakeResident().
+  virtual size_t GetResidentBytes() const { return 0; }
+
+  // Location of the stored (possibly compressed) bytes of a chunk in a file.
+  // The descriptor stays open as long as the lease is held.
+  struct StoredChunk {
+    FileDescriptorCache::Lease file;
+    off_t offset;
+    size_t size;
+  };
+
+  // Returns where the chunk is stored, so that the caller can read it
+  // asynchronously and decode it with DecodeStoredChunk(). Returns
+  // std::nullopt if the source doesn't read chunks from a file descriptor;
+  // GetChunkData() must be used then.
+  virtual std::optional<StoredChunk> GetStoredChunk(size_t /*index*/) const {
+    return std::nullopt;
+  }
+
+  // Decodes the bytes read from GetStoredChunk(), with the same result as
+  // GetChunkData(). Safe to call concurrently.
+  virtual std::optional<std::vector<FrameType>> DecodeStoredChunk(
+      size_t /*index*/, std::string_view /*stored*/) {
+    return std::nullopt;
+  }
+
+  // Returns the number of frames of the chunk if it can be told without
+  // decoding it, e.g. from an index or the gzip trailer. Returns std::nullopt
+  // otherwise; GetChunkData() must be used then. Safe to call concurrently.
+  virtual std::optional<size_t> GetChunkFrameCount(size_t /*index*/) const {
+    return std::nullopt;
+  }
+
+  // Returns the I/O stats accumulated since the previous call, and resets
+  // them. Safe to call concurrently with reads.
+  virtual ChunkSourceIoStats FlushIoStats() { return io_counters_.Flush(); }
+
+ protected:
+  // Accounts reads, or decodes done without CountedDecode().
+  void AddIoStats(const ChunkSourceIoStats& stats) { io_counters_.Add(stats); }
+  // Runs `decode` and accounts its wall time and result.
+  std::optional<std::vector<FrameType>> CountedDecode(
+      absl::FunctionRef<std::optional<std::vector<FrameType>>()> decode);
+
+ private:
+  ChunkSourceIoCounters io_counters_;
 };
 
 }  // namespace training
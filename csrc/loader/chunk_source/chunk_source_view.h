@@ -5,6 +5,7 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "loader/chunk_source/chunk_source.h"
@@ -16,6 +17,9 @@ namespace training {
 // It exposes a remapped subset/order of chunks defined by indices into the
 // underlying source. It does not own or copy the data; it forwards calls to
 // the wrapped source.
+//
+// MakeResident() is not forwarded: the underlying source is shared between
+// views that may be used from different pools concurrently.
 class ChunkSourceView : public ChunkSource {
  public:
   // Constructs a view over an existing chunk source. The indices vector maps
@@ -39,6 +43,27 @@ class ChunkSourceView : public ChunkSource {
     return source_->GetChunkData(src_index);
   }
 
+  std::optional<StoredChunk> GetStoredChunk(size_t index) const override {
+    if (index >= indices_.size()) return std::nullopt;
+    return source_->GetStoredChunk(static_cast<size_t>(indices_[index]));
+  }
+
+  std::optional<std::vector<FrameType>> DecodeStoredChunk(
+      size_t index, std::string_view stored) override {
+    if (index >= indices_.size()) return std::nullopt;
+    return source_->DecodeStoredChunk(static_cast<size_t>(indices_[index]),
+                                      stored);
+  }
+
+  std::optional<size_t> GetChunkFrameCount(size_t index) const override {
+    if (index >= indices_.size()) return std::nullopt;
+    return source_->GetChunkFrameCount(static_cast<size_t>(indices_[index]));
+  }
+
+  // Views of a shared source flush its stats in turns, which adds up to the
+  // same totals.
+  ChunkSourceIoStats FlushIoStats() override { return source_->FlushIoStats(); }
+
   std::shared_ptr<ChunkSource> source_;
   std::vector<uint32_t> indices_;
 };
@@ -42,15 +42,17 @@ std::optional<std::vector<FrameType>> DebugChunkSource::GetChunkData(
   std::uniform_int_distribution<int> frame_count_distribution(1, 200);
   const int frame_count = frame_count_distribution(rng);
 
-  std::vector<FrameType> result(frame_count);
-  for (int frame_index = 0; frame_index < frame_count; ++frame_index) {
-    result[frame_index] = FrameType{};
-    result[frame_index].planes[0] = static_cast<uint64_t>(id_);
-    result[frame_index].planes[1] = static_cast<uint64_t>(index);
-    result[frame_index].planes[2] = static_cast<uint64_t>(frame_index);
-  }
-
-  return result;
+  // Generating the frames stands in for decoding them.
+  return CountedDecode([&] {
+    std::vector<FrameType> result(frame_count);
+    for (int frame_index = 0; frame_index < frame_count; ++frame_index) {
+      result[frame_index] = FrameType{};
+      result[frame_index].planes[0] = static_cast<uint64_t>(id_);
+      result[frame_index].planes[1] = static_cast<uint64_t>(index);
+      result[frame_index].planes[2] = static_cast<uint64_t>(frame_index);
+    }
+    return std::make_optional(std::move(result));
+  });
 }
 
 }  // namespace training
@@ -0,0 +1,129 @@
+#include "loader/chunk_source/frame_decoder.h"
+
+#include <absl/log/log.h>
+
+#include <array>
+#include <cstring>
+#include <span>
+#include <string>
+
+#include "trainingdata/trainingdata_v6.h"
+#include "utils/gz.h"
+
+namespace lczero {
+namespace training {
+namespace {
+
+static_assert(sizeof(FrameType) >= sizeof(V6TrainingData),
+              "V6 frames are widened into FrameType in place");
+
+std::span<char> AsBytes(std::vector<FrameType>& frames) {
+  return {reinterpret_cast<char*>(frames.data()),
+          frames.size() * sizeof(FrameType)};
+}
+
+// The first frames.size() * sizeof(V6TrainingData) bytes of `frames` hold
+// packed V6 frames. Moves each one to its FrameType slot and zeroes the fields
+// that V6 doesn't have. Going from the back never overwrites a V6 frame before
+// it's moved.
+void WidenV6FramesInPlace(std::vector<FrameType>& frames) {
+  char* base = reinterpret_cast<char*>(frames.data());
+  for (size_t i = frames.size(); i-- > 0;) {
+    char* frame = base + i * sizeof(FrameType);
+    std::memmove(frame, base + i * sizeof(V6TrainingData),
+                 sizeof(V6TrainingData));
+    std::memset(frame + sizeof(V6TrainingData), 0,
+                sizeof(FrameType) - sizeof(V6TrainingData));
+  }
+}
+
+// Inflates `data` into the start of `frames`, sized from the gzip trailer.
+// Returns the number of bytes produced, or std::nullopt if the stream doesn't
+// fit because the trailer understates its size, or if the trailer size is
+// implausible and can't be used to size the buffer.
+std::optional<size_t> InflateIntoFrames(std::string_view data,
+                                        size_t input_size,
+                                        std::vector<FrameType>& frames) {
+  const auto trailer_size = GzipUncompressedSize(data);
+  if (!trailer_size) throw GunzipError("Not a gzip stream");
+  if (*trailer_size > data.size() * kMaxGzipExpansionRatio) return std::nullopt;
+  frames.resize((*trailer_size + input_size - 1) / input_size);
+  return DefaultInflateBackend().Inflate(data,
+                                         AsBytes(frames).first(*trailer_size));
+}
+
+}  // namespace
+
+std::optional<std::vector<FrameType>> DecodeFrames(
+    std::string_view data, bool is_gzip,
+    ChunkSourceLoaderConfig::FrameFormat frame_format,
+    std::string_view description) {
+  const size_t input_size = InputFrameSize(frame_format);
+
+  std::vector<FrameType> frames;
+  size_t data_size;
+  try {
+    std::optional<size_t> inflated;
+    if (is_gzip) inflated = InflateIntoFrames(data, input_size, frames);
+    if (inflated) {
+      data_size = *inflated;
+    } else {
+      // Uncompressed data, or a gzip stream whose trailer can't be trusted.
+      std::string decompressed;
+      if (is_gzip) {
+        decompressed = GunzipBuffer(data);
+        data = decompressed;
+      }
+      frames.resize((data.size() + input_size - 1) / input_size);
+      std::memcpy(frames.data(), data.data(), data.size());
+      data_size = data.size();
+    }
+  } catch (const GunzipError& e) {
+    LOG(WARNING) << "Failed to decompress " << description << ": " << e.what();
+    return std::nullopt;
+  }
+
+  if (data_size == 0) return std::nullopt;
+  if (data_size % input_size != 0) {
+    LOG(WARNING) << description << " size " << data_size
+                 << " is not a multiple of input frame size " << input_size;
+    return std::nullopt;
+  }
+  frames.resize(data_size / input_size);
+  if (frame_format != ChunkSourceLoaderConfig::V7TrainingData) {
+    WidenV6FramesInPlace(frames);
+  }
+  return frames;
+}
+
+size_t InputFrameSize(ChunkSourceLoaderConfig::FrameFormat frame_format) {
+  return frame_format == ChunkSourceLoaderConfig::V7TrainingData
+             ? sizeof(V7TrainingData)
+             : sizeof(V6TrainingData);
+}
+
+std::optional<size_t> PeekFrameCount(
+    absl::FunctionRef<bool(void*, size_t, uint64_t)> read_at,
+    uint64_t stored_size, bool is_gzip,
+    ChunkSourceLoaderConfig::FrameFormat frame_format) {
+  const size_t input_size = InputFrameSize(frame_format);
+  uint64_t data_size = stored_size;
+  if (is_gzip) {
+    // The smallest gzip stream is a 10-byte header and an 8-byte trailer.
+    std::array<unsigned char, 4> field;
+    if (stored_size < 18 || !read_at(field.data(), 2, 0) || field[0] != 0x1f ||
+        field[1] != 0x8b || !read_at(field.data(), 4, stored_size - 4)) {
+      return std::nullopt;
+    }
+    data_size = static_cast<uint32_t>(field[0]) |
+                (static_cast<uint32_t>(field[1]) << 8) |
+                (static_cast<uint32_t>(field[2]) << 16) |
+                (static_cast<uint32_t>(field[3]) << 24);
+    if (data_size > stored_size * kMaxGzipExpansionRatio) return std::nullopt;
+  }
+  if (data_size == 0 || data_size % input_size != 0) return std::nullopt;
+  return data_size / input_size;
+}
+
+}  // namespace training
+}  // namespace lczero
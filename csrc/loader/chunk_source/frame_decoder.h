@@ -0,0 +1,43 @@
+#pragma once
+
+#include <absl/functional/function_ref.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "loader/frame_type.h"
+#include "proto/data_loader_config.pb.h"
+
+namespace lczero {
+namespace training {
+
+// Decodes the contents of one chunk file into frames. `data` holds frames of
+// `frame_format`, gzip-compressed if `is_gzip` is set. Compressed data is
+// inflated straight into the returned frame buffer, and V6 frames are widened
+// to FrameType in place. Returns std::nullopt (with a warning mentioning
+// `description`) if the data is empty, corrupted or not a whole number of
+// frames.
+std::optional<std::vector<FrameType>> DecodeFrames(
+    std::string_view data, bool is_gzip,
+    ChunkSourceLoaderConfig::FrameFormat frame_format,
+    std::string_view description);
+
+// Size of one stored frame of `frame_format`.
+size_t InputFrameSize(ChunkSourceLoaderConfig::FrameFormat frame_format);
+
+// Returns the number of frames that DecodeFrames() would produce for stored
+// data of `stored_size` bytes, without decoding it. `read_at(buffer, size,
+// offset)` reads bytes of the stored data. Gzip data is sized by the ISIZE
+// field of its trailer, which is exact for single-member streams below 4 GiB.
+// Returns std::nullopt if the size is implausible or not a whole positive
+// number of frames.
+std::optional<size_t> PeekFrameCount(
+    absl::FunctionRef<bool(void*, size_t, uint64_t)> read_at,
+    uint64_t stored_size, bool is_gzip,
+    ChunkSourceLoaderConfig::FrameFormat frame_format);
+
+}  // namespace training
+}  // namespace lczero
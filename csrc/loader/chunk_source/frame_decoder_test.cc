@@ -0,0 +1,139 @@
+#include "loader/chunk_source/frame_decoder.h"
+
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "trainingdata/trainingdata_v6.h"
+
+namespace lczero {
+namespace training {
+namespace {
+
+std::string Gzip(std::string_view data) {
+  z_stream strm = {};
+  EXPECT_EQ(deflateInit2(&strm, Z_BEST_SPEED, Z_DEFLATED, 16 + MAX_WBITS, 8,
+                         Z_DEFAULT_STRATEGY),
+            Z_OK);
+  std::string output(deflateBound(&strm, data.size()), '\0');
+  strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  strm.avail_in = data.size();
+  strm.next_out = reinterpret_cast<Bytef*>(output.data());
+  strm.avail_out = output.size();
+  EXPECT_EQ(deflate(&strm, Z_FINISH), Z_STREAM_END);
+  output.resize(strm.total_out);
+  deflateEnd(&strm);
+  return output;
+}
+
+// Serializes `count` frames of `frame_size` bytes, where every byte of frame i
+// is derived from i and the byte offset.
+std::string MakeFrames(size_t count, size_t frame_size) {
+  std::string data(count * frame_size, '\0');
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<char>((i / frame_size) * 31 + (i % frame_size) % 97);
+  }
+  return data;
+}
+
+void ExpectV6Frames(const std::vector<FrameType>& frames,
+                    std::string_view v6_data) {
+  ASSERT_EQ(frames.size() * sizeof(V6TrainingData), v6_data.size());
+  const std::string zeros(sizeof(FrameType) - sizeof(V6TrainingData), '\0');
+  for (size_t i = 0; i < frames.size(); ++i) {
+    const char* frame = reinterpret_cast<const char*>(&frames[i]);
+    EXPECT_EQ(std::memcmp(frame, v6_data.data() + i * sizeof(V6TrainingData),
+                          sizeof(V6TrainingData)),
+              0)
+        << "frame " << i;
+    EXPECT_EQ(std::memcmp(frame + sizeof(V6TrainingData), zeros.data(),
+                          zeros.size()),
+              0)
+        << "frame " << i;
+  }
+}
+
+TEST(FrameDecoderTest, WidensV6Frames) {
+  const std::string data = MakeFrames(5, sizeof(V6TrainingData));
+  for (bool is_gzip : {false, true}) {
+    auto frames = DecodeFrames(is_gzip ? Gzip(data) : data, is_gzip,
+                               ChunkSourceLoaderConfig::V6TrainingData, "test");
+    ASSERT_TRUE(frames) << is_gzip;
+    ExpectV6Frames(*frames, data);
+  }
+}
+
+TEST(FrameDecoderTest, KeepsV7Frames) {
+  const std::string data = MakeFrames(3, sizeof(V7TrainingData));
+  for (bool is_gzip : {false, true}) {
+    auto frames = DecodeFrames(is_gzip ? Gzip(data) : data, is_gzip,
+                               ChunkSourceLoaderConfig::V7TrainingData, "test");
+    ASSERT_TRUE(frames) << is_gzip;
+    ASSERT_EQ(frames->size(), 3);
+    EXPECT_EQ(std::memcmp(frames->data(), data.data(), data.size()), 0);
+  }
+}
+
+TEST(FrameDecoderTest, HandlesUnderstatedTrailer) {
+  // The trailer of concatenated members only holds the last member's size.
+  const std::string data = MakeFrames(4, sizeof(V6TrainingData));
+  auto frames = DecodeFrames(Gzip(data) + Gzip("x"), true,
+                             ChunkSourceLoaderConfig::V6TrainingData, "test");
+  ASSERT_TRUE(frames);
+  ExpectV6Frames(*frames, data);
+}
+
+TEST(FrameDecoderTest, RejectsCorruptedTrailer) {
+  // An ISIZE beyond the deflate expansion limit must not size the output.
+  const std::string data = MakeFrames(4, sizeof(V6TrainingData));
+  std::string gzipped = Gzip(data);
+  std::memset(gzipped.data() + gzipped.size() - 4, 0xff, 4);
+  EXPECT_FALSE(DecodeFrames(gzipped, true,
+                            ChunkSourceLoaderConfig::V6TrainingData, "test"));
+}
+
+TEST(FrameDecoderTest, RejectsBadInput) {
+  const auto format = ChunkSourceLoaderConfig::V6TrainingData;
+  EXPECT_FALSE(DecodeFrames("", false, format, "test"));
+  EXPECT_FALSE(DecodeFrames(Gzip(""), true, format, "test"));
+  const std::string partial = MakeFrames(2, sizeof(V6TrainingData)) + "x";
+  EXPECT_FALSE(DecodeFrames(partial, false, format, "test"));
+  EXPECT_FALSE(DecodeFrames(Gzip(partial), true, format, "test"));
+  EXPECT_FALSE(DecodeFrames("not gzip at all, not even close", true, format,
+                            "test"));
+}
+
+TEST(FrameDecoderTest, PeeksFrameCount) {
+  const auto format = ChunkSourceLoaderConfig::V6TrainingData;
+  auto peek = [format](std::string_view stored, bool is_gzip) {
+    size_t bytes_read = 0;
+    const auto count = PeekFrameCount(
+        [&](void* buffer, size_t size, uint64_t offset) {
+          if (offset + size > stored.size()) return false;
+          std::memcpy(buffer, stored.data() + offset, size);
+          bytes_read += size;
+          return true;
+        },
+        stored.size(), is_gzip, format);
+    // Only the gzip magic and trailer are read.
+    EXPECT_LE(bytes_read, 6u);
+    return count;
+  };
+  const std::string data = MakeFrames(7, sizeof(V6TrainingData));
+  EXPECT_EQ(peek(data, false), 7u);
+  EXPECT_EQ(peek(Gzip(data), true), 7u);
+  EXPECT_EQ(peek("", false), std::nullopt);
+  EXPECT_EQ(peek(Gzip(""), true), std::nullopt);
+  EXPECT_EQ(peek(data + "x", false), std::nullopt);
+  EXPECT_EQ(peek(Gzip(data + "x"), true), std::nullopt);
+  EXPECT_EQ(peek("not gzip at all, not even close", true), std::nullopt);
+  EXPECT_EQ(InputFrameSize(ChunkSourceLoaderConfig::V7TrainingData),
+            sizeof(V7TrainingData));
+}
+
+}  // namespace
+}  // namespace training
+}  // namespace lczero
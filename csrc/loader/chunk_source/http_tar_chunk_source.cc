@@ -0,0 +1,114 @@
+#include "loader/chunk_source/http_tar_chunk_source.h"
+
+#include <absl/log/log.h>
+#include <absl/strings/str_cat.h>
+
+#include <array>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#include "loader/chunk_source/frame_decoder.h"
+
+namespace lczero {
+namespace training {
+
+HttpTarChunkSource::HttpTarChunkSource(
+    std::shared_ptr<HttpRangeReader> reader, std::string url,
+    uint64_t file_size, ChunkSourceLoaderConfig::FrameFormat frame_format)
+    : reader_(std::move(reader)),
+      url_(std::move(url)),
+      file_size_(file_size),
+      frame_format_(frame_format) {
+  Index();
+}
+
+HttpTarChunkSource::HttpTarChunkSource(
+    std::shared_ptr<HttpRangeReader> reader, std::string url,
+    uint64_t file_size, ChunkSourceLoaderConfig::FrameFormat frame_format,
+    std::vector<TarChunkSource::FileEntry> files)
+    : reader_(std::move(reader)),
+      url_(std::move(url)),
+      file_size_(file_size),
+      frame_format_(frame_format),
+      files_(std::move(files)) {}
+
+std::string HttpTarChunkSource::GetChunkSortKey() const {
+  return url_.substr(url_.rfind('/') + 1);
+}
+
+bool HttpTarChunkSource::ReadAt(void* buffer, size_t size,
+                                uint64_t offset) const {
+  return reader_->Read(url_, file_size_, offset,
+                       {static_cast<char*>(buffer), size});
+}
+
+void HttpTarChunkSource::Index() {
+  long int offset = 0;
+  while (true) {
+    std::array<char, 512> header;
+    if (static_cast<uint64_t>(offset) + header.size() > file_size_ ||
+        !ReadAt(header.data(), header.size(), offset)) {
+      LOG(WARNING) << "Truncated tar file: " << url_;
+      break;
+    }
+    const auto member = TarChunkSource::ParseHeader(
+        std::string_view(header.data(), header.size()), offset);
+    if (!member) break;
+    offset = member->next_header;
+    if (!member->is_chunk) continue;
+
+    const TarChunkSource::FileEntry& entry = member->entry;
+    if (static_cast<uint64_t>(entry.offset + entry.size) > file_size_) {
+      LOG(WARNING) << "Truncated tar file at " << member->name << " in "
+                   << url_;
+      break;
+    }
+    files_.push_back(entry);
+  }
+
+  LOG(INFO) << "Read " << files_.size() << " entries from " << url_;
+}
+
+size_t HttpTarChunkSource::GetChunkCount() const { return files_.size(); }
+
+std::optional<std::vector<FrameType>> HttpTarChunkSource::GetChunkData(
+    size_t index) {
+  if (index >= files_.size()) {
+    throw std::out_of_range("File index out of range");
+  }
+  const auto& file_entry = files_[index];
+  std::string buffer(file_entry.size, '\0');
+  if (!ReadAt(buffer.data(), buffer.size(), file_entry.offset)) {
+    LOG(WARNING) << "Failed to read chunk " << index << " from " << url_;
+    return std::nullopt;
+  }
+  AddIoStats({.bytes_read = buffer.size(), .read_calls = 1});
+  return CountedDecode([&] {
+    return DecodeFrames(buffer, file_entry.is_gzip, frame_format_,
+                        absl::StrCat("chunk ", index, " from ", url_));
+  });
+}
+
+std::optional<size_t> HttpTarChunkSource::GetChunkFrameCount(
+    size_t index) const {
+  if (index >= files_.size()) {
+    throw std::out_of_range("File index out of range");
+  }
+  const auto& file_entry = files_[index];
+  if (file_entry.frame_count > 0) return file_entry.frame_count;
+  return PeekFrameCount(
+      [this, &file_entry](void* buffer, size_t size, uint64_t offset) {
+        return ReadAt(buffer, size, file_entry.offset + offset);
+      },
+      file_entry.size, file_entry.is_gzip, frame_format_);
+}
+
+void HttpTarChunkSource::CountFrames() {
+  for (size_t i = 0; i < files_.size(); ++i) {
+    files_[i].frame_count = GetChunkFrameCount(i).value_or(0);
+  }
+}
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "loader/chunk_source/chunk_source.h"
+#include "loader/chunk_source/tar_chunk_source.h"
+#include "proto/data_loader_config.pb.h"
+#include "utils/http_range_reader.h"
+
+namespace lczero {
+namespace training {
+
+// A chunk source for a tar archive on an HTTP server, read with Range requests
+// through a shared HttpRangeReader. Each file in the tar is treated as a
+// separate chunk, as in TarChunkSource. GetChunkData() is safe to call
+// concurrently from multiple threads.
+class HttpTarChunkSource : public ChunkSource {
+ public:
+  // Indexes the archive by reading its tar headers, which fetches most of the
+  // archive. `file_size` is the size of the archive, see
+  // HttpRangeReader::Stat().
+  HttpTarChunkSource(std::shared_ptr<HttpRangeReader> reader, std::string url,
+                     uint64_t file_size,
+                     ChunkSourceLoaderConfig::FrameFormat frame_format);
+  // Uses a previously built index (see files()) instead of reading the tar
+  // headers. The caller is responsible for the index matching the file.
+  HttpTarChunkSource(std::shared_ptr<HttpRangeReader> reader, std::string url,
+                     uint64_t file_size,
+                     ChunkSourceLoaderConfig::FrameFormat frame_format,
+                     std::vector<TarChunkSource::FileEntry> files);
+
+  // The file name part of the URL.
+  std::string GetChunkSortKey() const override;
+  size_t GetChunkCount() const override;
+  std::optional<std::vector<FrameType>> GetChunkData(size_t index) override;
+  // From the index if counted, otherwise from the member size, or the gzip
+  // trailer of compressed members.
+  std::optional<size_t> GetChunkFrameCount(size_t index) const override;
+  // See TarChunkSource::CountFrames().
+  void CountFrames();
+  const std::vector<TarChunkSource::FileEntry>& files() const {
+    return files_;
+  }
+
+ private:
+  void Index();
+  bool ReadAt(void* buffer, size_t size, uint64_t offset) const;
+
+  std::shared_ptr<HttpRangeReader> reader_;
+  std::string url_;
+  uint64_t file_size_;
+  ChunkSourceLoaderConfig::FrameFormat frame_format_;
+  std::vector<TarChunkSource::FileEntry> files_;
+};
+
+}  // namespace training
+}  // namespace lczero
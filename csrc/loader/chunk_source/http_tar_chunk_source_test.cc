@@ -0,0 +1,191 @@
+#include "loader/chunk_source/http_tar_chunk_source.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "loader/chunk_source/chunk_manifest.h"
+#include "loader/stages/chunk_source_loader.h"
+#include "utils/gz.h"
+#include "utils/test_http_server.h"
+
+namespace lczero {
+namespace training {
+
+namespace {
+
+std::vector<FrameType> MakeChunk(uint32_t id, size_t frame_count) {
+  std::vector<FrameType> frames(frame_count);
+  for (size_t i = 0; i < frame_count; ++i) {
+    frames[i].version = 7;
+    frames[i].input_format = id;
+    frames[i].best_idx = static_cast<uint32_t>(i);
+  }
+  return frames;
+}
+
+// Appends a ustar member with the given contents.
+void AppendTarMember(std::string& tar, const std::string& name,
+                     std::string_view contents, char typeflag = '0') {
+  std::string header(512, '\0');
+  std::memcpy(header.data(), name.data(), name.size());
+  std::snprintf(header.data() + 124, 12, "%011zo", contents.size());
+  header[156] = typeflag;
+  std::memcpy(header.data() + 257, "ustar", 5);
+  tar.append(header);
+  tar.append(contents);
+  tar.append((512 - contents.size() % 512) % 512, '\0');
+}
+
+}  // namespace
+
+class HttpTarChunkSourceTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    std::string tar;
+    AppendTarMember(tar, "training", "", '5');
+    AppendTarMember(tar, "LICENSE", "license text");
+    for (uint32_t i = 0; i < 100; ++i) {
+      chunks_.push_back(MakeChunk(i, 1 + i % 7));
+      const std::string_view raw(
+          reinterpret_cast<const char*>(chunks_.back().data()),
+          chunks_.back().size() * sizeof(FrameType));
+      const std::string name = "training/game_" + std::to_string(i);
+      if (i % 2) {
+        AppendTarMember(tar, name, raw);
+      } else {
+        AppendTarMember(tar, name + ".gz", GzipBuffer(raw, 1));
+      }
+    }
+    tar.append(1024, '\0');
+    tar_size_ = tar.size();
+    server_ = std::make_unique<TestHttpServer>(
+        std::map<std::string, std::string>{{"/data/run1-test.tar", tar}});
+    url_ = server_->url("/data/run1-test.tar");
+  }
+
+  void ExpectAllChunks(ChunkSource& source) {
+    ASSERT_EQ(source.GetChunkCount(), chunks_.size());
+    // Out of order, as the shuffling chunk pool reads them.
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+      const size_t index = (i * 37) % chunks_.size();
+      const auto frames = source.GetChunkData(index);
+      ASSERT_TRUE(frames.has_value()) << "chunk " << index;
+      ASSERT_EQ(frames->size(), chunks_[index].size()) << "chunk " << index;
+      EXPECT_EQ(source.GetChunkFrameCount(index), frames->size())
+          << "chunk " << index;
+      EXPECT_EQ(std::memcmp(frames->data(), chunks_[index].data(),
+                            frames->size() * sizeof(FrameType)),
+                0)
+          << "chunk " << index;
+    }
+  }
+
+  std::vector<std::vector<FrameType>> chunks_;
+  size_t tar_size_ = 0;
+  std::unique_ptr<TestHttpServer> server_;
+  std::string url_;
+};
+
+TEST_F(HttpTarChunkSourceTest, ReadsChunksFromCache) {
+  auto reader = std::make_shared<HttpRangeReader>(64 << 20, 4096, 4);
+  const auto info = reader->Stat(url_);
+  ASSERT_TRUE(info.has_value());
+  EXPECT_EQ(info->size, tar_size_);
+  EXPECT_EQ(info->mtime_ns, int64_t{784111777} * 1000000000);
+
+  HttpTarChunkSource source(reader, url_, info->size,
+                            ChunkSourceLoaderConfig::V7TrainingData);
+  EXPECT_EQ(source.GetChunkSortKey(), "run1-test.tar");
+  ExpectAllChunks(source);
+  EXPECT_GT(reader->FlushMisses(), 0);
+  EXPECT_EQ(reader->cached_bytes(), tar_size_);
+
+  const size_t requests = server_->requests();
+  ExpectAllChunks(source);
+  EXPECT_EQ(server_->requests(), requests);
+  EXPECT_EQ(reader->FlushMisses(), 0);
+  EXPECT_GT(reader->FlushHits(), 0);
+  // All of it over one connection.
+  EXPECT_EQ(server_->connections(), 1);
+}
+
+TEST_F(HttpTarChunkSourceTest, ReadsConcurrentlyWithoutCache) {
+  constexpr size_t kConnections = 3;
+  auto reader = std::make_shared<HttpRangeReader>(0, 1024, kConnections);
+  HttpTarChunkSource source(reader, url_, tar_size_,
+                            ChunkSourceLoaderConfig::V7TrainingData);
+  EXPECT_EQ(reader->cached_bytes(), 0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 6; ++i) {
+    threads.emplace_back([&] { ExpectAllChunks(source); });
+  }
+  for (auto& thread : threads) thread.join();
+  EXPECT_EQ(reader->FlushHits(), 0);
+  EXPECT_LE(server_->connections(), kConnections);
+}
+
+TEST_F(HttpTarChunkSourceTest, FailedReadsAreNotCounted) {
+  auto reader = std::make_shared<HttpRangeReader>(0, 4096, 1);
+  HttpTarChunkSource source(reader, url_, tar_size_,
+                            ChunkSourceLoaderConfig::V7TrainingData);
+  source.FlushIoStats();
+  server_.reset();
+  EXPECT_FALSE(source.GetChunkData(0).has_value());
+  const ChunkSourceIoStats stats = source.FlushIoStats();
+  EXPECT_EQ(stats.bytes_read, 0);
+  EXPECT_EQ(stats.read_calls, 0);
+}
+
+TEST_F(HttpTarChunkSourceTest, CreatedByLoaderWithManifest) {
+  const auto manifest_path =
+      std::filesystem::temp_directory_path() /
+      ("http_tar_chunk_source_test_" +
+       std::to_string(
+           std::chrono::steady_clock::now().time_since_epoch().count()));
+  ChunkSourceLoaderConfig config;
+  config.set_frame_format(ChunkSourceLoaderConfig::V7TrainingData);
+  config.set_http_block_size(4096);
+  {
+    auto manifest = std::make_shared<ChunkManifest>(manifest_path);
+    auto source = CreateChunkSourceFromFile(url_, config, manifest);
+    ASSERT_NE(source, nullptr);
+    ExpectAllChunks(*source);
+    EXPECT_EQ(manifest->size(), 1);
+  }
+
+  // The index comes from the manifest, so only the HEAD request is made
+  // before the chunks are read.
+  auto manifest = std::make_shared<ChunkManifest>(manifest_path);
+  config.set_lazy_indexing(true);
+  const size_t requests = server_->requests();
+  auto source = CreateChunkSourceFromFile(url_, config, manifest);
+  ASSERT_NE(source, nullptr);
+  EXPECT_EQ(source->GetChunkSortKey(), "run1-test.tar");
+  EXPECT_EQ(server_->requests(), requests);
+  EXPECT_EQ(source->GetChunkCount(), chunks_.size());
+  EXPECT_EQ(server_->requests(), requests + 1);
+  EXPECT_EQ(manifest->FlushHits(), 1);
+  // So do the frame counts.
+  for (size_t i = 0; i < chunks_.size(); ++i) {
+    EXPECT_EQ(source->GetChunkFrameCount(i), chunks_[i].size());
+  }
+  EXPECT_EQ(server_->requests(), requests + 1);
+  ExpectAllChunks(*source);
+
+  EXPECT_EQ(CreateChunkSourceFromFile(server_->url("/data/missing.tar"),
+                                      config)
+                ->GetChunkCount(),
+            0);
+  std::filesystem::remove(manifest_path);
+}
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,83 @@
+#include "loader/chunk_source/lazy_chunk_source.h"
+
+#include <absl/log/log.h>
+
+#include <exception>
+#include <utility>
+
+namespace lczero {
+namespace training {
+
+LazyChunkSource::LazyChunkSource(std::string sort_key, Factory factory)
+    : sort_key_(std::move(sort_key)), factory_(std::move(factory)) {}
+
+LazyChunkSource::~LazyChunkSource() = default;
+
+std::string LazyChunkSource::GetChunkSortKey() const { return sort_key_; }
+
+ChunkSource* LazyChunkSource::source() const {
+  absl::call_once(open_once_, [this]() {
+    try {
+      source_ = std::move(factory_)();
+      if (!source_) {
+        LOG(ERROR) << "Failed to open chunk source " << sort_key_;
+      }
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "Failed to open chunk source " << sort_key_ << ": "
+                 << e.what();
+    }
+    factory_ = nullptr;
+    opened_.store(source_.get(), std::memory_order_release);
+  });
+  return source_.get();
+}
+
+size_t LazyChunkSource::GetChunkCount() const {
+  ChunkSource* const opened = source();
+  return opened ? opened->GetChunkCount() : 0;
+}
+
+std::optional<std::vector<FrameType>> LazyChunkSource::GetChunkData(
+    size_t index) {
+  ChunkSource* const opened = source();
+  if (!opened) return std::nullopt;
+  return opened->GetChunkData(index);
+}
+
+bool LazyChunkSource::MakeResident() {
+  ChunkSource* const opened = source();
+  return opened && opened->MakeResident();
+}
+
+size_t LazyChunkSource::GetResidentBytes() const {
+  ChunkSource* const opened = source();
+  return opened ? opened->GetResidentBytes() : 0;
+}
+
+std::optional<ChunkSource::StoredChunk> LazyChunkSource::GetStoredChunk(
+    size_t index) const {
+  ChunkSource* const opened = source();
+  if (!opened) return std::nullopt;
+  return opened->GetStoredChunk(index);
+}
+
+std::optional<std::vector<FrameType>> LazyChunkSource::DecodeStoredChunk(
+    size_t index, std::string_view stored) {
+  ChunkSource* const opened = source();
+  if (!opened) return std::nullopt;
+  return opened->DecodeStoredChunk(index, stored);
+}
+
+std::optional<size_t> LazyChunkSource::GetChunkFrameCount(size_t index) const {
+  ChunkSource* const opened = source();
+  if (!opened) return std::nullopt;
+  return opened->GetChunkFrameCount(index);
+}
+
+ChunkSourceIoStats LazyChunkSource::FlushIoStats() {
+  ChunkSource* const opened = opened_.load(std::memory_order_acquire);
+  return opened ? opened->FlushIoStats() : ChunkSourceIoStats();
+}
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/base/call_once.h"
+#include "absl/functional/any_invocable.h"
+#include "loader/chunk_source/chunk_source.h"
+
+namespace lczero {
+namespace training {
+
+// A chunk source that defers opening (and indexing) the underlying source
+// until its chunks are first needed. The sort key is known upfront, so sources
+// can be ordered and discarded without touching the files.
+//
+// The factory runs at most once, on the first call of any method other than
+// GetChunkSortKey(), and may throw. If it throws or returns nullptr, the error
+// is logged and the source reports zero chunks.
+class LazyChunkSource : public ChunkSource {
+ public:
+  using Factory = absl::AnyInvocable<std::unique_ptr<ChunkSource>() &&>;
+
+  LazyChunkSource(std::string sort_key, Factory factory);
+  ~LazyChunkSource() override;
+
+  std::string GetChunkSortKey() const override;
+  size_t GetChunkCount() const override;
+  std::optional<std::vector<FrameType>> GetChunkData(size_t index) override;
+  bool MakeResident() override;
+  size_t GetResidentBytes() const override;
+  std::optional<StoredChunk> GetStoredChunk(size_t index) const override;
+  std::optional<std::vector<FrameType>> DecodeStoredChunk(
+      size_t index, std::string_view stored) override;
+  std::optional<size_t> GetChunkFrameCount(size_t index) const override;
+  // Doesn't open the source.
+  ChunkSourceIoStats FlushIoStats() override;
+
+ private:
+  ChunkSource* source() const;
+
+  const std::string sort_key_;
+  mutable Factory factory_;
+  mutable absl::once_flag open_once_;
+  mutable std::unique_ptr<ChunkSource> source_;
+  // source_ once it's open, readable without waiting for the factory.
+  mutable std::atomic<ChunkSource*> opened_{nullptr};
+};
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,89 @@
+#include "loader/chunk_source/packed_chunk_format.h"
+
+#include <absl/strings/str_cat.h>
+#include <zlib.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include "utils/gz.h"
+
+namespace lczero {
+namespace training {
+
+PackedChunkWriter::PackedChunkWriter(const std::filesystem::path& path,
+                                     int gzip_level)
+    : path_(path.string()), gzip_level_(gzip_level) {
+  file_ = fopen(path_.c_str(), "wb");
+  if (!file_) {
+    throw std::runtime_error(
+        absl::StrCat("Failed to open ", path_, ": ", strerror(errno)));
+  }
+  Write(kPackedMagic);
+  Pad();
+}
+
+PackedChunkWriter::~PackedChunkWriter() {
+  if (file_) fclose(file_);
+}
+
+void PackedChunkWriter::Write(std::string_view data) {
+  if (fwrite(data.data(), 1, data.size(), file_) != data.size()) {
+    throw std::runtime_error(
+        absl::StrCat("Failed to write ", path_, ": ", strerror(errno)));
+  }
+  offset_ += data.size();
+}
+
+void PackedChunkWriter::Pad() {
+  static constexpr char kZeros[kPackedAlignment] = {};
+  const uint64_t remainder = offset_ % kPackedAlignment;
+  if (remainder) Write({kZeros, kPackedAlignment - remainder});
+}
+
+void PackedChunkWriter::AddChunk(std::span<const FrameType> frames) {
+  const std::string_view raw(reinterpret_cast<const char*>(frames.data()),
+                             frames.size_bytes());
+  PackedChunkEntry entry{.offset = offset_,
+                         .stored_size = 0,
+                         .frame_count = static_cast<uint32_t>(frames.size()),
+                         .codec = PackedCodec::kStored};
+  // Empty chunks are stored, there is nothing to inflate them into.
+  if (gzip_level_ > 0 && !frames.empty()) {
+    const std::string compressed = GzipBuffer(raw, gzip_level_);
+    entry.codec = PackedCodec::kGzip;
+    entry.stored_size = compressed.size();
+    Write(compressed);
+  } else {
+    entry.stored_size = raw.size();
+    Write(raw);
+  }
+  Pad();
+  entries_.push_back(entry);
+}
+
+void PackedChunkWriter::Finish() {
+  const std::string_view index(reinterpret_cast<const char*>(entries_.data()),
+                               entries_.size() * sizeof(PackedChunkEntry));
+  PackedFooter footer{
+      .index_offset = offset_,
+      .chunk_count = entries_.size(),
+      .index_crc32 = static_cast<uint32_t>(
+          crc32(0, reinterpret_cast<const Bytef*>(index.data()),
+                static_cast<uInt>(index.size()))),
+      .version = kPackedVersion,
+      .magic = {}};
+  std::memcpy(footer.magic, kPackedMagic.data(), sizeof(footer.magic));
+  Write(index);
+  Write({reinterpret_cast<const char*>(&footer), sizeof(footer)});
+  const int result = fclose(file_);
+  file_ = nullptr;
+  if (result != 0) {
+    throw std::runtime_error(
+        absl::StrCat("Failed to close ", path_, ": ", strerror(errno)));
+  }
+}
+
+}  // namespace training
+}  // namespace lczero
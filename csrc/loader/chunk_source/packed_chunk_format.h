@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "loader/frame_type.h"
+
+namespace lczero {
+namespace training {
+
+// Loader-native chunk archive (.lczpack). Unlike a tar of gzipped files, it
+// can be indexed with a single footer read, and chunks stored raw can be
+// copied straight out of a mapping.
+//
+// Layout (all integers little-endian, as written by the host):
+//   header:  kPackedMagic, padded to kPackedAlignment bytes.
+//   chunks:  back to back, each starting at a kPackedAlignment-aligned offset.
+//            A chunk is an array of FrameType, either stored as is or
+//            compressed as a single gzip member.
+//   index:   PackedChunkEntry per chunk.
+//   footer:  PackedFooter, at the very end of the file.
+//
+// Frames are stored as FrameType regardless of the format of the source data,
+// so the archive doesn't depend on the loader's frame_format setting.
+
+inline constexpr std::string_view kPackedMagic = "LCZPACK1";
+inline constexpr uint32_t kPackedVersion = 1;
+inline constexpr uint64_t kPackedAlignment = 64;
+
+enum class PackedCodec : uint32_t {
+  kStored = 0,
+  kGzip = 1,
+};
+
+struct PackedChunkEntry {
+  uint64_t offset;
+  uint64_t stored_size;
+  uint32_t frame_count;
+  PackedCodec codec;
+};
+static_assert(sizeof(PackedChunkEntry) == 24);
+
+struct PackedFooter {
+  uint64_t index_offset;
+  uint64_t chunk_count;
+  // CRC32 of the index entries.
+  uint32_t index_crc32;
+  uint32_t version;
+  char magic[8];
+};
+static_assert(sizeof(PackedFooter) == 32);
+
+// Writes a .lczpack archive. Chunks are appended with AddChunk(), and the file
+// is only valid after Finish(). Throws std::runtime_error on I/O errors.
+class PackedChunkWriter {
+ public:
+  // `gzip_level` is the zlib compression level of the chunks, or 0 to store
+  // them uncompressed.
+  PackedChunkWriter(const std::filesystem::path& path, int gzip_level);
+  ~PackedChunkWriter();
+
+  PackedChunkWriter(const PackedChunkWriter&) = delete;
+  PackedChunkWriter& operator=(const PackedChunkWriter&) = delete;
+
+  void AddChunk(std::span<const FrameType> frames);
+  void Finish();
+
+  uint64_t bytes_written() const { return offset_; }
+
+ private:
+  void Write(std::string_view data);
+  void Pad();
+
+  std::string path_;
+  FILE* file_ = nullptr;
+  const int gzip_level_;
+  uint64_t offset_ = 0;
+  std::vector<PackedChunkEntry> entries_;
+};
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,236 @@
+#include "loader/chunk_source/packed_chunk_source.h"
+
+#include <absl/log/log.h>
+#include <absl/strings/str_cat.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+#include "utils/file_io.h"
+#include "utils/gz.h"
+
+namespace lczero {
+namespace training {
+
+PackedChunkSource::PackedChunkSource(
+    const std::filesystem::path& filename,
+    ChunkSourceLoaderConfig::ReadMode read_mode, CachePolicy cache_policy,
+    std::shared_ptr<FileReadCounters> read_counters)
+    : filename_(filename.filename().string()) {
+  uint64_t file_size;
+  if (read_mode == ChunkSourceLoaderConfig::MMAP) {
+    mapped_file_ = std::make_unique<MappedFile>(filename);
+    // Chunks are drawn in shuffled order, see TarChunkSource.
+    mapped_file_->Advise(MADV_RANDOM);
+    file_size = mapped_file_->size();
+  } else {
+    file_ = std::make_unique<ReadOnlyFile>(filename, cache_policy,
+                                           std::move(read_counters));
+    file_size = file_->size();
+  }
+  ReadIndex(file_size);
+  LOG(INFO) << "Read " << entries_.size() << " entries from " << filename_;
+}
+
+PackedChunkSource::~PackedChunkSource() = default;
+
+void PackedChunkSource::ReadIndex(uint64_t file_size) {
+  PackedFooter footer;
+  if (file_size < kPackedAlignment + sizeof(footer) ||
+      !ReadAt(&footer, sizeof(footer), file_size - sizeof(footer)) ||
+      std::string_view(footer.magic, sizeof(footer.magic)) != kPackedMagic) {
+    throw std::runtime_error(
+        absl::StrCat(filename_, " is not a packed chunk archive"));
+  }
+  if (footer.version != kPackedVersion) {
+    throw std::runtime_error(absl::StrCat(
+        filename_, ": unsupported packed archive version ", footer.version));
+  }
+  const uint64_t index_end = file_size - sizeof(footer);
+  if (footer.index_offset > index_end ||
+      (index_end - footer.index_offset) / sizeof(PackedChunkEntry) !=
+          footer.chunk_count ||
+      (index_end - footer.index_offset) % sizeof(PackedChunkEntry) != 0) {
+    throw std::runtime_error(
+        absl::StrCat(filename_, ": packed archive index is truncated"));
+  }
+
+  entries_.resize(footer.chunk_count);
+  const size_t index_size = entries_.size() * sizeof(PackedChunkEntry);
+  if (!ReadAt(entries_.data(), index_size, footer.index_offset) ||
+      crc32(0, reinterpret_cast<const Bytef*>(entries_.data()),
+            static_cast<uInt>(index_size)) != footer.index_crc32) {
+    throw std::runtime_error(
+        absl::StrCat(filename_, ": packed archive index is corrupted"));
+  }
+  for (const auto& entry : entries_) {
+    const bool valid_codec =
+        entry.codec == PackedCodec::kGzip ||
+        (entry.codec == PackedCodec::kStored &&
+         entry.stored_size == entry.frame_count * sizeof(FrameType));
+    if (!valid_codec || entry.offset > footer.index_offset ||
+        entry.stored_size > footer.index_offset - entry.offset) {
+      throw std::runtime_error(
+          absl::StrCat(filename_, ": packed archive index is corrupted"));
+    }
+  }
+}
+
+std::string PackedChunkSource::GetChunkSortKey() const { return filename_; }
+
+size_t PackedChunkSource::GetChunkCount() const { return entries_.size(); }
+
+std::optional<std::string_view> PackedChunkSource::ViewAt(
+    size_t size, uint64_t offset) const {
+  std::string_view data;
+  if (!resident_data_.empty()) {
+    if (offset < resident_offset_) return std::nullopt;
+    data = resident_data_;
+    offset -= resident_offset_;
+  } else if (mapped_file_) {
+    data = mapped_file_->data();
+  } else {
+    return std::nullopt;
+  }
+  if (offset + size > data.size()) return std::nullopt;
+  return data.substr(offset, size);
+}
+
+bool PackedChunkSource::ReadAt(void* buffer, size_t size,
+                               uint64_t offset) const {
+  if (file_) return file_->Read(buffer, size, offset);
+  const auto view = ViewAt(size, offset);
+  if (!view) return false;
+  std::memcpy(buffer, view->data(), size);
+  return true;
+}
+
+bool PackedChunkSource::MakeResident() {
+  if (!resident_data_.empty()) return true;
+  if (entries_.empty()) return false;
+  const uint64_t begin = entries_.front().offset;
+  const uint64_t end = entries_.back().offset + entries_.back().stored_size;
+  std::string data(end - begin, '\0');
+  if (!ReadAt(data.data(), data.size(), begin)) {
+    LOG(WARNING) << "Failed to load " << filename_ << " into memory";
+    return false;
+  }
+  resident_data_ = std::move(data);
+  resident_offset_ = begin;
+  if (file_) file_->Release(begin, resident_data_.size());
+  file_.reset();
+  mapped_file_.reset();
+  return true;
+}
+
+size_t PackedChunkSource::GetResidentBytes() const {
+  return resident_data_.size();
+}
+
+std::optional<std::vector<FrameType>> PackedChunkSource::GetChunkData(
+    size_t index) {
+  if (index >= entries_.size()) {
+    throw std::out_of_range("Chunk index out of range");
+  }
+  const auto& entry = entries_[index];
+  if (auto view = ViewAt(entry.stored_size, entry.offset)) {
+    AddIoStats({.bytes_read = view->size()});
+    return Decode(index, *view);
+  }
+  std::optional<std::vector<FrameType>> frames;
+  if (entry.codec == PackedCodec::kStored) {
+    // Read straight into the frames, without a bounce buffer.
+    frames.emplace(entry.frame_count);
+    if (file_->Read(frames->data(), entry.stored_size, entry.offset)) {
+      AddIoStats({.bytes_read = entry.stored_size,
+                  .bytes_decoded = entry.stored_size,
+                  .read_calls = 1});
+    } else {
+      frames.reset();
+    }
+  } else {
+    std::string buffer(entry.stored_size, '\0');
+    if (file_->Read(buffer.data(), buffer.size(), entry.offset)) {
+      AddIoStats({.bytes_read = buffer.size(), .read_calls = 1});
+      frames = Decode(index, buffer);
+      if (!frames) return std::nullopt;
+    }
+  }
+  if (!frames) {
+    LOG(WARNING) << "Failed to read chunk " << index << " from " << filename_;
+    return std::nullopt;
+  }
+  file_->Release(entry.offset, entry.stored_size);
+  return frames;
+}
+
+std::optional<ChunkSource::StoredChunk> PackedChunkSource::GetStoredChunk(
+    size_t index) const {
+  if (index >= entries_.size()) {
+    throw std::out_of_range("Chunk index out of range");
+  }
+  // As in TarChunkSource.
+  if (!file_ || file_->policy() == CachePolicy::kDirect) return std::nullopt;
+  auto lease = file_->Borrow();
+  if (!lease) return std::nullopt;
+  return StoredChunk{.file = std::move(*lease),
+                     .offset = static_cast<off_t>(entries_[index].offset),
+                     .size = entries_[index].stored_size};
+}
+
+std::optional<std::vector<FrameType>> PackedChunkSource::DecodeStoredChunk(
+    size_t index, std::string_view stored) {
+  // The caller issued one read for the chunk.
+  AddIoStats({.bytes_read = stored.size(), .read_calls = 1});
+  if (!file_) return Decode(index, stored);
+  file_->CountRead(stored.size());
+  auto frames = Decode(index, stored);
+  file_->Release(entries_.at(index).offset, stored.size());
+  return frames;
+}
+
+std::optional<size_t> PackedChunkSource::GetChunkFrameCount(
+    size_t index) const {
+  if (index >= entries_.size()) {
+    throw std::out_of_range("Chunk index out of range");
+  }
+  return entries_[index].frame_count;
+}
+
+std::optional<std::vector<FrameType>> PackedChunkSource::Decode(
+    size_t index, std::string_view stored) {
+  return CountedDecode([&]() -> std::optional<std::vector<FrameType>> {
+    const auto& entry = entries_.at(index);
+    std::vector<FrameType> frames(entry.frame_count);
+    const std::span<char> output(reinterpret_cast<char*>(frames.data()),
+                                 frames.size() * sizeof(FrameType));
+    if (stored.size() != entry.stored_size) {
+      LOG(WARNING) << "Chunk " << index << " from " << filename_
+                   << " has unexpected size " << stored.size();
+      return std::nullopt;
+    }
+    if (entry.codec == PackedCodec::kStored) {
+      std::memcpy(output.data(), stored.data(), output.size());
+      return frames;
+    }
+    try {
+      if (GunzipInto(stored, output) != output.size()) {
+        LOG(WARNING) << "Chunk " << index << " from " << filename_
+                     << " is shorter than its index entry";
+        return std::nullopt;
+      }
+    } catch (const GunzipError& e) {
+      LOG(WARNING) << "Failed to decompress chunk " << index << " from "
+                   << filename_ << ": " << e.what();
+      return std::nullopt;
+    }
+    return frames;
+  });
+}
+
+}  // namespace training
+}  // namespace lczero
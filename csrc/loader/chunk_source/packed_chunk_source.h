@@ -0,0 +1,67 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "loader/chunk_source/chunk_source.h"
+#include "loader/chunk_source/packed_chunk_format.h"
+#include "proto/data_loader_config.pb.h"
+#include "utils/file_io.h"
+#include "utils/mapped_file.h"
+
+namespace lczero {
+namespace training {
+
+// A chunk source that reads a .lczpack archive (see packed_chunk_format.h).
+// Indexing reads only the footer and the index. Stored chunks are copied
+// straight into the frame buffer, gzip chunks are inflated into it.
+// Like TarChunkSource, all reads are positional or come from memory, so
+// GetChunkData() is safe to call concurrently. Throws std::runtime_error from
+// the constructor if the file can't be opened or is not a valid archive.
+class PackedChunkSource : public ChunkSource {
+ public:
+  PackedChunkSource(const std::filesystem::path& filename,
+                    ChunkSourceLoaderConfig::ReadMode read_mode =
+                        ChunkSourceLoaderConfig::PREAD,
+                    CachePolicy cache_policy = CachePolicy::kBuffered,
+                    std::shared_ptr<FileReadCounters> read_counters = nullptr);
+  ~PackedChunkSource() override;
+
+  std::string GetChunkSortKey() const override;
+  size_t GetChunkCount() const override;
+  std::optional<std::vector<FrameType>> GetChunkData(size_t index) override;
+  // Reads all chunks into memory and closes the file.
+  bool MakeResident() override;
+  size_t GetResidentBytes() const override;
+  std::optional<StoredChunk> GetStoredChunk(size_t index) const override;
+  std::optional<std::vector<FrameType>> DecodeStoredChunk(
+      size_t index, std::string_view stored) override;
+  // From the index.
+  std::optional<size_t> GetChunkFrameCount(size_t index) const override;
+
+ private:
+  void ReadIndex(uint64_t file_size);
+  std::optional<std::vector<FrameType>> Decode(size_t index,
+                                               std::string_view stored);
+  // Copies `size` bytes at `offset` of the file into `buffer`.
+  bool ReadAt(void* buffer, size_t size, uint64_t offset) const;
+  // Returns `size` bytes at `offset` of the file if they are in memory.
+  std::optional<std::string_view> ViewAt(size_t size, uint64_t offset) const;
+
+  // Exactly one of file_, mapped_file_ and resident_data_ is set, as in
+  // TarChunkSource.
+  std::unique_ptr<ReadOnlyFile> file_;
+  std::unique_ptr<MappedFile> mapped_file_;
+  // Bytes of the file starting at resident_offset_.
+  std::string resident_data_;
+  uint64_t resident_offset_ = 0;
+  std::vector<PackedChunkEntry> entries_;
+  std::string filename_;
+};
+
+}  // namespace training
+}  // namespace lczero
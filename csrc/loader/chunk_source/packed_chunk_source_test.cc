@@ -0,0 +1,166 @@
+#include "loader/chunk_source/packed_chunk_source.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "loader/chunk_source/packed_chunk_format.h"
+
+namespace lczero {
+namespace training {
+
+namespace {
+
+std::vector<FrameType> MakeChunk(uint32_t id, size_t frame_count) {
+  std::vector<FrameType> frames(frame_count);
+  for (size_t i = 0; i < frame_count; ++i) {
+    frames[i].version = 7;
+    frames[i].input_format = id;
+    frames[i].best_idx = static_cast<uint32_t>(i);
+  }
+  return frames;
+}
+
+bool SameFrames(const std::vector<FrameType>& a,
+                const std::vector<FrameType>& b) {
+  return a.size() == b.size() &&
+         std::memcmp(a.data(), b.data(), a.size() * sizeof(FrameType)) == 0;
+}
+
+}  // namespace
+
+class PackedChunkSourceTest : public ::testing::TestWithParam<int> {
+ protected:
+  void SetUp() override {
+    test_dir_ =
+        std::filesystem::temp_directory_path() /
+        ("packed_chunk_source_test_" +
+         std::to_string(
+             std::chrono::steady_clock::now().time_since_epoch().count()));
+    std::filesystem::create_directories(test_dir_);
+    path_ = test_dir_ / "archive.lczpack";
+    chunks_ = {MakeChunk(1, 3), MakeChunk(2, 1), MakeChunk(3, 0),
+               MakeChunk(4, 5)};
+    PackedChunkWriter writer(path_, GetParam());
+    for (const auto& chunk : chunks_) writer.AddChunk(chunk);
+    writer.Finish();
+  }
+
+  void TearDown() override {
+    if (std::filesystem::exists(test_dir_)) {
+      std::filesystem::remove_all(test_dir_);
+    }
+  }
+
+  void ExpectAllChunks(ChunkSource& source) {
+    ASSERT_EQ(source.GetChunkCount(), chunks_.size());
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+      const auto frames = source.GetChunkData(i);
+      ASSERT_TRUE(frames.has_value()) << "chunk " << i;
+      EXPECT_EQ(source.GetChunkFrameCount(i), frames->size()) << "chunk " << i;
+      EXPECT_TRUE(SameFrames(*frames, chunks_[i])) << "chunk " << i;
+    }
+  }
+
+  std::filesystem::path test_dir_;
+  std::filesystem::path path_;
+  std::vector<std::vector<FrameType>> chunks_;
+};
+
+TEST_P(PackedChunkSourceTest, ReadsChunksWithPread) {
+  PackedChunkSource source(path_, ChunkSourceLoaderConfig::PREAD);
+  EXPECT_EQ(source.GetChunkSortKey(), "archive.lczpack");
+  ExpectAllChunks(source);
+}
+
+TEST_P(PackedChunkSourceTest, ReadsChunksWithMmap) {
+  PackedChunkSource source(path_, ChunkSourceLoaderConfig::MMAP);
+  ExpectAllChunks(source);
+}
+
+TEST_P(PackedChunkSourceTest, ReadsChunksWithCachePolicies) {
+  for (CachePolicy policy : {CachePolicy::kFadvise, CachePolicy::kDirect}) {
+    auto counters = std::make_shared<FileReadCounters>();
+    PackedChunkSource source(path_, ChunkSourceLoaderConfig::PREAD, policy,
+                             counters);
+    const uint64_t index_bytes = counters->bytes_read;
+    ExpectAllChunks(source);
+    EXPECT_GT(counters->bytes_read, index_bytes);
+    EXPECT_GT(counters->cache_bypassed_reads, 0u);
+  }
+}
+
+TEST_P(PackedChunkSourceTest, ReadsChunksWhenResident) {
+  PackedChunkSource source(path_);
+  ASSERT_TRUE(source.MakeResident());
+  EXPECT_GT(source.GetResidentBytes(), 0u);
+  std::filesystem::remove(path_);
+  ExpectAllChunks(source);
+}
+
+TEST_P(PackedChunkSourceTest, CountsIoStats) {
+  uint64_t frame_bytes = 0;
+  for (const auto& chunk : chunks_) {
+    frame_bytes += chunk.size() * sizeof(FrameType);
+  }
+  for (auto read_mode :
+       {ChunkSourceLoaderConfig::PREAD, ChunkSourceLoaderConfig::MMAP}) {
+    PackedChunkSource source(path_, read_mode);
+    ExpectAllChunks(source);
+    const ChunkSourceIoStats stats = source.FlushIoStats();
+    EXPECT_GT(stats.bytes_read, 0u);
+    EXPECT_EQ(stats.bytes_decoded, frame_bytes);
+    EXPECT_EQ(stats.read_calls, read_mode == ChunkSourceLoaderConfig::PREAD
+                                    ? chunks_.size()
+                                    : 0u);
+    EXPECT_EQ(stats.failed_decodes, 0u);
+    EXPECT_EQ(source.FlushIoStats().bytes_decoded, 0u);
+  }
+}
+
+TEST_P(PackedChunkSourceTest, StoresChunksAligned) {
+  std::ifstream file(path_, std::ios::binary);
+  file.seekg(-static_cast<std::streamoff>(sizeof(PackedFooter)),
+             std::ios::end);
+  PackedFooter footer;
+  file.read(reinterpret_cast<char*>(&footer), sizeof(footer));
+  ASSERT_EQ(footer.chunk_count, chunks_.size());
+  std::vector<PackedChunkEntry> entries(footer.chunk_count);
+  file.seekg(footer.index_offset);
+  file.read(reinterpret_cast<char*>(entries.data()),
+            entries.size() * sizeof(PackedChunkEntry));
+  for (const auto& entry : entries) {
+    EXPECT_EQ(entry.offset % kPackedAlignment, 0u);
+    EXPECT_EQ(entry.codec, GetParam() && entry.frame_count
+                               ? PackedCodec::kGzip
+                               : PackedCodec::kStored);
+  }
+}
+
+TEST_P(PackedChunkSourceTest, RejectsCorruptedIndex) {
+  const auto size = std::filesystem::file_size(path_);
+  {
+    std::fstream file(path_, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(size - sizeof(PackedFooter) - 1);
+    file.put('\x55');
+  }
+  EXPECT_THROW(PackedChunkSource source(path_), std::runtime_error);
+}
+
+TEST_P(PackedChunkSourceTest, RejectsOtherFiles) {
+  std::ofstream(path_, std::ios::binary | std::ios::trunc)
+      << std::string(200, 'x');
+  EXPECT_THROW(PackedChunkSource source(path_), std::runtime_error);
+}
+
+INSTANTIATE_TEST_SUITE_P(Codecs, PackedChunkSourceTest,
+                         ::testing::Values(0, 1));
+
+}  // namespace training
+}  // namespace lczero
@@ -1,58 +1,182 @@
 #include "loader/chunk_source/rawfile_chunk_source.h"
 
 #include <absl/log/log.h>
+#include <sys/mman.h>
 
-#include <fstream>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <optional>
 #include <stdexcept>
+#include <string>
+#include <utility>
 
-#include "trainingdata/trainingdata_v6.h"
-#include "utils/files.h"
-#include "utils/gz.h"
+#include "loader/chunk_source/frame_decoder.h"
+#include "utils/mapped_file.h"
 
 namespace lczero {
 namespace training {
+namespace {
+
+bool IsGzip(std::string_view data) {
+  return data.size() >= 2 && static_cast<unsigned char>(data[0]) == 0x1f &&
+         static_cast<unsigned char>(data[1]) == 0x8b;
+}
+
+}  // namespace
 
 RawFileChunkSource::RawFileChunkSource(
     const std::filesystem::path& filename,
-    ChunkSourceLoaderConfig::FrameFormat frame_format)
-    : filename_(filename), frame_format_(frame_format) {}
+    ChunkSourceLoaderConfig::FrameFormat frame_format,
+    ChunkSourceLoaderConfig::ReadMode read_mode, CachePolicy cache_policy,
+    std::shared_ptr<FileReadCounters> read_counters)
+    : RawFileChunkSource(filename.parent_path(), {filename.filename().string()},
+                         frame_format, read_mode, cache_policy,
+                         std::move(read_counters)) {}
+
+RawFileChunkSource::RawFileChunkSource(
+    const std::filesystem::path& directory, std::vector<std::string> filenames,
+    ChunkSourceLoaderConfig::FrameFormat frame_format,
+    ChunkSourceLoaderConfig::ReadMode read_mode, CachePolicy cache_policy,
+    std::shared_ptr<FileReadCounters> read_counters)
+    : directory_(directory),
+      frame_format_(frame_format),
+      read_mode_(read_mode),
+      cache_policy_(cache_policy),
+      read_counters_(std::move(read_counters)) {
+  assert(!filenames.empty());
+  std::sort(filenames.begin(), filenames.end());
+  name_ends_.reserve(filenames.size());
+  for (const auto& name : filenames) {
+    names_.append(name);
+    name_ends_.push_back(static_cast<uint32_t>(names_.size()));
+  }
+  names_.shrink_to_fit();
+}
 
 RawFileChunkSource::~RawFileChunkSource() = default;
 
 std::string RawFileChunkSource::GetChunkSortKey() const {
-  return std::filesystem::path(filename_).filename().string();
+  return std::string(GetFilename(0));
 }
 
-size_t RawFileChunkSource::GetChunkCount() const { return 1; }
+size_t RawFileChunkSource::GetChunkCount() const { return name_ends_.size(); }
+
+std::string_view RawFileChunkSource::GetFilename(size_t index) const {
+  const uint32_t begin = index == 0 ? 0 : name_ends_[index - 1];
+  return std::string_view(names_).substr(begin, name_ends_[index] - begin);
+}
+
+std::filesystem::path RawFileChunkSource::GetPath(size_t index) const {
+  return directory_ / GetFilename(index);
+}
 
 std::optional<std::vector<FrameType>> RawFileChunkSource::GetChunkData(
     size_t index) {
-  if (index != 0) return std::nullopt;
-  std::string data = ReadFileToString(filename_);
-  if (data.empty()) return std::nullopt;
-
-  const size_t input_size =
-      frame_format_ == ChunkSourceLoaderConfig::V7TrainingData
-          ? sizeof(V7TrainingData)
-          : sizeof(V6TrainingData);
-  if (data.size() % input_size != 0) {
-    LOG(WARNING) << "File " << filename_ << " size " << data.size()
-                 << " is not a multiple of input frame size " << input_size;
-    return std::nullopt;
+  if (index >= name_ends_.size()) return std::nullopt;
+  const std::filesystem::path path = GetPath(index);
+  // The mapping only lives for this call: keeping one per loose file would
+  // quickly exhaust vm.max_map_count.
+  std::optional<MappedFile> mapped_file;
+  std::string buffer;
+  std::string_view data;
+  if (!resident_data_.empty()) {
+    data = resident_data_[index];
+  } else if (read_mode_ == ChunkSourceLoaderConfig::MMAP) {
+    try {
+      mapped_file.emplace(path);
+    } catch (const std::exception& e) {
+      LOG(WARNING) << e.what();
+      return std::nullopt;
+    }
+    // The whole file is consumed front to back right away.
+    mapped_file->Advise(MADV_SEQUENTIAL);
+    mapped_file->Advise(MADV_WILLNEED);
+    data = mapped_file->data();
+  } else {
+    auto contents = ReadFile(index);
+    if (!contents) return std::nullopt;
+    buffer = std::move(*contents);
+    data = buffer;
   }
+  AddIoStats({.bytes_read = data.size(),
+              .read_calls = resident_data_.empty() && !mapped_file ? 1u : 0u});
+  return CountedDecode([&] {
+    return DecodeFrames(data, IsGzip(data), frame_format_, path.string());
+  });
+}
 
-  const size_t num_frames = data.size() / input_size;
-  std::vector<V7TrainingData> result(num_frames);
+bool RawFileChunkSource::MakeResident() {
+  if (!resident_data_.empty()) return true;
+  std::vector<std::string> data;
+  data.reserve(name_ends_.size());
+  size_t bytes = 0;
+  for (size_t i = 0; i < name_ends_.size(); ++i) {
+    auto contents = ReadFile(i);
+    if (!contents) return false;
+    bytes += contents->size();
+    data.push_back(std::move(*contents));
+  }
+  if (bytes == 0) return false;
+  resident_data_ = std::move(data);
+  resident_bytes_ = bytes;
+  return true;
+}
 
-  if (frame_format_ == ChunkSourceLoaderConfig::V7TrainingData) {
-    std::memcpy(result.data(), data.data(), data.size());
-  } else {
-    const auto* v6_data = reinterpret_cast<const V6TrainingData*>(data.data());
-    for (size_t i = 0; i < num_frames; ++i) {
-      std::memcpy(&result[i], &v6_data[i], sizeof(V6TrainingData));
+std::optional<std::string> RawFileChunkSource::ReadFile(size_t index) const {
+  const std::filesystem::path path = GetPath(index);
+  try {
+    const ReadOnlyFile file(path, cache_policy_, read_counters_);
+    std::string contents(file.size(), '\0');
+    if (!file.Read(contents.data(), contents.size(), 0)) {
+      LOG(WARNING) << "Failed to read " << path;
+      return std::nullopt;
     }
+    // The file is read exactly once, even when it's kept resident.
+    file.Release(0, contents.size());
+    return contents;
+  } catch (const std::exception& e) {
+    LOG(WARNING) << e.what();
+    return std::nullopt;
+  }
+}
+
+size_t RawFileChunkSource::GetResidentBytes() const { return resident_bytes_; }
+
+std::optional<size_t> RawFileChunkSource::GetChunkFrameCount(
+    size_t index) const {
+  if (index >= name_ends_.size()) return std::nullopt;
+  auto peek = [this](auto read_at, uint64_t size) {
+    std::array<char, 2> magic;
+    if (!read_at(magic.data(), magic.size(), 0)) return std::optional<size_t>();
+    return PeekFrameCount(read_at, size,
+                          IsGzip(std::string_view(magic.data(), magic.size())),
+                          frame_format_);
+  };
+  if (!resident_data_.empty()) {
+    const std::string_view data = resident_data_[index];
+    return peek(
+        [data](void* buffer, size_t size, uint64_t offset) {
+          if (offset + size > data.size()) return false;
+          std::memcpy(buffer, data.data() + offset, size);
+          return true;
+        },
+        data.size());
+  }
+  try {
+    // Unaccounted, the few bytes would only skew bytes_read.
+    const ReadOnlyFile file(GetPath(index), cache_policy_);
+    return peek(
+        [&file](void* buffer, size_t size, uint64_t offset) {
+          return offset + size <= file.size() &&
+                 file.Read(buffer, size, offset);
+        },
+        file.size());
+  } catch (const std::exception& e) {
+    LOG(WARNING) << e.what();
+    return std::nullopt;
   }
-  return result;
 }
 
 }  // namespace training
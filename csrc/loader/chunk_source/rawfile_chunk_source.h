@@ -1,29 +1,67 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "loader/chunk_source/chunk_source.h"
 #include "proto/data_loader_config.pb.h"
+#include "utils/file_io.h"
 
 namespace lczero {
 namespace training {
 
-// A chunk source that reads a single (potentially gzipped) file as a single
-// chunk.
+// A chunk source that reads loose (potentially gzipped) files, each file as a
+// single chunk. Usually that's one file, but the loader groups loose files of
+// a directory into one source (see ChunkSourceLoaderConfig), so that they
+// don't each cost a source in the pool. Only the file names are kept in
+// memory; every read opens the file.
 class RawFileChunkSource : public ChunkSource {
  public:
   RawFileChunkSource(const std::filesystem::path& filename,
-                     ChunkSourceLoaderConfig::FrameFormat frame_format);
+                     ChunkSourceLoaderConfig::FrameFormat frame_format,
+                     ChunkSourceLoaderConfig::ReadMode read_mode =
+                         ChunkSourceLoaderConfig::PREAD,
+                     CachePolicy cache_policy = CachePolicy::kBuffered,
+                     std::shared_ptr<FileReadCounters> read_counters = nullptr);
+  // Files `filenames` of `directory`. Chunks are in the sorted order of the
+  // names, and the sort key is the first name.
+  RawFileChunkSource(const std::filesystem::path& directory,
+                     std::vector<std::string> filenames,
+                     ChunkSourceLoaderConfig::FrameFormat frame_format,
+                     ChunkSourceLoaderConfig::ReadMode read_mode =
+                         ChunkSourceLoaderConfig::PREAD,
+                     CachePolicy cache_policy = CachePolicy::kBuffered,
+                     std::shared_ptr<FileReadCounters> read_counters = nullptr);
   ~RawFileChunkSource();
 
  private:
   std::string GetChunkSortKey() const override;
   size_t GetChunkCount() const override;
   std::optional<std::vector<FrameType>> GetChunkData(size_t index) override;
+  bool MakeResident() override;
+  size_t GetResidentBytes() const override;
+  // From the file size or the gzip trailer, with two small reads.
+  std::optional<size_t> GetChunkFrameCount(size_t index) const override;
+  std::string_view GetFilename(size_t index) const;
+  std::filesystem::path GetPath(size_t index) const;
+  // Reads a whole file under the cache policy.
+  std::optional<std::string> ReadFile(size_t index) const;
 
-  std::string filename_;
+  std::filesystem::path directory_;
+  // All file names back to back; name i ends at name_ends_[i].
+  std::string names_;
+  std::vector<uint32_t> name_ends_;
   ChunkSourceLoaderConfig::FrameFormat frame_format_;
+  ChunkSourceLoaderConfig::ReadMode read_mode_;
+  CachePolicy cache_policy_;
+  std::shared_ptr<FileReadCounters> read_counters_;
+  // Raw file contents once MakeResident() has been called.
+  std::vector<std::string> resident_data_;
+  size_t resident_bytes_ = 0;
 };
 
 }  // namespace training
@@ -1,17 +1,22 @@
 #include "loader/chunk_source/tar_chunk_source.h"
 
+#include <absl/functional/function_ref.h>
 #include <absl/log/log.h>
 #include <absl/strings/str_cat.h>
+#include <sys/mman.h>
 #include <zlib.h>
 
 #include <algorithm>
 #include <array>
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <stdexcept>
+#include <utility>
 
-#include "trainingdata/trainingdata_v6.h"
-#include "utils/gz.h"
+#include "loader/chunk_source/frame_decoder.h"
+#include "utils/file_io.h"
+#include "utils/mapped_file.h"
 
 namespace lczero {
 namespace training {
@@ -46,14 +51,11 @@ uint64_t ParseOctal(const std::array<uint8_t, 12>& octal) {
   return value;
 }
 
-std::optional<std::string> ReadGzipPrefix(FILE* file, long int offset,
-                                          long int size, size_t max_bytes) {
+std::optional<std::string> ReadGzipPrefix(
+    absl::FunctionRef<bool(void*, size_t, long int)> read_at, long int offset,
+    long int size, size_t max_bytes) {
   if (max_bytes == 0) return std::string();
 
-  if (fseek(file, offset, SEEK_SET) != 0) {
-    return std::nullopt;
-  }
-
   z_stream strm = {};
   if (inflateInit2(&strm, 16 + MAX_WBITS) != Z_OK) {
     return std::nullopt;
@@ -72,15 +74,15 @@ std::optional<std::string> ReadGzipPrefix(FILE* file, long int offset,
   while (remaining > 0 && !finished && output.size() < max_bytes) {
     const size_t to_read = static_cast<size_t>(
         std::min<long int>(remaining, static_cast<long int>(kChunkSize)));
-    const size_t read = fread(input_buffer.data(), 1, to_read, file);
-    if (read != to_read) {
+    if (!read_at(input_buffer.data(), to_read, offset)) {
       inflateEnd(&strm);
       return std::nullopt;
     }
-    remaining -= static_cast<long int>(read);
+    offset += static_cast<long int>(to_read);
+    remaining -= static_cast<long int>(to_read);
 
     strm.next_in = reinterpret_cast<Bytef*>(input_buffer.data());
-    strm.avail_in = static_cast<uInt>(read);
+    strm.avail_in = static_cast<uInt>(to_read);
 
     while (strm.avail_in > 0 && output.size() < max_bytes) {
       strm.next_out = reinterpret_cast<Bytef*>(output_buffer.data());
@@ -112,58 +114,151 @@ std::optional<std::string> ReadGzipPrefix(FILE* file, long int offset,
 
 TarChunkSource::TarChunkSource(
     const std::filesystem::path& filename,
-    ChunkSourceLoaderConfig::FrameFormat frame_format)
-    : file_(fopen(filename.string().c_str(), "rb")),
-      filename_(filename.filename().string()),
-      frame_format_(frame_format) {
-  if (!file_) throw std::runtime_error("Failed to open tar file");
+    ChunkSourceLoaderConfig::FrameFormat frame_format,
+    ChunkSourceLoaderConfig::ReadMode read_mode, CachePolicy cache_policy,
+    std::shared_ptr<FileReadCounters> read_counters)
+    : filename_(filename.filename().string()), frame_format_(frame_format) {
+  Open(filename, read_mode, cache_policy, std::move(read_counters));
   // Perform indexing during construction.
   Index();
 }
 
-TarChunkSource::~TarChunkSource() {
-  if (file_) fclose(file_);
+TarChunkSource::TarChunkSource(
+    const std::filesystem::path& filename,
+    ChunkSourceLoaderConfig::FrameFormat frame_format,
+    ChunkSourceLoaderConfig::ReadMode read_mode, std::vector<FileEntry> files,
+    CachePolicy cache_policy, std::shared_ptr<FileReadCounters> read_counters)
+    : files_(std::move(files)),
+      filename_(filename.filename().string()),
+      frame_format_(frame_format) {
+  Open(filename, read_mode, cache_policy, std::move(read_counters));
+}
+
+void TarChunkSource::Open(const std::filesystem::path& filename,
+                          ChunkSourceLoaderConfig::ReadMode read_mode,
+                          CachePolicy cache_policy,
+                          std::shared_ptr<FileReadCounters> read_counters) {
+  if (read_mode == ChunkSourceLoaderConfig::MMAP) {
+    mapped_file_ = std::make_unique<MappedFile>(filename);
+    // Chunks are drawn in shuffled order, so readahead would only pull in
+    // pages of chunks that are not going to be read next.
+    mapped_file_->Advise(MADV_RANDOM);
+  } else {
+    file_ = std::make_unique<ReadOnlyFile>(filename, cache_policy,
+                                           std::move(read_counters));
+  }
 }
 
+TarChunkSource::~TarChunkSource() = default;
+
 std::string TarChunkSource::GetChunkSortKey() const { return filename_; }
 
+std::optional<std::string_view> TarChunkSource::ViewAt(size_t size,
+                                                      long int offset) const {
+  std::string_view data;
+  if (!resident_data_.empty()) {
+    data = resident_data_;
+    offset -= resident_offset_;
+  } else if (mapped_file_) {
+    data = mapped_file_->data();
+  } else {
+    return std::nullopt;
+  }
+  if (offset < 0 || static_cast<size_t>(offset) + size > data.size()) {
+    return std::nullopt;
+  }
+  return data.substr(offset, size);
+}
+
+bool TarChunkSource::ReadAt(void* buffer, size_t size, long int offset) const {
+  if (file_) return file_->Read(buffer, size, offset);
+  const auto view = ViewAt(size, offset);
+  if (!view) return false;
+  std::memcpy(buffer, view->data(), size);
+  return true;
+}
+
+bool TarChunkSource::MakeResident() {
+  if (!resident_data_.empty()) return true;
+  if (files_.empty()) return false;
+  // Members are stored in offset order, so one read covers all of them (and
+  // the tar headers in between, which are small compared to the chunks).
+  const long int begin = files_.front().offset;
+  const long int end = files_.back().offset + files_.back().size;
+  std::string data(end - begin, '\0');
+  if (!ReadAt(data.data(), data.size(), begin)) {
+    LOG(WARNING) << "Failed to load " << filename_ << " into memory";
+    return false;
+  }
+  resident_data_ = std::move(data);
+  resident_offset_ = begin;
+  // The file is not needed anymore.
+  if (file_) file_->Release(begin, resident_data_.size());
+  file_.reset();
+  mapped_file_.reset();
+  return true;
+}
+
+size_t TarChunkSource::GetResidentBytes() const {
+  return resident_data_.size();
+}
+
+std::optional<TarChunkSource::Member> TarChunkSource::ParseHeader(
+    std::string_view block, long int header_offset) {
+  assert(block.size() == sizeof(TarHeader));
+  TarHeader header;
+  std::memcpy(&header, block.data(), sizeof(header));
+  if (header.name[0] == '\0') return std::nullopt;  // End of file.
+
+  Member member;
+  member.next_header = header_offset + sizeof(header);
+  switch (header.typeflag) {
+    case '5':  // Directory
+      return member;
+    case '0':  // Regular file
+      break;
+    default:
+      LOG(WARNING) << "Unsupported tar header type: " << header.typeflag;
+      return member;
+  }
+
+  member.name = std::string(
+      header.name.data(), strnlen(header.name.data(), header.name.size()));
+  const std::filesystem::path filepath(member.name);
+  const long int size = ParseOctal(header.size);
+  member.entry = {member.next_header, size, filepath.extension() == ".gz"};
+  member.is_chunk = filepath.filename() != "LICENSE";
+  member.next_header += (size + 511) / 512 * 512;
+  return member;
+}
+
 void TarChunkSource::Index() {
   assert(files_.empty());
 
+  const long int file_size = static_cast<long int>(
+      mapped_file_ ? mapped_file_->size() : file_->size());
+
+  long int offset = 0;
   while (true) {
-    TarHeader header;
-    if (fread(&header, sizeof(header), 1, file_) != 1) {
+    std::array<char, sizeof(TarHeader)> header;
+    if (!ReadAt(header.data(), header.size(), offset)) {
       LOG(WARNING) << "Truncated tar file: " << filename_;
       break;
     }
-
-    if (header.name[0] == '\0') break;  // End of file.
-
-    switch (header.typeflag) {
-      case '5':  // Directory
-        continue;
-      case '0':  // Regular file
-        break;
-      default:
-        LOG(WARNING) << "Unsupported tar header type: " << header.typeflag;
-        continue;
-    }
-
-    std::string_view fname(const_cast<const char*>(header.name.data()));
-    const std::filesystem::path filepath = std::filesystem::path(fname);
-    const long int offset = ftell(file_);
-    const long int size = ParseOctal(header.size);
-    const long int new_offset = offset + (size + 511) / 512 * 512;
-    fseek(file_, new_offset, SEEK_SET);
-    if (new_offset != ftell(file_)) {
-      LOG(WARNING) << "Truncated tar file at " << fname
-                   << ", expected size: " << size
-                   << ", actual size: " << (new_offset - offset);
+    const auto member =
+        ParseHeader(std::string_view(header.data(), header.size()), offset);
+    if (!member) break;
+    offset = member->next_header;
+    if (!member->is_chunk) continue;
+
+    const FileEntry& entry = member->entry;
+    if (entry.offset + entry.size > file_size) {
+      LOG(WARNING) << "Truncated tar file at " << member->name
+                   << ", expected size: " << entry.size
+                   << ", actual size: " << (file_size - entry.offset);
       break;
     }
-
-    if (filepath.filename() == "LICENSE") continue;
-    files_.push_back({offset, size, filepath.extension() == ".gz"});
+    files_.push_back(entry);
   }
 
   LOG(INFO) << "Read " << files_.size() << " entries from " << filename_;
@@ -177,42 +272,74 @@ std::optional<std::vector<FrameType>> TarChunkSource::GetChunkData(
     throw std::out_of_range("File index out of range");
   }
   const auto& file_entry = files_[index];
-  std::string content(file_entry.size, '\0');
-  fseek(file_, file_entry.offset, SEEK_SET);
-  fread(content.data(), 1, file_entry.size, file_);
-  if (file_entry.is_gzip) {
-    try {
-      content = GunzipBuffer(content);
-    } catch (const GunzipError& e) {
-      return std::nullopt;
-    }
+  // In memory (mmap or resident) the entry is used in place, otherwise it is
+  // read into buffer.
+  if (auto view = ViewAt(file_entry.size, file_entry.offset)) {
+    AddIoStats({.bytes_read = view->size()});
+    return Decode(index, *view);
   }
-  if (content.empty()) return std::nullopt;
-
-  const size_t input_size =
-      frame_format_ == ChunkSourceLoaderConfig::V7TrainingData
-          ? sizeof(V7TrainingData)
-          : sizeof(V6TrainingData);
-  if (content.size() % input_size != 0) {
-    LOG(WARNING) << "Chunk " << index << " from " << filename_ << " size "
-                 << content.size() << " is not a multiple of input frame size "
-                 << input_size;
+  std::string buffer(file_entry.size, '\0');
+  if (!file_->Read(buffer.data(), buffer.size(), file_entry.offset)) {
+    LOG(WARNING) << "Failed to read chunk " << index << " from " << filename_;
     return std::nullopt;
   }
+  AddIoStats({.bytes_read = buffer.size(), .read_calls = 1});
+  auto frames = Decode(index, buffer);
+  file_->Release(file_entry.offset, buffer.size());
+  return frames;
+}
 
-  const size_t num_frames = content.size() / input_size;
-  std::vector<V7TrainingData> result(num_frames);
+std::optional<ChunkSource::StoredChunk> TarChunkSource::GetStoredChunk(
+    size_t index) const {
+  if (index >= files_.size()) {
+    throw std::out_of_range("File index out of range");
+  }
+  // Chunks in memory are cheaper to decode right away, and O_DIRECT reads
+  // need aligned buffers.
+  if (!file_ || file_->policy() == CachePolicy::kDirect) return std::nullopt;
+  auto lease = file_->Borrow();
+  if (!lease) return std::nullopt;
+  return StoredChunk{.file = std::move(*lease),
+                     .offset = files_[index].offset,
+                     .size = static_cast<size_t>(files_[index].size)};
+}
 
-  if (frame_format_ == ChunkSourceLoaderConfig::V7TrainingData) {
-    std::memcpy(result.data(), content.data(), content.size());
-  } else {
-    const auto* v6_data =
-        reinterpret_cast<const V6TrainingData*>(content.data());
-    for (size_t i = 0; i < num_frames; ++i) {
-      std::memcpy(&result[i], &v6_data[i], sizeof(V6TrainingData));
-    }
+std::optional<std::vector<FrameType>> TarChunkSource::DecodeStoredChunk(
+    size_t index, std::string_view stored) {
+  // The caller issued one read for the chunk.
+  AddIoStats({.bytes_read = stored.size(), .read_calls = 1});
+  if (!file_) return Decode(index, stored);
+  file_->CountRead(stored.size());
+  auto frames = Decode(index, stored);
+  file_->Release(files_.at(index).offset, stored.size());
+  return frames;
+}
+
+std::optional<std::vector<FrameType>> TarChunkSource::Decode(
+    size_t index, std::string_view stored) {
+  return CountedDecode([&] {
+    return DecodeFrames(stored, files_.at(index).is_gzip, frame_format_,
+                        absl::StrCat("chunk ", index, " from ", filename_));
+  });
+}
+
+std::optional<size_t> TarChunkSource::GetChunkFrameCount(size_t index) const {
+  if (index >= files_.size()) {
+    throw std::out_of_range("File index out of range");
+  }
+  const auto& file_entry = files_[index];
+  if (file_entry.frame_count > 0) return file_entry.frame_count;
+  return PeekFrameCount(
+      [this, &file_entry](void* buffer, size_t size, uint64_t offset) {
+        return ReadAt(buffer, size, file_entry.offset + offset);
+      },
+      file_entry.size, file_entry.is_gzip, frame_format_);
+}
+
+void TarChunkSource::CountFrames() {
+  for (size_t i = 0; i < files_.size(); ++i) {
+    files_[i].frame_count = GetChunkFrameCount(i).value_or(0);
   }
-  return result;
 }
 
 std::optional<std::string> TarChunkSource::GetChunkPrefix(size_t index,
@@ -222,17 +349,17 @@ std::optional<std::string> TarChunkSource::GetChunkPrefix(size_t index,
   }
   const auto& file_entry = files_[index];
   if (file_entry.is_gzip) {
-    return ReadGzipPrefix(file_, file_entry.offset, file_entry.size, max_bytes);
+    return ReadGzipPrefix(
+        [this](void* buffer, size_t size, long int offset) {
+          return ReadAt(buffer, size, offset);
+        },
+        file_entry.offset, file_entry.size, max_bytes);
   }
 
   const size_t to_read =
       std::min(static_cast<size_t>(file_entry.size), max_bytes);
   std::string content(to_read, '\0');
-  if (fseek(file_, file_entry.offset, SEEK_SET) != 0) {
-    return std::nullopt;
-  }
-  const size_t read = fread(content.data(), 1, to_read, file_);
-  if (read != to_read) {
+  if (!ReadAt(content.data(), to_read, file_entry.offset)) {
     return std::nullopt;
   }
   return content;
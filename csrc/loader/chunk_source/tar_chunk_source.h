@@ -1,37 +1,108 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "loader/chunk_source/chunk_source.h"
 #include "proto/data_loader_config.pb.h"
+#include "utils/file_io.h"
+#include "utils/mapped_file.h"
 
 namespace lczero {
 namespace training {
 
 // A chunk source that reads a tar archive and provides access to its files as
 // chunks. Each file in the tar is treated as a separate chunk.
+// All reads are positional (pread) into per-call buffers, or come straight
+// from a read-only mapping in MMAP mode or from memory after MakeResident(), so
+// GetChunkData() and GetChunkPrefix() are safe to call concurrently from
+// multiple threads.
 class TarChunkSource : public ChunkSource {
  public:
+  // Location of a single member file inside the tar archive.
+  struct FileEntry {
+    long int offset;
+    long int size;
+    bool is_gzip;
+    // Number of frames, or 0 if not counted (see CountFrames()).
+    uint32_t frame_count = 0;
+  };
+
+  // A member of the archive, as described by its 512-byte tar header.
+  struct Member {
+    std::string name;
+    // Only set for regular files.
+    FileEntry entry = {};
+    // A regular file other than LICENSE.
+    bool is_chunk = false;
+    long int next_header = 0;
+  };
+
+  // Parses the tar header block at `header_offset` of the archive. Returns
+  // std::nullopt at the end-of-archive marker. Also used by sources that see
+  // the archive as a stream (TarGzChunkSource).
+  static std::optional<Member> ParseHeader(std::string_view block,
+                                           long int header_offset);
+
+  TarChunkSource(const std::filesystem::path& filename,
+                 ChunkSourceLoaderConfig::FrameFormat frame_format,
+                 ChunkSourceLoaderConfig::ReadMode read_mode =
+                     ChunkSourceLoaderConfig::PREAD,
+                 CachePolicy cache_policy = CachePolicy::kBuffered,
+                 std::shared_ptr<FileReadCounters> read_counters = nullptr);
+  // Uses a previously built index (see files()) instead of reading the tar
+  // headers. The caller is responsible for the index matching the file.
   TarChunkSource(const std::filesystem::path& filename,
-                 ChunkSourceLoaderConfig::FrameFormat frame_format);
+                 ChunkSourceLoaderConfig::FrameFormat frame_format,
+                 ChunkSourceLoaderConfig::ReadMode read_mode,
+                 std::vector<FileEntry> files,
+                 CachePolicy cache_policy = CachePolicy::kBuffered,
+                 std::shared_ptr<FileReadCounters> read_counters = nullptr);
   ~TarChunkSource() override;
   std::string GetChunkSortKey() const override;
   size_t GetChunkCount() const override;
   std::optional<std::vector<FrameType>> GetChunkData(size_t index) override;
+  // Reads all members into memory and closes the file.
+  bool MakeResident() override;
+  size_t GetResidentBytes() const override;
+  std::optional<StoredChunk> GetStoredChunk(size_t index) const override;
+  std::optional<std::vector<FrameType>> DecodeStoredChunk(
+      size_t index, std::string_view stored) override;
+  // From the index if counted, otherwise from the member size, or the gzip
+  // trailer of compressed members.
+  std::optional<size_t> GetChunkFrameCount(size_t index) const override;
+  // Records the frame count of every member in the index, so that it can be
+  // stored along with it. Not thread-safe.
+  void CountFrames();
   std::optional<std::string> GetChunkPrefix(size_t index, size_t max_bytes);
+  const std::vector<FileEntry>& files() const { return files_; }
 
  private:
+  void Open(const std::filesystem::path& filename,
+            ChunkSourceLoaderConfig::ReadMode read_mode,
+            CachePolicy cache_policy,
+            std::shared_ptr<FileReadCounters> read_counters);
   // Performs one-time indexing during construction. Not part of the interface.
   void Index();
-  struct FileEntry {
-    long int offset;
-    long int size;
-    bool is_gzip;
-  };
+  std::optional<std::vector<FrameType>> Decode(size_t index,
+                                               std::string_view stored);
+  // Copies `size` bytes at `offset` of the tar file into `buffer`.
+  bool ReadAt(void* buffer, size_t size, long int offset) const;
+  // Returns `size` bytes at `offset` of the tar file if they are in memory.
+  std::optional<std::string_view> ViewAt(size_t size, long int offset) const;
 
-  FILE* file_ = nullptr;
+  // Exactly one of file_, mapped_file_ and resident_data_ is set: the first
+  // two depending on the read mode, until MakeResident() replaces them.
+  std::unique_ptr<ReadOnlyFile> file_;
+  std::unique_ptr<MappedFile> mapped_file_;
+  // Bytes of the tar file starting at resident_offset_.
+  std::string resident_data_;
+  long int resident_offset_ = 0;
   std::vector<FileEntry> files_;
   std::string filename_;
   ChunkSourceLoaderConfig::FrameFormat frame_format_;
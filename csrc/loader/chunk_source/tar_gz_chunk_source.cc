@@ -0,0 +1,211 @@
+#include "loader/chunk_source/tar_gz_chunk_source.h"
+
+#include <absl/log/log.h>
+#include <absl/strings/str_cat.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#include "loader/chunk_source/frame_decoder.h"
+
+namespace lczero {
+namespace training {
+namespace {
+
+constexpr size_t kTarBlockSize = 512;
+
+// Member list as stored in the index metadata.
+struct IndexedMember {
+  uint64_t offset;
+  uint64_t size;
+  uint64_t is_gzip;
+};
+
+std::string EncodeMembers(
+    const std::vector<TarChunkSource::FileEntry>& files) {
+  std::string metadata(files.size() * sizeof(IndexedMember), '\0');
+  for (size_t i = 0; i < files.size(); ++i) {
+    const IndexedMember member = {
+        .offset = static_cast<uint64_t>(files[i].offset),
+        .size = static_cast<uint64_t>(files[i].size),
+        .is_gzip = files[i].is_gzip};
+    std::memcpy(metadata.data() + i * sizeof(member), &member, sizeof(member));
+  }
+  return metadata;
+}
+
+std::optional<std::vector<TarChunkSource::FileEntry>> DecodeMembers(
+    std::string_view metadata, uint64_t uncompressed_size) {
+  if (metadata.size() % sizeof(IndexedMember) != 0) return std::nullopt;
+  std::vector<TarChunkSource::FileEntry> files(metadata.size() /
+                                               sizeof(IndexedMember));
+  for (size_t i = 0; i < files.size(); ++i) {
+    IndexedMember member;
+    std::memcpy(&member, metadata.data() + i * sizeof(member), sizeof(member));
+    if (member.offset > uncompressed_size ||
+        member.size > uncompressed_size - member.offset) {
+      return std::nullopt;
+    }
+    files[i] = {.offset = static_cast<long int>(member.offset),
+                .size = static_cast<long int>(member.size),
+                .is_gzip = member.is_gzip != 0};
+  }
+  return files;
+}
+
+// Finds the members of a tar archive that is only seen as a stream.
+class TarStreamParser {
+ public:
+  void Consume(std::string_view data) {
+    while (!data.empty() && !done_) {
+      if (skip_ > 0) {
+        const size_t skipped = std::min<uint64_t>(skip_, data.size());
+        data.remove_prefix(skipped);
+        skip_ -= skipped;
+        offset_ += skipped;
+        continue;
+      }
+      const size_t taken =
+          std::min(kTarBlockSize - header_.size(), data.size());
+      header_.append(data.substr(0, taken));
+      data.remove_prefix(taken);
+      offset_ += taken;
+      if (header_.size() < kTarBlockSize) continue;
+
+      const auto member =
+          TarChunkSource::ParseHeader(header_, offset_ - kTarBlockSize);
+      header_.clear();
+      if (!member) {
+        done_ = true;
+        break;
+      }
+      skip_ = member->next_header - offset_;
+      if (member->is_chunk) files_.push_back(member->entry);
+    }
+  }
+
+  std::vector<TarChunkSource::FileEntry>& files() { return files_; }
+
+ private:
+  std::vector<TarChunkSource::FileEntry> files_;
+  std::string header_;
+  uint64_t offset_ = 0;
+  // Bytes of member contents left to skip before the next header.
+  uint64_t skip_ = 0;
+  bool done_ = false;
+};
+
+}  // namespace
+
+TarGzChunkSource::TarGzChunkSource(
+    const std::filesystem::path& filename,
+    ChunkSourceLoaderConfig::FrameFormat frame_format, CachePolicy cache_policy,
+    std::shared_ptr<FileReadCounters> read_counters)
+    : file_(std::make_unique<ReadOnlyFile>(filename, cache_policy,
+                                           std::move(read_counters))),
+      filename_(filename.filename().string()),
+      frame_format_(frame_format) {
+  const auto stat = ChunkManifest::Stat(filename);
+  std::string metadata;
+  if (stat) {
+    index_ = GzipIndex::Load(IndexPath(filename), stat->size, stat->mtime_ns,
+                             &metadata);
+  }
+  if (index_) {
+    if (auto files = DecodeMembers(metadata, index_->uncompressed_size())) {
+      files_ = std::move(*files);
+    } else {
+      LOG(WARNING) << IndexPath(filename) << " is corrupted, rebuilding it";
+      index_.reset();
+    }
+  }
+  if (!index_) BuildIndex(filename, stat);
+  LOG(INFO) << "Read " << files_.size() << " entries from " << filename_;
+}
+
+TarGzChunkSource::~TarGzChunkSource() = default;
+
+std::filesystem::path TarGzChunkSource::IndexPath(
+    const std::filesystem::path& filename) {
+  return std::filesystem::path(filename) += ".gzidx";
+}
+
+void TarGzChunkSource::BuildIndex(
+    const std::filesystem::path& filename,
+    const std::optional<ChunkManifest::FileStat>& stat) {
+  LOG(INFO) << "Building gzip index for " << filename_;
+  TarStreamParser parser;
+  index_ = GzipIndex::Build(
+      *file_, [&parser](std::string_view data) { parser.Consume(data); });
+  files_ = std::move(parser.files());
+  // Same as TarChunkSource for a truncated archive.
+  const auto truncated = std::find_if(
+      files_.begin(), files_.end(), [this](const auto& entry) {
+        return static_cast<uint64_t>(entry.offset + entry.size) >
+               index_->uncompressed_size();
+      });
+  if (truncated != files_.end()) {
+    LOG(WARNING) << "Truncated tar file: " << filename_;
+    files_.erase(truncated, files_.end());
+  }
+
+  if (!stat || !index_->Save(IndexPath(filename), stat->size, stat->mtime_ns,
+                             EncodeMembers(files_))) {
+    return;
+  }
+  // The saved index reads the windows from disk instead of keeping them in
+  // memory.
+  std::string metadata;
+  if (auto saved = GzipIndex::Load(IndexPath(filename), stat->size,
+                                   stat->mtime_ns, &metadata)) {
+    index_ = std::move(saved);
+  }
+}
+
+std::string TarGzChunkSource::GetChunkSortKey() const { return filename_; }
+
+size_t TarGzChunkSource::GetChunkCount() const { return files_.size(); }
+
+std::optional<std::vector<FrameType>> TarGzChunkSource::GetChunkData(
+    size_t index) {
+  if (index >= files_.size()) {
+    throw std::out_of_range("File index out of range");
+  }
+  const auto& file_entry = files_[index];
+  // Reads are interleaved with inflating the archive, so both count as
+  // decoding.
+  GzipIndex::ReadStats read_stats;
+  auto frames = CountedDecode([&]() -> std::optional<std::vector<FrameType>> {
+    std::string buffer(file_entry.size, '\0');
+    if (!index_->Extract(*file_, file_entry.offset, buffer, &read_stats)) {
+      LOG(WARNING) << "Failed to read chunk " << index << " from "
+                   << filename_;
+      return std::nullopt;
+    }
+    return DecodeFrames(buffer, file_entry.is_gzip, frame_format_,
+                        absl::StrCat("chunk ", index, " from ", filename_));
+  });
+  AddIoStats({.bytes_read = read_stats.bytes, .read_calls = read_stats.calls});
+  return frames;
+}
+
+std::optional<size_t> TarGzChunkSource::GetChunkFrameCount(
+    size_t index) const {
+  if (index >= files_.size()) {
+    throw std::out_of_range("File index out of range");
+  }
+  const auto& file_entry = files_[index];
+  const size_t input_size = InputFrameSize(frame_format_);
+  if (file_entry.is_gzip || file_entry.size == 0 ||
+      file_entry.size % input_size != 0) {
+    return std::nullopt;
+  }
+  return file_entry.size / input_size;
+}
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "loader/chunk_source/chunk_manifest.h"
+#include "loader/chunk_source/chunk_source.h"
+#include "loader/chunk_source/tar_chunk_source.h"
+#include "proto/data_loader_config.pb.h"
+#include "utils/file_io.h"
+#include "utils/gzip_index.h"
+
+namespace lczero {
+namespace training {
+
+// A chunk source that reads a tar archive compressed as a whole (.tar.gz or
+// .tgz) without extracting it. The first open inflates the archive once to
+// find the members and to build a GzipIndex, which is saved next to the
+// archive (see IndexPath()) together with the member list, so that later opens
+// only read the index. If the index can't be saved (e.g. a read-only
+// directory) it is kept in memory only.
+//
+// Reading a chunk inflates from the nearest access point before it, i.e. up to
+// GzipIndex::kDefaultSpan bytes of output more than the chunk itself.
+// GetChunkData() is safe to call concurrently. Throws GunzipError or
+// std::runtime_error from the constructor if the archive can't be read.
+class TarGzChunkSource : public ChunkSource {
+ public:
+  TarGzChunkSource(const std::filesystem::path& filename,
+                   ChunkSourceLoaderConfig::FrameFormat frame_format,
+                   CachePolicy cache_policy = CachePolicy::kBuffered,
+                   std::shared_ptr<FileReadCounters> read_counters = nullptr);
+  ~TarGzChunkSource() override;
+
+  // Where the index of `filename` is saved: "<filename>.gzidx".
+  static std::filesystem::path IndexPath(const std::filesystem::path& filename);
+
+  std::string GetChunkSortKey() const override;
+  size_t GetChunkCount() const override;
+  std::optional<std::vector<FrameType>> GetChunkData(size_t index) override;
+  // Only for uncompressed members; the trailer of a gzip member is inside the
+  // compressed archive.
+  std::optional<size_t> GetChunkFrameCount(size_t index) const override;
+  const std::vector<TarChunkSource::FileEntry>& files() const {
+    return files_;
+  }
+
+ private:
+  // Inflates the archive to build index_ and files_, and saves them if the
+  // file could be stat()ed.
+  void BuildIndex(const std::filesystem::path& filename,
+                  const std::optional<ChunkManifest::FileStat>& stat);
+
+  std::unique_ptr<ReadOnlyFile> file_;
+  std::optional<GzipIndex> index_;
+  // Offsets are in the uncompressed archive.
+  std::vector<TarChunkSource::FileEntry> files_;
+  std::string filename_;
+  ChunkSourceLoaderConfig::FrameFormat frame_format_;
+};
+
+}  // namespace training
+}  // namespace lczero
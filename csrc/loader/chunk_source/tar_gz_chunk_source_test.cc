@@ -0,0 +1,147 @@
+#include "loader/chunk_source/tar_gz_chunk_source.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "loader/stages/chunk_source_loader.h"
+#include "utils/gz.h"
+
+namespace lczero {
+namespace training {
+
+namespace {
+
+std::vector<FrameType> MakeChunk(uint32_t id, size_t frame_count) {
+  std::vector<FrameType> frames(frame_count);
+  for (size_t i = 0; i < frame_count; ++i) {
+    frames[i].version = 7;
+    frames[i].input_format = id;
+    frames[i].best_idx = static_cast<uint32_t>(i);
+  }
+  return frames;
+}
+
+// Appends a ustar member with the given contents.
+void AppendTarMember(std::string& tar, const std::string& name,
+                     std::string_view contents, char typeflag = '0') {
+  std::string header(512, '\0');
+  std::memcpy(header.data(), name.data(), name.size());
+  std::snprintf(header.data() + 124, 12, "%011zo", contents.size());
+  header[156] = typeflag;
+  std::memcpy(header.data() + 257, "ustar", 5);
+  tar.append(header);
+  tar.append(contents);
+  tar.append((512 - contents.size() % 512) % 512, '\0');
+}
+
+}  // namespace
+
+class TarGzChunkSourceTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    test_dir_ =
+        std::filesystem::temp_directory_path() /
+        ("tar_gz_chunk_source_test_" +
+         std::to_string(
+             std::chrono::steady_clock::now().time_since_epoch().count()));
+    std::filesystem::create_directories(test_dir_);
+    path_ = test_dir_ / "training-run1-test.tar.gz";
+
+    std::string tar;
+    AppendTarMember(tar, "training", "", '5');
+    AppendTarMember(tar, "LICENSE", "license text");
+    // Every other chunk is stored uncompressed, so that the archive spans
+    // several access points.
+    for (uint32_t i = 0; i < 400; ++i) {
+      chunks_.push_back(MakeChunk(i, 1 + i % 7));
+      const std::string_view raw(
+          reinterpret_cast<const char*>(chunks_.back().data()),
+          chunks_.back().size() * sizeof(FrameType));
+      const std::string name = "training/game_" + std::to_string(i);
+      if (i % 2) {
+        AppendTarMember(tar, name, raw);
+      } else {
+        AppendTarMember(tar, name + ".gz", GzipBuffer(raw, 1));
+      }
+    }
+    tar.append(1024, '\0');
+    std::ofstream(path_, std::ios::binary) << GzipBuffer(tar, 6);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(test_dir_); }
+
+  void ExpectAllChunks(ChunkSource& source) {
+    ASSERT_EQ(source.GetChunkCount(), chunks_.size());
+    // Out of order, as the shuffling chunk pool reads them.
+    for (size_t i = 0; i < chunks_.size(); ++i) {
+      const size_t index = (i * 7919) % chunks_.size();
+      const auto frames = source.GetChunkData(index);
+      ASSERT_TRUE(frames.has_value()) << "chunk " << index;
+      ASSERT_EQ(frames->size(), chunks_[index].size()) << "chunk " << index;
+      // Known without decoding for the uncompressed members only.
+      EXPECT_EQ(source.GetChunkFrameCount(index),
+                index % 2 ? std::optional<size_t>(frames->size())
+                          : std::nullopt)
+          << "chunk " << index;
+      EXPECT_EQ(std::memcmp(frames->data(), chunks_[index].data(),
+                            frames->size() * sizeof(FrameType)),
+                0)
+          << "chunk " << index;
+    }
+  }
+
+  std::filesystem::path test_dir_;
+  std::filesystem::path path_;
+  std::vector<std::vector<FrameType>> chunks_;
+};
+
+TEST_F(TarGzChunkSourceTest, ReadsChunksAndReusesIndex) {
+  const auto index_path = TarGzChunkSource::IndexPath(path_);
+  {
+    TarGzChunkSource source(path_, ChunkSourceLoaderConfig::V7TrainingData);
+    EXPECT_EQ(source.GetChunkSortKey(), "training-run1-test.tar.gz");
+    ExpectAllChunks(source);
+  }
+  ASSERT_TRUE(std::filesystem::exists(index_path));
+  const auto index_mtime = std::filesystem::last_write_time(index_path);
+
+  TarGzChunkSource source(path_, ChunkSourceLoaderConfig::V7TrainingData);
+  EXPECT_EQ(std::filesystem::last_write_time(index_path), index_mtime);
+  ExpectAllChunks(source);
+}
+
+TEST_F(TarGzChunkSourceTest, WorksWithoutWritableDirectory) {
+  // A directory in place of the index makes saving fail.
+  std::filesystem::create_directories(TarGzChunkSource::IndexPath(path_) +=
+                                      ".tmp");
+  TarGzChunkSource source(path_, ChunkSourceLoaderConfig::V7TrainingData);
+  EXPECT_FALSE(
+      std::filesystem::is_regular_file(TarGzChunkSource::IndexPath(path_)));
+  ExpectAllChunks(source);
+}
+
+TEST_F(TarGzChunkSourceTest, CreatedByLoader) {
+  ChunkSourceLoaderConfig config;
+  config.set_frame_format(ChunkSourceLoaderConfig::V7TrainingData);
+  auto source = CreateChunkSourceFromFile(path_, config);
+  ASSERT_NE(source, nullptr);
+  ExpectAllChunks(*source);
+
+  const auto tgz_path = test_dir_ / "archive.tgz";
+  std::filesystem::copy_file(path_, tgz_path);
+  config.set_lazy_indexing(true);
+  source = CreateChunkSourceFromFile(tgz_path, config);
+  ASSERT_NE(source, nullptr);
+  EXPECT_EQ(source->GetChunkSortKey(), "archive.tgz");
+  ExpectAllChunks(*source);
+}
+
+}  // namespace training
+}  // namespace lczero
@@ -11,6 +11,8 @@
 #include <stdexcept>
 
 #include "loader/data_loader_metrics.h"
+#include "utils/fd_cache.h"
+#include "utils/io_scheduler.h"
 
 namespace lczero {
 namespace training {
@@ -40,6 +42,12 @@ void DataLoader::AddStages(const std::string& serialized_data_loader_config) {
 }
 
 void DataLoader::AddStages(const DataLoaderConfig& config) {
+  if (config.has_max_concurrent_reads()) {
+    IoBudget::Global().SetLimit(config.max_concurrent_reads());
+  }
+  if (config.has_max_open_files()) {
+    FileDescriptorCache::Global().SetCapacity(config.max_open_files());
+  }
   for (const auto& stage_config : config.stage()) AddStage(stage_config);
   for (const auto& stage_config : config.stage()) SetStageInputs(stage_config);
 }
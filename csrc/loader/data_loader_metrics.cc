@@ -120,5 +120,19 @@ void UpdateFrom(DataLoaderMetricsProto& dest,
   }
 }
 
+void AddIoStatsMetrics(StageMetricProto& dest,
+                       const ChunkSourceIoStats& stats) {
+  auto add_count = [&](const char* name, uint64_t count) {
+    auto* metric = dest.add_count_metrics();
+    metric->set_name(name);
+    metric->set_count(count);
+  };
+  add_count("source_bytes_read", stats.bytes_read);
+  add_count("source_bytes_decoded", stats.bytes_decoded);
+  add_count("source_read_calls", stats.read_calls);
+  add_count("source_decode_us", stats.decode_nanos / 1000);
+  add_count("source_failed_decodes", stats.failed_decodes);
+}
+
 }  // namespace training
 }  // namespace lczero
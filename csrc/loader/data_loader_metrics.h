@@ -5,6 +5,7 @@
 #pragma once
 
 #include "absl/strings/string_view.h"
+#include "loader/chunk_source/chunk_source.h"
 #include "proto/training_metrics.pb.h"
 #include "utils/metrics/load_metric.h"
 #include "utils/metrics/statistics_metric.h"
@@ -20,6 +21,9 @@ void UpdateFrom(StageMetricProto& dest, const StageMetricProto& src);
 void UpdateFrom(DataLoaderMetricsProto& dest,
                 const DataLoaderMetricsProto& src);
 
+// Adds chunk source I/O stats as count metrics named source_*.
+void AddIoStatsMetrics(StageMetricProto& dest, const ChunkSourceIoStats& stats);
+
 template <typename T>
 QueueMetricProto MetricsFromQueue(absl::string_view name, Queue<T>& queue) {
   QueueMetricProto result;
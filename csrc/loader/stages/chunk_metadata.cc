@@ -0,0 +1,121 @@
+#include "loader/stages/chunk_metadata.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <limits>
+#include <stdexcept>
+
+namespace lczero {
+namespace training {
+namespace {
+
+// bfloat16: the upper half of a float, rounded to nearest even.
+uint16_t ToBfloat16(float value) {
+  const uint32_t bits = std::bit_cast<uint32_t>(value);
+  return static_cast<uint16_t>((bits + 0x7FFF + ((bits >> 16) & 1)) >> 16);
+}
+
+float FromBfloat16(uint16_t value) {
+  return std::bit_cast<float>(static_cast<uint32_t>(value) << 16);
+}
+
+}  // namespace
+
+ChunkMetadata::ChunkMetadata(size_t chunk_count, bool with_cache)
+    : size_(chunk_count),
+      flags_(std::make_unique<uint16_t[]>(chunk_count)),
+      weights_(std::make_unique_for_overwrite<uint16_t[]>(chunk_count)) {
+  std::fill_n(weights_.get(), chunk_count, ToBfloat16(-1.0f));
+  if (with_cache) cache_heads_ = std::make_unique<uint32_t[]>(chunk_count);
+}
+
+uint32_t ChunkMetadata::IncrementUseCount(size_t index) {
+  assert(index < size_);
+  const uint16_t flags = flags_[index];
+  const uint32_t use_count = flags & kUseCountMask;
+  flags_[index] = (flags & ~kUseCountMask) | ((use_count + 1) & kUseCountMask);
+  return use_count;
+}
+
+float ChunkMetadata::weight(size_t index) const {
+  assert(index < size_);
+  return FromBfloat16(weights_[index]);
+}
+
+void ChunkMetadata::set_weight(size_t index, float weight) {
+  assert(index < size_);
+  weights_[index] = ToBfloat16(weight);
+}
+
+size_t ChunkMetadata::AddCachedPositions(size_t index,
+                                         const std::vector<FrameType>& frames,
+                                         size_t max_positions) {
+  assert(cache_heads_ && index < size_);
+  // Walk to the end of the chain.
+  uint32_t* link = &cache_heads_[index];
+  size_t positions = 0;
+  while (*link != kNoNode && positions < max_positions) {
+    link = &node(*link).next;
+    ++positions;
+  }
+  // frames[i] is the position for the i-th place in the chain, so the
+  // positions already cached take the place of the first frames.
+  size_t added = 0;
+  for (; positions < max_positions && positions < frames.size();
+       ++positions, ++added) {
+    const uint32_t handle = AllocateNode();
+    CacheNode& new_node = node(handle);
+    new_node.frame = frames[positions];
+    new_node.next = kNoNode;
+    *link = handle;
+    link = &new_node.next;
+  }
+  if (cache_heads_[index] != kNoNode) flags_[index] |= kCachedFlag;
+  cached_positions_ += added;
+  return added;
+}
+
+std::optional<FrameType> ChunkMetadata::PopCachedPosition(size_t index) {
+  assert(index < size_);
+  if (!(flags_[index] & kCachedFlag)) return std::nullopt;
+  const uint32_t handle = cache_heads_[index];
+  CacheNode& head = node(handle);
+  const FrameType frame = head.frame;
+  cache_heads_[index] = head.next;
+  if (head.next == kNoNode) flags_[index] &= ~kCachedFlag;
+  FreeNode(handle);
+  --cached_positions_;
+  return frame;
+}
+
+size_t ChunkMetadata::metadata_bytes() const {
+  const size_t per_chunk = sizeof(flags_[0]) + sizeof(weights_[0]) +
+                           (cache_heads_ ? sizeof(cache_heads_[0]) : 0);
+  return sizeof(*this) + size_ * per_chunk +
+         slabs_.capacity() * sizeof(slabs_[0]) +
+         allocated_nodes_ * (sizeof(CacheNode) - sizeof(FrameType));
+}
+
+uint32_t ChunkMetadata::AllocateNode() {
+  if (free_nodes_ != kNoNode) {
+    const uint32_t handle = free_nodes_;
+    free_nodes_ = node(handle).next;
+    return handle;
+  }
+  if (allocated_nodes_ == std::numeric_limits<uint32_t>::max()) {
+    throw std::length_error("ChunkMetadata: too many cache nodes");
+  }
+  if (allocated_nodes_ % kSlabSize == 0) {
+    slabs_.push_back(std::make_unique<CacheNode[]>(kSlabSize));
+  }
+  return ++allocated_nodes_;
+}
+
+void ChunkMetadata::FreeNode(uint32_t handle) {
+  node(handle).next = free_nodes_;
+  free_nodes_ = handle;
+}
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "loader/frame_type.h"
+
+namespace lczero {
+namespace training {
+
+// Per-chunk state of one source in the shuffling chunk pool, packed so that
+// windows of hundreds of millions of chunks stay affordable: 4 bytes per
+// chunk, plus 4 when the position cache is enabled.
+//
+// Each chunk has a 16-bit word with the use count (14 bits, wrapping like a
+// counter), a dropped flag and a cache presence flag, and a weight quantized
+// to bfloat16. Cached positions are kept in per-source slabs of nodes, linked
+// by 32-bit handles. Not thread-safe.
+class ChunkMetadata {
+ public:
+  static constexpr uint32_t kUseCountBits = 14;
+  static constexpr uint32_t kUseCountMask = (1u << kUseCountBits) - 1;
+
+  ChunkMetadata(size_t chunk_count, bool with_cache);
+
+  size_t size() const { return size_; }
+
+  uint32_t use_count(size_t index) const {
+    return flags_[index] & kUseCountMask;
+  }
+  // Returns the use count before the increment.
+  uint32_t IncrementUseCount(size_t index);
+
+  bool dropped(size_t index) const { return flags_[index] & kDroppedFlag; }
+  void MarkDropped(size_t index) { flags_[index] |= kDroppedFlag; }
+
+  // Negative if not known yet.
+  float weight(size_t index) const;
+  // Stores the weight rounded to 8 significant bits.
+  void set_weight(size_t index, float weight);
+
+  // Extends the cache chain of the chunk to `max_positions` positions, taking
+  // frames[i] for the i-th place of the chain. Returns the number of
+  // positions added.
+  size_t AddCachedPositions(size_t index, const std::vector<FrameType>& frames,
+                            size_t max_positions);
+  // Removes and returns the oldest cached position of the chunk.
+  std::optional<FrameType> PopCachedPosition(size_t index);
+  // Number of positions cached for all chunks of the source.
+  size_t cached_positions() const { return cached_positions_; }
+
+  // Memory taken by the per-chunk state and the cache node links, excluding
+  // the cached positions themselves.
+  size_t metadata_bytes() const;
+
+ private:
+  static constexpr uint16_t kDroppedFlag = 1u << kUseCountBits;
+  static constexpr uint16_t kCachedFlag = 1u << (kUseCountBits + 1);
+  // Handle of no node.
+  static constexpr uint32_t kNoNode = 0;
+  static constexpr size_t kSlabSize = 64;
+
+  struct CacheNode {
+    FrameType frame;
+    uint32_t next = kNoNode;
+  };
+
+  CacheNode& node(uint32_t handle) {
+    return slabs_[(handle - 1) / kSlabSize][(handle - 1) % kSlabSize];
+  }
+  uint32_t AllocateNode();
+  void FreeNode(uint32_t handle);
+
+  size_t size_;
+  std::unique_ptr<uint16_t[]> flags_;
+  std::unique_ptr<uint16_t[]> weights_;
+  // Head of the cache chain of each chunk, if the cache is enabled.
+  std::unique_ptr<uint32_t[]> cache_heads_;
+  // Cache nodes, allocated kSlabSize at a time and never moved. Handles are
+  // 1-based indices into them.
+  std::vector<std::unique_ptr<CacheNode[]>> slabs_;
+  uint32_t allocated_nodes_ = 0;
+  uint32_t free_nodes_ = kNoNode;
+  size_t cached_positions_ = 0;
+};
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,95 @@
+#include "loader/stages/chunk_metadata.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+namespace lczero {
+namespace training {
+namespace {
+
+std::vector<FrameType> MakeFrames(uint32_t first, size_t count) {
+  std::vector<FrameType> frames(count);
+  for (size_t i = 0; i < count; ++i) {
+    frames[i].version = first + static_cast<uint32_t>(i);
+  }
+  return frames;
+}
+
+}  // namespace
+
+TEST(ChunkMetadataTest, StartsUnusedWithUnknownWeight) {
+  ChunkMetadata metadata(10, /*with_cache=*/false);
+  EXPECT_EQ(metadata.size(), 10);
+  for (size_t i = 0; i < 10; ++i) {
+    EXPECT_EQ(metadata.use_count(i), 0);
+    EXPECT_FALSE(metadata.dropped(i));
+    EXPECT_LT(metadata.weight(i), 0.0f);
+    EXPECT_EQ(metadata.PopCachedPosition(i), std::nullopt);
+  }
+  EXPECT_EQ(metadata.metadata_bytes() - sizeof(metadata), 10 * 4);
+}
+
+TEST(ChunkMetadataTest, UseCountWrapsWithoutTouchingFlags) {
+  ChunkMetadata metadata(2, /*with_cache=*/false);
+  metadata.MarkDropped(0);
+  for (uint32_t i = 0; i < ChunkMetadata::kUseCountMask; ++i) {
+    EXPECT_EQ(metadata.IncrementUseCount(0), i);
+  }
+  EXPECT_EQ(metadata.use_count(0), ChunkMetadata::kUseCountMask);
+  EXPECT_EQ(metadata.IncrementUseCount(0), ChunkMetadata::kUseCountMask);
+  EXPECT_EQ(metadata.use_count(0), 0);
+  EXPECT_TRUE(metadata.dropped(0));
+  EXPECT_EQ(metadata.use_count(1), 0);
+  EXPECT_FALSE(metadata.dropped(1));
+}
+
+TEST(ChunkMetadataTest, QuantizesWeights) {
+  ChunkMetadata metadata(4, /*with_cache=*/false);
+  metadata.set_weight(0, 0.0f);
+  metadata.set_weight(1, 37.0f);
+  metadata.set_weight(2, 1234.5f);
+  metadata.set_weight(3, 0.1f);
+  EXPECT_EQ(metadata.weight(0), 0.0f);
+  // Integers up to 256 are exact.
+  EXPECT_EQ(metadata.weight(1), 37.0f);
+  EXPECT_NEAR(metadata.weight(2), 1234.5f, 1234.5f / 256);
+  EXPECT_NEAR(metadata.weight(3), 0.1f, 0.1f / 256);
+}
+
+TEST(ChunkMetadataTest, CachesPositionsInOrder) {
+  ChunkMetadata metadata(3, /*with_cache=*/true);
+  EXPECT_EQ(metadata.AddCachedPositions(1, MakeFrames(100, 5), 3), 3);
+  EXPECT_EQ(metadata.AddCachedPositions(1, MakeFrames(200, 4), 2), 0);
+  // The first three places are taken, so only the last frame is added.
+  EXPECT_EQ(metadata.AddCachedPositions(1, MakeFrames(200, 4), 5), 1);
+  EXPECT_EQ(metadata.cached_positions(), 4);
+  EXPECT_EQ(metadata.PopCachedPosition(0), std::nullopt);
+
+  std::vector<uint32_t> versions;
+  while (auto frame = metadata.PopCachedPosition(1)) {
+    versions.push_back(frame->version);
+  }
+  EXPECT_EQ(versions, (std::vector<uint32_t>{100, 101, 102, 203}));
+  EXPECT_EQ(metadata.cached_positions(), 0);
+}
+
+TEST(ChunkMetadataTest, ReusesFreedCacheNodes) {
+  ChunkMetadata metadata(100, /*with_cache=*/true);
+  for (size_t i = 0; i < 100; ++i) {
+    ASSERT_EQ(metadata.AddCachedPositions(i, MakeFrames(i * 10, 2), 2), 2);
+  }
+  const size_t bytes = metadata.metadata_bytes();
+  for (int round = 0; round < 10; ++round) {
+    for (size_t i = 0; i < 100; ++i) {
+      const auto frame = metadata.PopCachedPosition(i);
+      ASSERT_TRUE(frame.has_value());
+      metadata.AddCachedPositions(i, MakeFrames(0, 2), 2);
+    }
+  }
+  EXPECT_EQ(metadata.cached_positions(), 200);
+  EXPECT_EQ(metadata.metadata_bytes(), bytes);
+}
+
+}  // namespace training
+}  // namespace lczero
@@ -1,27 +1,209 @@
 #include "loader/stages/chunk_source_loader.h"
 
+#include <algorithm>
 #include <filesystem>
+#include <optional>
+#include <stdexcept>
 #include <utility>
 
 #include "absl/log/log.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "loader/chunk_source/http_tar_chunk_source.h"
+#include "loader/chunk_source/lazy_chunk_source.h"
+#include "loader/chunk_source/packed_chunk_source.h"
 #include "loader/chunk_source/rawfile_chunk_source.h"
 #include "loader/chunk_source/tar_chunk_source.h"
+#include "loader/chunk_source/tar_gz_chunk_source.h"
 #include "loader/data_loader_metrics.h"
 #include "proto/data_loader_config.pb.h"
+#include "utils/fd_cache.h"
+#include "utils/io_scheduler.h"
 
 namespace lczero {
 namespace training {
 
+namespace {
+
+CachePolicy ToCachePolicy(ChunkSourceLoaderConfig::CachePolicy policy) {
+  switch (policy) {
+    case ChunkSourceLoaderConfig::FADVISE:
+      return CachePolicy::kFadvise;
+    case ChunkSourceLoaderConfig::DIRECT:
+      return CachePolicy::kDirect;
+    default:
+      return CachePolicy::kBuffered;
+  }
+}
+
+// Opens and indexes a .tar file, reusing and updating the manifest if given.
+// Recorded indexes include the frame count of every member.
+std::unique_ptr<ChunkSource> CreateTarChunkSource(
+    const std::filesystem::path& filepath,
+    ChunkSourceLoaderConfig::FrameFormat frame_format,
+    ChunkSourceLoaderConfig::ReadMode read_mode, CachePolicy cache_policy,
+    std::shared_ptr<FileReadCounters> read_counters, ChunkManifest* manifest) {
+  const auto stat = manifest ? ChunkManifest::Stat(filepath) : std::nullopt;
+  if (stat) {
+    if (auto entry = manifest->Lookup(filepath, *stat)) {
+      return std::make_unique<TarChunkSource>(
+          filepath, frame_format, read_mode, std::move(entry->chunks),
+          cache_policy, std::move(read_counters));
+    }
+  }
+  auto source = std::make_unique<TarChunkSource>(
+      filepath, frame_format, read_mode, cache_policy,
+      std::move(read_counters));
+  if (stat) {
+    source->CountFrames();
+    manifest->Append({.path = filepath.string(),
+                      .file_size = stat->size,
+                      .mtime_ns = stat->mtime_ns,
+                      .sort_key = source->GetChunkSortKey(),
+                      .chunks = source->files()});
+  }
+  return source;
+}
+
+std::shared_ptr<HttpRangeReader> CreateHttpRangeReader(
+    const ChunkSourceLoaderConfig& config) {
+  return std::make_shared<HttpRangeReader>(config.http_cache_bytes(),
+                                           config.http_block_size(),
+                                           config.http_connections());
+}
+
+// Indexes a .tar file on an HTTP server, reusing and updating the manifest if
+// given. Files are only recorded when the server tells their modification
+// time.
+std::unique_ptr<ChunkSource> CreateHttpTarChunkSource(
+    const std::string& url, ChunkSourceLoaderConfig::FrameFormat frame_format,
+    std::shared_ptr<HttpRangeReader> reader, ChunkManifest* manifest) {
+  const auto info = reader->Stat(url);
+  if (!info) throw std::runtime_error("HEAD request failed");
+  std::optional<ChunkManifest::FileStat> stat;
+  if (manifest && info->mtime_ns) {
+    stat = ChunkManifest::FileStat{.size = info->size,
+                                   .mtime_ns = *info->mtime_ns};
+    if (auto entry = manifest->Lookup(url, *stat)) {
+      return std::make_unique<HttpTarChunkSource>(
+          std::move(reader), url, info->size, frame_format,
+          std::move(entry->chunks));
+    }
+  }
+  auto source = std::make_unique<HttpTarChunkSource>(
+      std::move(reader), url, info->size, frame_format);
+  if (stat) {
+    source->CountFrames();
+    manifest->Append({.path = url,
+                      .file_size = stat->size,
+                      .mtime_ns = stat->mtime_ns,
+                      .sort_key = source->GetChunkSortKey(),
+                      .chunks = source->files()});
+  }
+  return source;
+}
+
+bool IsHttpUrl(const std::filesystem::path& filepath) {
+  return filepath.native().starts_with("http://");
+}
+
+bool IsTarGz(const std::filesystem::path& filepath) {
+  return filepath.extension() == ".tgz" ||
+         (filepath.extension() == ".gz" &&
+          filepath.stem().extension() == ".tar");
+}
+
+bool IsLooseChunkFile(const std::filesystem::path& filepath) {
+  return !IsHttpUrl(filepath) && filepath.extension() == ".gz" &&
+         !IsTarGz(filepath);
+}
+
+// Loose files are grouped by directory and by name without the trailing
+// number, e.g. "dir/training.1234.gz" and "dir/training.1235.gz".
+std::string LooseFileGroupKey(const std::filesystem::path& filepath) {
+  std::string stem = filepath.stem().string();
+  while (!stem.empty() && absl::ascii_isdigit(stem.back())) stem.pop_back();
+  return absl::StrCat(filepath.parent_path().string(), "/", stem);
+}
+
+}  // namespace
+
 std::unique_ptr<ChunkSource> CreateChunkSourceFromFile(
     const std::filesystem::path& filepath,
-    ChunkSourceLoaderConfig::FrameFormat frame_format) {
+    const ChunkSourceLoaderConfig& config,
+    std::shared_ptr<ChunkManifest> manifest,
+    std::shared_ptr<FileReadCounters> read_counters,
+    std::shared_ptr<HttpRangeReader> http_reader) {
   auto extension = filepath.extension();
+  const CachePolicy cache_policy = ToCachePolicy(config.cache_policy());
   try {
+    if (IsHttpUrl(filepath)) {
+      if (extension != ".tar") return nullptr;
+      if (!http_reader) http_reader = CreateHttpRangeReader(config);
+      if (config.lazy_indexing()) {
+        return std::make_unique<LazyChunkSource>(
+            filepath.filename().string(),
+            [url = filepath.string(), frame_format = config.frame_format(),
+             http_reader = std::move(http_reader),
+             manifest = std::move(manifest)]() {
+              return CreateHttpTarChunkSource(url, frame_format, http_reader,
+                                              manifest.get());
+            });
+      }
+      return CreateHttpTarChunkSource(filepath.string(),
+                                      config.frame_format(),
+                                      std::move(http_reader), manifest.get());
+    }
+    if (IsTarGz(filepath)) {
+      if (config.lazy_indexing()) {
+        return std::make_unique<LazyChunkSource>(
+            filepath.filename().string(),
+            [filepath, frame_format = config.frame_format(), cache_policy,
+             read_counters = std::move(read_counters)]() {
+              return std::make_unique<TarGzChunkSource>(
+                  filepath, frame_format, cache_policy, read_counters);
+            });
+      }
+      return std::make_unique<TarGzChunkSource>(filepath, config.frame_format(),
+                                                cache_policy,
+                                                std::move(read_counters));
+    }
     if (extension == ".gz") {
-      return std::make_unique<RawFileChunkSource>(filepath, frame_format);
+      return std::make_unique<RawFileChunkSource>(
+          filepath, config.frame_format(), config.read_mode(), cache_policy,
+          std::move(read_counters));
+    }
+    if (extension == ".lczpack") {
+      if (config.lazy_indexing()) {
+        return std::make_unique<LazyChunkSource>(
+            filepath.filename().string(),
+            [filepath, read_mode = config.read_mode(), cache_policy,
+             read_counters = std::move(read_counters)]() {
+              return std::make_unique<PackedChunkSource>(
+                  filepath, read_mode, cache_policy, read_counters);
+            });
+      }
+      return std::make_unique<PackedChunkSource>(filepath, config.read_mode(),
+                                                 cache_policy,
+                                                 std::move(read_counters));
     }
     if (extension == ".tar") {
-      return std::make_unique<TarChunkSource>(filepath, frame_format);
+      if (config.lazy_indexing()) {
+        return std::make_unique<LazyChunkSource>(
+            filepath.filename().string(),
+            [filepath, frame_format = config.frame_format(),
+             read_mode = config.read_mode(), cache_policy,
+             read_counters = std::move(read_counters),
+             manifest = std::move(manifest)]() {
+              return CreateTarChunkSource(filepath, frame_format, read_mode,
+                                          cache_policy, read_counters,
+                                          manifest.get());
+            });
+      }
+      return CreateTarChunkSource(filepath, config.frame_format(),
+                                  config.read_mode(), cache_policy,
+                                  std::move(read_counters), manifest.get());
     }
   } catch (const std::exception& e) {
     LOG(ERROR) << "Failed to create chunk source for " << filepath << ": "
@@ -34,10 +216,17 @@ std::unique_ptr<ChunkSource> CreateChunkSourceFromFile(
 ChunkSourceLoader::ChunkSourceLoader(const ChunkSourceLoaderConfig& config)
     : SingleInputStage<ChunkSourceLoaderConfig, InputType>(config),
       SingleOutputStage<OutputType>(config.output()),
-      thread_pool_(config.threads(), ThreadPoolOptions{}),
-      frame_format_(config.frame_format()) {
+      // One more thread runs the loose file flusher if grouping is enabled.
+      thread_pool_(config.threads() + (config.loose_file_group_size() > 1),
+                   ThreadPoolOptions{}),
+      config_(config),
+      read_counters_(std::make_shared<FileReadCounters>()),
+      http_reader_(CreateHttpRangeReader(config)) {
   LOG(INFO) << "Initializing ChunkSourceLoader with " << config.threads()
             << " worker threads";
+  if (config.has_manifest_path()) {
+    manifest_ = std::make_shared<ChunkManifest>(config.manifest_path());
+  }
 
   // Initialize thread contexts but don't start worker threads yet.
   thread_contexts_.reserve(config.threads());
@@ -50,11 +239,17 @@ ChunkSourceLoader::~ChunkSourceLoader() { Stop(); }
 
 void ChunkSourceLoader::Start() {
   LOG(INFO) << "Starting ChunkSourceLoader worker threads.";
+  running_workers_ = thread_contexts_.size();
   for (size_t i = 0; i < thread_contexts_.size(); ++i) {
     thread_pool_.Enqueue([this, i](std::stop_token stop_token) {
       Worker(stop_token, thread_contexts_[i].get());
+      --running_workers_;
     });
   }
+  if (config_.loose_file_group_size() > 1) {
+    thread_pool_.Enqueue(
+        [this](std::stop_token stop_token) { LooseFileFlusher(stop_token); });
+  }
 }
 
 void ChunkSourceLoader::Stop() {
@@ -72,6 +267,32 @@ void ChunkSourceLoader::Worker(std::stop_token stop_token,
   LOG(INFO) << "ChunkSourceLoader worker@" << static_cast<const void*>(context)
             << " started.";
 
+  auto put_source = [&](std::unique_ptr<ChunkSource> source,
+                        FilePathProvider::MessageType message_type) {
+    {
+      absl::MutexLock lock(&last_chunk_key_mutex_);
+      last_chunk_key_ = source->GetChunkSortKey();
+    }
+    ChunkSourceWithPhase output{.source = std::move(source),
+                                .message_type = message_type};
+    LoadMetricPauser pauser(context->load_metric_updater);
+    producer.Put(std::move(output), stop_token);
+  };
+  // Pending loose files were discovered before the sentinel, so they go out
+  // ahead of it.
+  auto forward_sentinel = [&]() {
+    for (auto& group : TakeLooseFileGroups()) {
+      put_source(MakeLooseFileSource(std::move(group)),
+                 FilePathProvider::MessageType::kFile);
+    }
+    producer.Put({.source = nullptr,
+                  .message_type =
+                      FilePathProvider::MessageType::kInitialScanComplete},
+                 stop_token);
+    absl::MutexLock lock(&phase_mutex_);
+    sentinel_forwarded_ = true;
+  };
+
   try {
     while (true) {
       auto file = [&]() {
@@ -94,8 +315,7 @@ void ChunkSourceLoader::Worker(std::stop_token stop_token,
         if (should_forward) {
           LOG(INFO) << "ChunkSourceLoader forwarding initial scan completion "
                        "marker.";
-          producer.Put({.source = nullptr, .message_type = file.message_type},
-                       stop_token);
+          forward_sentinel();
         }
         continue;
       }
@@ -108,36 +328,45 @@ void ChunkSourceLoader::Worker(std::stop_token stop_token,
         if (is_pre_sentinel) pre_sentinel_work_count_++;
       }
 
-      // Create ChunkSource from the file.
-      LOG_EVERY_N(INFO, 1000)
-          << "ChunkSourceLoader preparing chunk source for " << file.filepath;
-      auto source = CreateChunkSourceFromFile(file.filepath, frame_format_);
-      if (source) {
-        {
-          absl::MutexLock lock(&last_chunk_key_mutex_);
-          last_chunk_key_ = source->GetChunkSortKey();
+      if (config_.loose_file_group_size() > 1 &&
+          IsLooseChunkFile(file.filepath)) {
+        if (auto group = AddLooseFile(file.filepath)) {
+          put_source(MakeLooseFileSource(std::move(*group)),
+                     FilePathProvider::MessageType::kFile);
         }
-        ChunkSourceWithPhase output{.source = std::move(source),
-                                    .message_type = file.message_type};
-        LoadMetricPauser pauser(context->load_metric_updater);
-        producer.Put(std::move(output), stop_token);
       } else {
-        LOG_EVERY_N(INFO, 100)
-            << "ChunkSourceLoader skipping unsupported file: " << file.filepath;
-        skipped_files_count_++;
+        // Create ChunkSource from the file.
+        LOG_EVERY_N(INFO, 1000)
+            << "ChunkSourceLoader preparing chunk source for "
+            << file.filepath;
+        std::unique_ptr<ChunkSource> source;
+        {
+          IoBudget::Lease lease(IoBudget::Global());
+          source = CreateChunkSourceFromFile(file.filepath, config_, manifest_,
+                                             read_counters_, http_reader_);
+        }
+        if (source) {
+          put_source(std::move(source), file.message_type);
+        } else {
+          LOG_EVERY_N(INFO, 100)
+              << "ChunkSourceLoader skipping unsupported file: "
+              << file.filepath;
+          skipped_files_count_++;
+        }
       }
 
       // Complete pre-sentinel work tracking.
       if (is_pre_sentinel) {
-        absl::MutexLock lock(&phase_mutex_);
-        if (--pre_sentinel_work_count_ == 0 && sentinel_received_) {
+        bool should_forward;
+        {
+          absl::MutexLock lock(&phase_mutex_);
+          should_forward =
+              --pre_sentinel_work_count_ == 0 && sentinel_received_;
+        }
+        if (should_forward) {
           LOG(INFO) << "ChunkSourceLoader forwarding initial scan completion "
                        "marker after all pre-sentinel work completed.";
-          producer.Put(
-              {.source = nullptr,
-               .message_type =
-                   FilePathProvider::MessageType::kInitialScanComplete},
-              stop_token);
+          forward_sentinel();
         }
       }
     }
@@ -160,6 +389,86 @@ void ChunkSourceLoader::Worker(std::stop_token stop_token,
             << " exiting loop.";
 }
 
+void ChunkSourceLoader::LooseFileFlusher(std::stop_token stop_token) {
+  auto producer = output_queue()->CreateProducer();
+  const absl::Duration max_delay =
+      absl::Milliseconds(config_.loose_file_group_max_delay_ms());
+  try {
+    while (!stop_token.stop_requested()) {
+      // Checked before taking the groups, so that none are added after the
+      // last flush.
+      const bool workers_done = running_workers_ == 0;
+      // Groups of files found by the initial scan go out ahead of its
+      // completion marker, so age only counts after it.
+      bool sentinel_forwarded;
+      {
+        absl::MutexLock lock(&phase_mutex_);
+        sentinel_forwarded = sentinel_forwarded_;
+      }
+      std::vector<LooseFileGroup> groups;
+      if (workers_done) {
+        groups = TakeLooseFileGroups();
+      } else if (sentinel_forwarded) {
+        groups = TakeLooseFileGroups(absl::Now() - max_delay);
+      }
+      for (auto& group : groups) {
+        auto source = MakeLooseFileSource(std::move(group));
+        {
+          absl::MutexLock lock(&last_chunk_key_mutex_);
+          last_chunk_key_ = source->GetChunkSortKey();
+        }
+        producer.Put({.source = std::move(source),
+                      .message_type = FilePathProvider::MessageType::kFile},
+                     stop_token);
+      }
+      if (workers_done) break;
+      absl::SleepFor(std::min(max_delay, absl::Milliseconds(100)));
+    }
+  } catch (const QueueClosedException&) {
+  } catch (const QueueRequestCancelled&) {
+  }
+  LOG(INFO) << "ChunkSourceLoader loose file flusher exiting.";
+}
+
+std::unique_ptr<ChunkSource> ChunkSourceLoader::MakeLooseFileSource(
+    LooseFileGroup group) {
+  return std::make_unique<RawFileChunkSource>(
+      group.directory, std::move(group.filenames), config_.frame_format(),
+      config_.read_mode(), ToCachePolicy(config_.cache_policy()),
+      read_counters_);
+}
+
+std::optional<ChunkSourceLoader::LooseFileGroup>
+ChunkSourceLoader::AddLooseFile(const std::filesystem::path& filepath) {
+  absl::MutexLock lock(&loose_files_mutex_);
+  const std::string key = LooseFileGroupKey(filepath);
+  LooseFileGroup& group = loose_files_[key];
+  if (group.filenames.empty()) {
+    group.directory = filepath.parent_path();
+    group.started = absl::Now();
+  }
+  group.filenames.push_back(filepath.filename().string());
+  if (group.filenames.size() < config_.loose_file_group_size()) {
+    return std::nullopt;
+  }
+  LooseFileGroup full = std::move(group);
+  loose_files_.erase(key);
+  return full;
+}
+
+std::vector<ChunkSourceLoader::LooseFileGroup>
+ChunkSourceLoader::TakeLooseFileGroups(absl::Time deadline) {
+  std::vector<LooseFileGroup> groups;
+  absl::MutexLock lock(&loose_files_mutex_);
+  for (auto it = loose_files_.begin(); it != loose_files_.end();) {
+    auto current = it++;
+    if (current->second.started >= deadline) continue;
+    groups.push_back(std::move(current->second));
+    loose_files_.erase(current);
+  }
+  return groups;
+}
+
 StageMetricProto ChunkSourceLoader::FlushMetrics() {
   StageMetricProto stage_metric;
   LoadMetricProto aggregated_load;
@@ -173,6 +482,54 @@ StageMetricProto ChunkSourceLoader::FlushMetrics() {
   skipped_metric->set_name("skipped_files");
   skipped_metric->set_count(skipped_files_count_.exchange(0));
 
+  // Reads of the sources happen downstream, mostly in the shuffling chunk
+  // pool, but are accounted here where the cache policy is configured.
+  auto* bytes_read_metric = stage_metric.add_count_metrics();
+  bytes_read_metric->set_name("bytes_read");
+  bytes_read_metric->set_count(read_counters_->bytes_read.exchange(0));
+  auto* bypassed_metric = stage_metric.add_count_metrics();
+  bypassed_metric->set_name("cache_bypassed_reads");
+  bypassed_metric->set_count(
+      read_counters_->cache_bypassed_reads.exchange(0));
+  auto* opens_metric = stage_metric.add_count_metrics();
+  opens_metric->set_name("file_opens");
+  opens_metric->set_count(read_counters_->file_opens.exchange(0));
+  auto* reopens_metric = stage_metric.add_count_metrics();
+  reopens_metric->set_name("file_reopens");
+  reopens_metric->set_count(read_counters_->file_reopens.exchange(0));
+  auto* evictions_metric = stage_metric.add_count_metrics();
+  evictions_metric->set_name("file_evictions");
+  evictions_metric->set_count(read_counters_->file_evictions.exchange(0));
+  // Shared by all stages of the process.
+  const FileDescriptorCache& fd_cache = FileDescriptorCache::Global();
+  auto* open_files_metric = stage_metric.add_gauge_metrics();
+  open_files_metric->set_name("open_files");
+  open_files_metric->set_value(fd_cache.open_count());
+  open_files_metric->set_capacity(fd_cache.capacity());
+
+  auto* http_hits_metric = stage_metric.add_count_metrics();
+  http_hits_metric->set_name("http_block_hits");
+  http_hits_metric->set_count(http_reader_->FlushHits());
+  auto* http_misses_metric = stage_metric.add_count_metrics();
+  http_misses_metric->set_name("http_block_misses");
+  http_misses_metric->set_count(http_reader_->FlushMisses());
+  auto* http_requests_metric = stage_metric.add_count_metrics();
+  http_requests_metric->set_name("http_requests");
+  http_requests_metric->set_count(http_reader_->FlushRequests());
+  auto* http_cache_metric = stage_metric.add_gauge_metrics();
+  http_cache_metric->set_name("http_cache_bytes");
+  http_cache_metric->set_value(http_reader_->cached_bytes());
+  http_cache_metric->set_capacity(http_reader_->cache_capacity());
+
+  if (manifest_) {
+    auto* hits_metric = stage_metric.add_count_metrics();
+    hits_metric->set_name("manifest_hits");
+    hits_metric->set_count(manifest_->FlushHits());
+    auto* misses_metric = stage_metric.add_count_metrics();
+    misses_metric->set_name("manifest_misses");
+    misses_metric->set_count(manifest_->FlushMisses());
+  }
+
   // Get the last chunk key.
   {
     absl::MutexLock lock(&last_chunk_key_mutex_);
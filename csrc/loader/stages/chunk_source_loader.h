@@ -3,15 +3,23 @@
 #include <atomic>
 #include <filesystem>
 #include <memory>
+#include <optional>
 #include <stop_token>
+#include <string>
+#include <vector>
 
 #include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "loader/chunk_source/chunk_manifest.h"
 #include "loader/chunk_source/chunk_source.h"
 #include "loader/stages/file_path_provider.h"
 #include "loader/stages/stage.h"
 #include "proto/data_loader_config.pb.h"
 #include "proto/training_metrics.pb.h"
+#include "utils/file_io.h"
+#include "utils/http_range_reader.h"
 #include "utils/metrics/load_metric.h"
 #include "utils/queue.h"
 #include "utils/thread_pool.h"
@@ -20,10 +28,20 @@ namespace lczero {
 namespace training {
 
 // Creates a ChunkSource based on file extension. Returns RawFileChunkSource for
-// .gz files, TarChunkSource for .tar files, or nullptr for unsupported types.
+// .gz files, TarChunkSource for .tar files, TarGzChunkSource for .tar.gz and
+// .tgz files, or nullptr for unsupported types.
+// Frame format and read mode are taken from the config. If `manifest` is given,
+// .tar files are built from their recorded index when it is still valid, and
+// newly indexed ones are recorded. With lazy_indexing, archives are only
+// opened once the returned source is first asked for its chunks. Reads of the
+// source are accounted in `read_counters` if given. http:// URLs of .tar files
+// are read through `http_reader`, or a reader of their own if not given.
 std::unique_ptr<ChunkSource> CreateChunkSourceFromFile(
     const std::filesystem::path& filepath,
-    ChunkSourceLoaderConfig::FrameFormat frame_format);
+    const ChunkSourceLoaderConfig& config,
+    std::shared_ptr<ChunkManifest> manifest = nullptr,
+    std::shared_ptr<FileReadCounters> read_counters = nullptr,
+    std::shared_ptr<HttpRangeReader> http_reader = nullptr);
 
 struct ChunkSourceWithPhase {
   std::unique_ptr<ChunkSource> source;
@@ -32,6 +50,8 @@ struct ChunkSourceWithPhase {
 
 // Worker pool that converts FilePathProvider output to ChunkSource objects.
 // Takes FilePathProvider::File as input and outputs ChunkSourceWithPhase.
+// Loose .gz files are grouped into multi-chunk sources, see
+// loose_file_group_size.
 class ChunkSourceLoader
     : public SingleInputStage<ChunkSourceLoaderConfig, FilePathProvider::File>,
       public SingleOutputStage<ChunkSourceWithPhase> {
@@ -52,18 +72,54 @@ class ChunkSourceLoader
     LoadMetricUpdater load_metric_updater;
   };
 
+  // Loose files of one directory that are waiting to be passed on as one
+  // source.
+  struct LooseFileGroup {
+    std::filesystem::path directory;
+    std::vector<std::string> filenames;
+    // When the first file was added.
+    absl::Time started;
+  };
+
   void Worker(std::stop_token stop_token, ThreadContext* context);
+  // Passes on partial loose file groups once they have waited for
+  // loose_file_group_max_delay_ms after the initial scan, and all of them
+  // once the workers are done.
+  void LooseFileFlusher(std::stop_token stop_token);
+  std::unique_ptr<ChunkSource> MakeLooseFileSource(LooseFileGroup group);
+  // Adds a loose file to its group, and returns the group if it's full.
+  std::optional<LooseFileGroup> AddLooseFile(
+      const std::filesystem::path& filepath)
+      ABSL_LOCKS_EXCLUDED(loose_files_mutex_);
+  // Removes and returns the groups started before `deadline`.
+  std::vector<LooseFileGroup> TakeLooseFileGroups(
+      absl::Time deadline = absl::InfiniteFuture())
+      ABSL_LOCKS_EXCLUDED(loose_files_mutex_);
   ThreadPool thread_pool_;
   std::vector<std::unique_ptr<ThreadContext>> thread_contexts_;
   std::atomic<uint64_t> skipped_files_count_{0};
+  std::atomic<size_t> running_workers_{0};
   absl::Mutex last_chunk_key_mutex_;
   std::string last_chunk_key_;
-  ChunkSourceLoaderConfig::FrameFormat frame_format_;
+  const ChunkSourceLoaderConfig config_;
+  // Shared with lazily opened sources, which may outlive the loader.
+  std::shared_ptr<ChunkManifest> manifest_;
+  // Shared with the created sources, which do their reads after the loader
+  // has passed them on.
+  std::shared_ptr<FileReadCounters> read_counters_;
+  // Block cache and connections shared by all http:// sources.
+  std::shared_ptr<HttpRangeReader> http_reader_;
+
+  absl::Mutex loose_files_mutex_;
+  // Keyed by directory and file name prefix.
+  absl::flat_hash_map<std::string, LooseFileGroup> loose_files_
+      ABSL_GUARDED_BY(loose_files_mutex_);
 
   // Synchronization for sentinel barrier.
   absl::Mutex phase_mutex_;
   int pre_sentinel_work_count_ ABSL_GUARDED_BY(phase_mutex_) = 0;
   bool sentinel_received_ ABSL_GUARDED_BY(phase_mutex_) = false;
+  bool sentinel_forwarded_ ABSL_GUARDED_BY(phase_mutex_) = false;
 };
 
 }  // namespace training
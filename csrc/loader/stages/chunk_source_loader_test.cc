@@ -2,9 +2,15 @@
 
 #include <gtest/gtest.h>
 
+#include <chrono>
 #include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
 
 #include "loader/stages/file_path_provider.h"
+#include "utils/gz.h"
 #include "utils/queue.h"
 
 namespace lczero {
@@ -195,5 +201,147 @@ TEST(ChunkSourceLoaderTest, SentinelBarrierWithMultipleThreads) {
   EXPECT_EQ(files_after_sentinel, 0);
 }
 
+TEST(ChunkSourceLoaderTest, LazyIndexingDefersOpeningTarFiles) {
+  const auto missing = std::filesystem::path("/nonexistent/dir/missing.tar");
+  ChunkSourceLoaderConfig config;
+  EXPECT_EQ(CreateChunkSourceFromFile(missing, config), nullptr);
+
+  config.set_lazy_indexing(true);
+  auto source = CreateChunkSourceFromFile(missing, config);
+  ASSERT_NE(source, nullptr);
+  EXPECT_EQ(source->GetChunkSortKey(), "missing.tar");
+  // Opening fails only when the chunks are needed.
+  EXPECT_EQ(source->GetChunkCount(), 0);
+  EXPECT_EQ(source->GetChunkData(0), std::nullopt);
+}
+
+TEST(ChunkSourceLoaderTest, GroupsLooseFiles) {
+  const auto test_dir =
+      std::filesystem::temp_directory_path() /
+      ("chunk_source_loader_test_" +
+       std::to_string(
+           std::chrono::steady_clock::now().time_since_epoch().count()));
+  std::filesystem::create_directories(test_dir);
+  std::vector<FrameType> frames(2);
+  const std::string chunk = GzipBuffer(
+      std::string_view(reinterpret_cast<const char*>(frames.data()),
+                       frames.size() * sizeof(FrameType)),
+      1);
+
+  Queue<FilePathProvider::File> input_queue(10);
+  {
+    auto producer = input_queue.CreateProducer();
+    for (const std::string name :
+         {"training.12.gz", "training.3.gz", "training.7.gz", "training.10.gz",
+          "training.5.gz", "other.1.gz"}) {
+      std::ofstream(test_dir / name, std::ios::binary) << chunk;
+      producer.Put(FilePathProvider::File{
+          .filepath = test_dir / name,
+          .message_type = FilePathProvider::MessageType::kFile});
+    }
+    producer.Put(FilePathProvider::File{
+        .filepath = std::filesystem::path(""),
+        .message_type = FilePathProvider::MessageType::kInitialScanComplete});
+  }
+
+  ChunkSourceLoaderConfig config;
+  config.set_threads(1);
+  config.set_frame_format(ChunkSourceLoaderConfig::V7TrainingData);
+  config.set_loose_file_group_size(3);
+  config.mutable_output()->set_queue_capacity(10);
+  ChunkSourceLoader feed(config);
+  feed.SetInputs({&input_queue});
+  feed.Start();
+
+  // Sort key to chunk count.
+  std::map<std::string, size_t> sources;
+  while (true) {
+    auto output = feed.output_queue()->Get();
+    if (output.message_type ==
+        FilePathProvider::MessageType::kInitialScanComplete) {
+      break;
+    }
+    for (size_t i = 0; i < output.source->GetChunkCount(); ++i) {
+      const auto data = output.source->GetChunkData(i);
+      ASSERT_TRUE(data.has_value());
+      EXPECT_EQ(data->size(), frames.size());
+      EXPECT_EQ(output.source->GetChunkFrameCount(i), frames.size());
+    }
+    sources[output.source->GetChunkSortKey()] =
+        output.source->GetChunkCount();
+  }
+  // A full group of the first three training files, and the partial groups
+  // pending at the end of the initial scan.
+  const std::map<std::string, size_t> expected = {
+      {"training.12.gz", 3}, {"training.10.gz", 2}, {"other.1.gz", 1}};
+  EXPECT_EQ(sources, expected);
+  std::filesystem::remove_all(test_dir);
+}
+
+TEST(ChunkSourceLoaderTest, GroupsTricklingLooseFiles) {
+  const auto test_dir =
+      std::filesystem::temp_directory_path() /
+      ("chunk_source_loader_test_" +
+       std::to_string(
+           std::chrono::steady_clock::now().time_since_epoch().count()));
+  std::filesystem::create_directories(test_dir);
+  std::vector<FrameType> frames(2);
+  const std::string chunk = GzipBuffer(
+      std::string_view(reinterpret_cast<const char*>(frames.data()),
+                       frames.size() * sizeof(FrameType)),
+      1);
+
+  Queue<FilePathProvider::File> input_queue(10);
+  ChunkSourceLoaderConfig config;
+  config.set_threads(1);
+  config.set_frame_format(ChunkSourceLoaderConfig::V7TrainingData);
+  config.set_loose_file_group_size(3);
+  config.set_loose_file_group_max_delay_ms(300);
+  config.mutable_output()->set_queue_capacity(10);
+  ChunkSourceLoader feed(config);
+  feed.SetInputs({&input_queue});
+  feed.Start();
+
+  auto producer = input_queue.CreateProducer();
+  producer.Put(FilePathProvider::File{
+      .filepath = std::filesystem::path(""),
+      .message_type = FilePathProvider::MessageType::kInitialScanComplete});
+  EXPECT_EQ(feed.output_queue()->Get().message_type,
+            FilePathProvider::MessageType::kInitialScanComplete);
+  auto put_file = [&](const std::string& name) {
+    std::ofstream(test_dir / name, std::ios::binary) << chunk;
+    producer.Put(FilePathProvider::File{
+        .filepath = test_dir / name,
+        .message_type = FilePathProvider::MessageType::kFile});
+  };
+
+  // Files arriving one at a time, with the input queue drained in between,
+  // still fill a group.
+  for (int i = 1; i <= 4; ++i) {
+    put_file("training." + std::to_string(i) + ".gz");
+    input_queue.WaitForSizeAtMost(0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  auto output = feed.output_queue()->Get();
+  EXPECT_EQ(output.source->GetChunkSortKey(), "training.1.gz");
+  EXPECT_EQ(output.source->GetChunkCount(), 3);
+
+  // The fourth file goes out alone once its group is old enough.
+  const auto start = std::chrono::steady_clock::now();
+  output = feed.output_queue()->Get();
+  EXPECT_GE(std::chrono::steady_clock::now() - start,
+            std::chrono::milliseconds(200));
+  EXPECT_EQ(output.source->GetChunkSortKey(), "training.4.gz");
+  EXPECT_EQ(output.source->GetChunkCount(), 1);
+
+  // Pending files are passed on when the input is closed.
+  put_file("training.5.gz");
+  producer.Close();
+  output = feed.output_queue()->Get();
+  EXPECT_EQ(output.source->GetChunkSortKey(), "training.5.gz");
+  EXPECT_THROW(feed.output_queue()->Get(), QueueClosedException);
+  std::filesystem::remove_all(test_dir);
+}
+
 }  // namespace training
 }  // namespace lczero
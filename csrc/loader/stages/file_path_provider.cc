@@ -4,6 +4,10 @@
 #include <absl/container/flat_hash_set.h>
 #include <absl/log/check.h>
 #include <absl/log/log.h>
+#include <absl/strings/ascii.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_split.h>
+#include <absl/strings/string_view.h>
 #include <absl/synchronization/mutex.h>
 #include <sys/epoll.h>
 #include <unistd.h>
@@ -34,6 +38,10 @@ bool ShouldSkipPathEntry(const FilePathProvider::Path& path) {
   return ShouldSkipName(path.filename().string());
 }
 
+bool IsHttpUrl(std::string_view directory) {
+  return directory.starts_with("http://");
+}
+
 }  // namespace
 
 FilePathProvider::FilePathProvider(const FilePathProviderConfig& config)
@@ -43,6 +51,17 @@ FilePathProvider::FilePathProvider(const FilePathProviderConfig& config)
       load_metric_updater_() {
   LOG(INFO) << "Initializing FilePathProvider for directory: "
             << config.directory();
+  if (IsHttpUrl(config.directory())) {
+    http_client_ = std::make_unique<HttpClient>(1);
+    std::string_view base_url = config.directory();
+    while (base_url.ends_with('/')) base_url.remove_suffix(1);
+    directory_ = std::string(base_url);
+    index_url_ = absl::StrCat(base_url, "/", config.index_file());
+    index_poll_interval_ =
+        std::chrono::milliseconds(config.index_poll_interval_ms());
+    inotify_fd_ = -1;
+    return;
+  }
   inotify_fd_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
   CHECK_NE(inotify_fd_, -1)
       << "Failed to initialize inotify: " << strerror(errno);
@@ -262,6 +281,10 @@ void FilePathProvider::RemoveWatchRecursive(const Path& base) {
 }
 
 void FilePathProvider::Worker(std::stop_token stop_token) {
+  if (http_client_) {
+    PollIndex(stop_token);
+    return;
+  }
   // Perform directory scanning in background thread
   AddDirectory(directory_, stop_token);
 
@@ -298,6 +321,71 @@ void FilePathProvider::Worker(std::stop_token stop_token) {
   }
 }
 
+void FilePathProvider::PollIndex(std::stop_token stop_token) {
+  bool initial_scan_complete = false;
+  while (!stop_token.stop_requested()) {
+    if (auto paths = FetchIndex()) {
+      std::vector<File> files;
+      for (auto& path : *paths) {
+        if (ShouldSkipPathEntry(path) || !listed_files_.insert(path).second) {
+          continue;
+        }
+        files.push_back({.filepath = absl::StrCat(directory_.native(), "/",
+                                                  path),
+                         .message_type = MessageType::kFile});
+      }
+      if (!files.empty()) {
+        LOG(INFO) << "FilePathProvider found " << files.size()
+                  << " new file(s) in " << index_url_;
+        producer_.Put(files, stop_token);
+      }
+      if (!initial_scan_complete) {
+        LOG(INFO) << "FilePathProvider initial scan complete";
+        producer_.Put({{.filepath = Path{},
+                        .message_type = MessageType::kInitialScanComplete}},
+                      stop_token);
+        initial_scan_complete = true;
+      }
+    }
+
+    LoadMetricPauser pauser(load_metric_updater_);
+    const auto next_poll =
+        std::chrono::steady_clock::now() + index_poll_interval_;
+    while (std::chrono::steady_clock::now() < next_poll) {
+      if (stop_token.stop_requested()) {
+        pauser.DoNotResume();
+        return;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+  }
+}
+
+std::optional<std::vector<std::string>> FilePathProvider::FetchIndex() {
+  const auto info = http_client_->Head(index_url_);
+  if (!info) return std::nullopt;
+  // The index is taken as unchanged while its size and modification time are.
+  if (index_info_ && index_info_->size == info->size &&
+      index_info_->mtime_ns == info->mtime_ns) {
+    return std::nullopt;
+  }
+  std::string contents(info->size, '\0');
+  if (!contents.empty() &&
+      !http_client_->GetRange(index_url_, 0, std::span<char>(contents))) {
+    return std::nullopt;
+  }
+  index_info_ = info;
+
+  // One path per line, relative to the base URL.
+  std::vector<std::string> paths;
+  for (absl::string_view line : absl::StrSplit(contents, '\n')) {
+    line = absl::StripAsciiWhitespace(line);
+    if (line.empty() || line.front() == '#') continue;
+    paths.emplace_back(line);
+  }
+  return paths;
+}
+
 void FilePathProvider::ProcessInotifyEvents(Queue<File>::Producer& producer,
                                             std::stop_token stop_token) {
   constexpr size_t kNotifyBatchSize = 10000;
@@ -2,12 +2,16 @@
 
 #include <absl/base/thread_annotations.h>
 #include <absl/container/flat_hash_map.h>
+#include <absl/container/flat_hash_set.h>
 #include <absl/log/log.h>
 #include <absl/synchronization/mutex.h>
 #include <sys/inotify.h>
 
+#include <chrono>
 #include <filesystem>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <span>
 #include <stop_token>
 #include <string>
@@ -19,6 +23,7 @@
 #include "utils/metrics/load_metric.h"
 #include "utils/metrics/printer.h"
 #include "utils/metrics/statistics_metric.h"
+#include "utils/http_client.h"
 #include "utils/queue.h"
 #include "utils/thread_pool.h"
 
@@ -40,6 +45,8 @@ struct FilePathProviderFile {
 // This class watches for new files in a directory (recursively) and notifies
 // registered observers when new files are either closed after writing or
 // renamed into.
+// If the directory is an http:// URL, the files are instead listed in an index
+// file on the server, which is polled for new entries.
 // Uses background thread to monitor the directory.
 class FilePathProvider : public SingleOutputStage<FilePathProviderFile> {
  public:
@@ -67,6 +74,12 @@ class FilePathProvider : public SingleOutputStage<FilePathProviderFile> {
   void AddDirectory(const Path& directory, std::stop_token stop_token);
 
   void Worker(std::stop_token stop_token);
+  // Outputs the files listed in the index at the base URL, first all of them
+  // and then new ones as they are listed.
+  void PollIndex(std::stop_token stop_token);
+  // Returns the paths listed in the index, or std::nullopt if it can't be
+  // fetched or hasn't changed since the last call.
+  std::optional<std::vector<std::string>> FetchIndex();
   void AddWatchRecursive(const Path& path);
   void RemoveWatchRecursive(const Path& path);
   void ScanDirectoryWithWatch(const Path& directory,
@@ -84,6 +97,14 @@ class FilePathProvider : public SingleOutputStage<FilePathProviderFile> {
   Path directory_;  // Directory to monitor
   Queue<File>::Producer producer_;
 
+  // Set when directory_ is an http:// URL.
+  std::unique_ptr<HttpClient> http_client_;
+  std::string index_url_;
+  std::chrono::milliseconds index_poll_interval_{0};
+  std::optional<HttpClient::FileInfo> index_info_;
+  // Paths of the index that were already output.
+  absl::flat_hash_set<std::string> listed_files_;
+
   LoadMetricUpdater load_metric_updater_;
   std::stop_source stop_source_;
   ThreadPool thread_pool_{1, ThreadPoolOptions{}, stop_source_};
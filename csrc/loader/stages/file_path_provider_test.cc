@@ -9,6 +9,8 @@
 #include <unordered_set>
 #include <vector>
 
+#include "utils/test_http_server.h"
+
 namespace lczero {
 namespace training {
 
@@ -231,5 +233,38 @@ TEST_F(FilePathProviderTest, HandlesEmptyDirectory) {
   provider.Stop();
 }
 
+TEST(FilePathProviderHttpTest, PollsIndexAtBaseUrl) {
+  TestHttpServer server;
+  server.SetFile("/data/index.txt", "a.tar\n# comment\n\nsub/b.tar\n");
+  FilePathProviderConfig config;
+  config.mutable_output()->set_queue_capacity(128);
+  config.set_directory(server.url("/data/"));
+  config.set_index_poll_interval_ms(50);
+  FilePathProvider provider(config);
+  provider.Start();
+  auto* queue = provider.output_queue();
+
+  std::vector<std::string> files;
+  while (true) {
+    auto message = queue->Get();
+    if (message.message_type ==
+        FilePathProvider::MessageType::kInitialScanComplete) {
+      break;
+    }
+    files.push_back(message.filepath.string());
+  }
+  EXPECT_EQ(files, (std::vector<std::string>{server.url("/data/a.tar"),
+                                             server.url("/data/sub/b.tar")}));
+
+  // Only newly listed files are sent.
+  server.SetFile("/data/index.txt", "a.tar\nsub/b.tar\n.hidden.tar\nc.tar\n");
+  auto message = queue->Get();
+  EXPECT_EQ(message.message_type, FilePathProvider::MessageType::kFile);
+  EXPECT_EQ(message.filepath.string(), server.url("/data/c.tar"));
+
+  provider.Stop();
+  EXPECT_THROW(queue->Get(), QueueClosedException);
+}
+
 }  // namespace training
 }  // namespace lczero
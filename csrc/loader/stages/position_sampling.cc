@@ -7,9 +7,7 @@ namespace training {
 
 float ComputePositionSamplingWeight(const FrameType& frame,
                                     const PositionSamplingConfig& config) {
-  if (!config.has_diff_focus_q_weight() && !config.has_diff_focus_pol_scale()) {
-    return config.default_weight();
-  }
+  if (HasUniformPositionSamplingWeight(config)) return config.default_weight();
   if (std::isnan(frame.orig_q)) return config.default_weight();
   const float diff_q = std::abs(frame.best_q - frame.orig_q);
   const float q_weight = config.diff_focus_q_weight();
@@ -22,5 +20,10 @@ float ComputePositionSamplingWeight(const FrameType& frame,
       config.diff_focus_tau());
 }
 
+bool HasUniformPositionSamplingWeight(const PositionSamplingConfig& config) {
+  return !config.has_diff_focus_q_weight() &&
+         !config.has_diff_focus_pol_scale();
+}
+
 }  // namespace training
 }  // namespace lczero
\ No newline at end of file
@@ -9,5 +9,9 @@ namespace training {
 float ComputePositionSamplingWeight(const FrameType& frame,
                                     const PositionSamplingConfig& config);
 
+// Whether every frame gets default_weight, so that the weight of a chunk only
+// depends on its number of frames.
+bool HasUniformPositionSamplingWeight(const PositionSamplingConfig& config);
+
 }  // namespace training
 }  // namespace lczero
\ No newline at end of file
@@ -22,6 +22,7 @@
 #include "loader/stages/chunk_source_loader.h"
 #include "loader/stages/position_sampling.h"
 #include "proto/data_loader_config.pb.h"
+#include "utils/io_scheduler.h"
 #include "utils/thread_pool.h"
 
 namespace lczero {
@@ -41,7 +42,13 @@ ShufflingChunkPool::ShufflingChunkPool(const ShufflingChunkPoolConfig& config)
       chunk_loading_pool_(config.chunk_loading_threads(), ThreadPoolOptions{},
                           stop_source_),
       caching_pool_(config.has_cachehit_output() ? config.caching_threads() : 0,
-                    ThreadPoolOptions{}, stop_source_) {
+                    ThreadPoolOptions{}, stop_source_),
+      lookahead_pool_(config.io_lookahead_depth() > 0 ? 1 : 0,
+                      ThreadPoolOptions{}, stop_source_),
+      // Block sampling resets its shuffler in time proportional to the
+      // number of blocks, so it doesn't need to be prepared.
+      reshuffle_pool_(config.shuffle_block_size() > 1 ? 0 : 1,
+                      ThreadPoolOptions{}, stop_source_) {
   if (config.has_cachehit_output()) {
     cachehit_output_name_ = config.cachehit_output().name();
     cachehit_output_queue_.emplace(
@@ -53,6 +60,15 @@ ShufflingChunkPool::ShufflingChunkPool(const ShufflingChunkPoolConfig& config)
           primary_output_name_, "'"));
     }
   }
+  if (config.decoded_chunk_cache_bytes() > 0) {
+    decoded_chunk_cache_ =
+        std::make_unique<DecodedChunkCache>(config.decoded_chunk_cache_bytes());
+  }
+  if (config.shuffle_block_size() > 1) {
+    absl::MutexLock lock(&chunk_sources_mutex_);
+    stream_shuffler_.SetBlockSampling(config.shuffle_block_size(),
+                                      config.shuffle_open_blocks());
+  }
   LOG(INFO) << "Initializing ShufflingChunkPool with pool size "
             << config.chunk_pool_size();
 }
@@ -123,6 +139,17 @@ void ShufflingChunkPool::Start() {
             });
       }
 
+      if (config_.io_lookahead_depth() > 0) {
+        lookahead_pool_.Enqueue([this](std::stop_token stop_token) {
+          LookaheadWorker(stop_token);
+        });
+      }
+      if (reshuffle_pool_.num_threads() > 0) {
+        reshuffle_pool_.Enqueue([this](std::stop_token stop_token) {
+          ReshuffleWorker(stop_token);
+        });
+      }
+
       // Start output workers after everything is fully initialized.
       LOG(INFO) << "ShufflingChunkPool initialization done, starting workers";
       for (size_t i = 0; i < chunk_loading_pool_.num_threads(); ++i) {
@@ -171,6 +198,8 @@ void ShufflingChunkPool::Stop() {
 
   source_ingestion_pool_.Shutdown();
   chunk_loading_pool_.Shutdown();
+  lookahead_pool_.Shutdown();
+  reshuffle_pool_.Shutdown();
   if (cachehit_output_queue_) caching_pool_.Shutdown();
   output_queue()->Close();
   if (cachehit_output_queue_) cachehit_output_queue_->Close();
@@ -208,87 +237,146 @@ ShufflingChunkPool::InitializeChunkSources() {
             [](const auto& a, const auto& b) {
               return a->GetChunkSortKey() > b->GetChunkSortKey();
             });
-  std::atomic<size_t> total_chunks = 0;
-  size_t sources_to_keep = 0;
+  startup_candidate_sources_ = uninitialized_sources.size();
 
-  // Process sources sequentially until we have enough chunks.
   std::string current_anchor;
   {
     absl::MutexLock lock(&anchor_mutex_);
     current_anchor = anchor_;
   }
 
-  for (auto& source : uninitialized_sources) {
-    if (output_queue()->IsClosed()) {
-      LOG(INFO) << "Output queue closed, stopping source ingestion.";
-      break;
-    }
-    if (total_chunks >= chunk_pool_size_) break;
-
-    // Count chunks immediately; constructors have already prepared metadata.
-    const size_t chunk_count = source->GetChunkCount();
-    total_chunks += chunk_count;
+  // Index sources newest-first on a bounded number of threads. Sources finish
+  // out of order, so the window is grown over the longest fully indexed
+  // prefix, and no new source is started once that prefix covers the pool.
+  // At most startup_indexing_threads - 1 sources past the window are indexed
+  // needlessly.
+  const size_t num_sources = uninitialized_sources.size();
+  std::vector<size_t> chunk_counts(num_sources);
+  std::vector<bool> indexed(num_sources, false);
+  absl::Mutex progress_mutex;
+  size_t next_source = 0;
+  size_t sources_to_keep = 0;
+  size_t total_chunks = 0;
+  bool window_covered = (chunk_pool_size_ == 0);
 
-    // Count chunks since anchor during initial load.
-    if (source->GetChunkSortKey() > current_anchor) {
-      chunks_since_anchor_ += chunk_count;
+  auto indexing_worker = [&]() {
+    while (true) {
+      size_t index;
+      {
+        absl::MutexLock lock(&progress_mutex);
+        if (window_covered || next_source >= num_sources ||
+            output_queue()->IsClosed()) {
+          return;
+        }
+        index = next_source++;
+      }
+      const size_t chunk_count = uninitialized_sources[index]->GetChunkCount();
+
+      absl::MutexLock lock(&progress_mutex);
+      chunk_counts[index] = chunk_count;
+      indexed[index] = true;
+      while (!window_covered && sources_to_keep < num_sources &&
+             indexed[sources_to_keep]) {
+        const size_t count = chunk_counts[sources_to_keep];
+        total_chunks += count;
+        // Count chunks since anchor during initial load.
+        if (uninitialized_sources[sources_to_keep]->GetChunkSortKey() >
+            current_anchor) {
+          chunks_since_anchor_ += count;
+        }
+        ++sources_to_keep;
+        window_covered = total_chunks >= chunk_pool_size_;
+      }
+      startup_indexed_sources_ = sources_to_keep;
+      startup_indexed_chunks_ = total_chunks;
+      LOG_EVERY_N_SEC(INFO, 4)
+          << "Loaded so far: " << total_chunks << "; new: "
+          << chunks_since_anchor_ << "; sources: " << sources_to_keep << "/"
+          << num_sources;
     }
+  };
 
-    LOG_EVERY_N_SEC(INFO, 4) << "Loaded so far: " << total_chunks.load()
-                             << "; new: " << chunks_since_anchor_;
-    ++sources_to_keep;
+  {
+    const size_t num_threads = std::max<size_t>(
+        1, std::min<size_t>(config_.startup_indexing_threads(), num_sources));
+    ThreadPool indexing_pool(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+      indexing_pool.Enqueue(indexing_worker);
+    }
+    indexing_pool.WaitAll();
+  }
+  if (output_queue()->IsClosed()) {
+    LOG(INFO) << "Output queue closed, stopping source ingestion.";
   }
 
-  LOG(INFO) << "ShufflingChunkPool indexed " << total_chunks.load()
+  LOG(INFO) << "ShufflingChunkPool indexed " << total_chunks
             << " chunk(s) across " << sources_to_keep
             << " source(s) during startup.";
 
   if (total_chunks < chunk_pool_size_ && !output_queue()->IsClosed()) {
     LOG(ERROR) << "ShufflingChunkPool startup chunk requirement not met: "
-               << total_chunks.load() << " < " << chunk_pool_size_;
+               << total_chunks << " < " << chunk_pool_size_;
   }
 
   // Trim the vector to only keep the sources we need.
   uninitialized_sources.resize(sources_to_keep);
+
+  if (config_.resident_window() && !uninitialized_sources.empty()) {
+    std::atomic<size_t> next_resident{0};
+    const size_t num_threads = std::max<size_t>(
+        1, std::min<size_t>(config_.startup_indexing_threads(),
+                            uninitialized_sources.size()));
+    ThreadPool resident_pool(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+      resident_pool.Enqueue([&]() {
+        for (size_t index = next_resident++;
+             index < uninitialized_sources.size() &&
+             !output_queue()->IsClosed();
+             index = next_resident++) {
+          MakeSourceResident(*uninitialized_sources[index]);
+        }
+      });
+    }
+    resident_pool.WaitAll();
+    LOG(INFO) << "ShufflingChunkPool loaded " << resident_bytes_.load()
+              << " byte(s) of the initial window into memory.";
+  }
   return uninitialized_sources;
 }
 
 void ShufflingChunkPool::ProcessInputFiles(
     std::vector<std::unique_ptr<ChunkSource>> uninitialized_sources) {
   // Initialize chunk sources from the initial scan.
-  size_t initial_window_sources = 0;
-  size_t initial_total_chunks = 0;
+  auto table = std::make_shared<SourceTable>();
+  size_t start_chunk_index = 0;
+  // Newest sources first, so we add in reverse order.
+  std::for_each(uninitialized_sources.rbegin(), uninitialized_sources.rend(),
+                [this, &table, &start_chunk_index](auto& source) {
+                  const size_t count = source->GetChunkCount();
+                  table->push_back(
+                      MakeSourceItem(std::move(source), start_chunk_index));
+                  start_chunk_index += count;
+                });
+  const size_t initial_window_sources = table->size();
+  const size_t initial_total_chunks = start_chunk_index;
   {
+    absl::MutexLock ingestion_lock(&ingestion_mutex_);
     absl::MutexLock lock(&chunk_sources_mutex_);
-    size_t start_chunk_index = 0;
-    // Newest sources first, so we add in reverse order.
-    std::for_each(uninitialized_sources.rbegin(), uninitialized_sources.rend(),
-                  [this, &start_chunk_index](auto& source) {
-                    const size_t count = source->GetChunkCount();
-                    chunk_sources_.push_back(
-                        {.start_chunk_index = start_chunk_index,
-                         .source = std::move(source),
-                         .dropped_chunks = {},
-                         .use_counts = std::vector<uint16_t>(count, 0),
-                         .weight = std::vector<float>(count, -1.0f),
-                         .cache = std::vector<std::unique_ptr<CacheNode>>(
-                             cachehit_output_queue_.has_value() ? count : 0)});
-                    start_chunk_index +=
-                        chunk_sources_.back().source->GetChunkCount();
-                  });
-
     // Initialize stream shuffler with the initial bounds.
-    if (!chunk_sources_.empty()) {
-      size_t total_chunks = chunk_sources_.back().start_chunk_index +
-                            chunk_sources_.back().source->GetChunkCount();
+    if (!table->empty()) {
       // Set bounds to provide the last chunk_pool_size_ chunks.
-      size_t lower_bound =
-          total_chunks > chunk_pool_size_ ? total_chunks - chunk_pool_size_ : 0;
+      size_t lower_bound = initial_total_chunks > chunk_pool_size_
+                               ? initial_total_chunks - chunk_pool_size_
+                               : 0;
       stream_shuffler_.SetLowerBound(lower_bound);
-      stream_shuffler_.SetUpperBound(total_chunks);
-      initial_total_chunks = total_chunks;
+      // One source at a time, so that shuffle blocks don't span sources.
+      for (const auto& item : *table) {
+        const size_t end =
+            item->start_chunk_index + item->source->GetChunkCount();
+        if (end > lower_bound) stream_shuffler_.SetUpperBound(end);
+      }
     }
-    initial_window_sources = chunk_sources_.size();
+    source_table_.store(std::move(table));
   }
 
   LOG(INFO) << "ShufflingChunkPool initial window ready with "
@@ -300,11 +388,11 @@ void ShufflingChunkPool::ProcessInputFiles(
     absl::MutexLock anchor_lock(&anchor_mutex_);
     LOG(INFO) << "Current anchor: '" << anchor_ << "'";
 
-    absl::MutexLock sources_lock(&chunk_sources_mutex_);
+    const auto sources = source_table_.load();
     std::vector<const ChunkSourceItem*> sources_after_anchor;
-    for (const auto& item : chunk_sources_) {
-      if (item.source->GetChunkSortKey() > anchor_) {
-        sources_after_anchor.push_back(&item);
+    for (const auto& item : *sources) {
+      if (item->source->GetChunkSortKey() > anchor_) {
+        sources_after_anchor.push_back(item.get());
       }
     }
 
@@ -341,9 +429,7 @@ void ShufflingChunkPool::SourceIngestionWorker(
           FilePathProvider::MessageType::kFile) {
         // Ingest the new chunk source.
         auto source = std::move(chunk_source_with_phase.source);
-        size_t chunk_count = source->GetChunkCount();
-        absl::MutexLock lock(&chunk_sources_mutex_);
-        chunks_since_anchor_ += chunk_count;
+        if (config_.resident_window()) MakeSourceResident(*source);
         AddNewChunkSource(std::move(source));
       }
     }
@@ -354,6 +440,22 @@ void ShufflingChunkPool::SourceIngestionWorker(
   }
 }
 
+void ShufflingChunkPool::MakeSourceResident(ChunkSource& source) {
+  bool resident;
+  {
+    IoBudget::Lease lease(IoBudget::Global());
+    resident = source.MakeResident();
+  }
+  if (!resident) {
+    LOG_EVERY_N_SEC(WARNING, 10)
+        << "Chunk source " << source.GetChunkSortKey()
+        << " is not resident, reading it from disk.";
+    return;
+  }
+  resident_bytes_.fetch_add(source.GetResidentBytes(),
+                            std::memory_order_acq_rel);
+}
+
 void ShufflingChunkPool::OutputWorker(std::stop_token stop_token,
                                       ChunkLoadingThreadContext* context) {
   // Create a local producer for this worker
@@ -366,9 +468,9 @@ void ShufflingChunkPool::OutputWorker(std::stop_token stop_token,
 
   try {
     while (true) {
-      auto result = GetNextChunkData();
+      auto result = GetNextChunkData(context);
       if (!result) {
-        if (output_queue()->IsClosed()) break;
+        if (output_queue()->IsClosed() || stop_token.stop_requested()) break;
         continue;
       }
       LoadMetricPauser pauser(context->load_metric_updater);
@@ -404,32 +506,26 @@ void ShufflingChunkPool::CachingWorker(std::stop_token stop_token,
       absl::MutexLock lock(&chunk_sources_mutex_);
 
       // Find the chunk source containing this global index.
-      auto it = absl::c_lower_bound(
-          chunk_sources_, cache_request.global_index,
-          [](const auto& source_item, size_t chunk_idx) {
-            return source_item.start_chunk_index +
-                       source_item.source->GetChunkCount() <=
-                   chunk_idx;
-          });
-
-      if (it == chunk_sources_.end() ||
-          cache_request.global_index < it->start_chunk_index) {
+      ChunkSourceItem* const it =
+          FindSourceByIndex(*source_table_.load(), cache_request.global_index);
+      if (!it) {
         chunk_source_not_found_.fetch_add(1, std::memory_order_acq_rel);
         continue;
       }
 
       const size_t local_index =
           cache_request.global_index - it->start_chunk_index;
-      assert(local_index < it->use_counts.size());
+      assert(local_index < it->metadata.size());
 
       // Check use_count match.
-      if (it->use_counts[local_index] != cache_request.next_use) {
+      if (it->metadata.use_count(local_index) !=
+          (cache_request.next_use & ChunkMetadata::kUseCountMask)) {
         mismatched_use_counts_.fetch_add(1, std::memory_order_acq_rel);
         continue;
       }
 
       // Compute how many positions to cache.
-      const float weight = it->weight[local_index];
+      const float weight = it->metadata.weight(local_index);
       assert(weight >= 0.0f);
       const double probability = ComputeHanseProbability(weight);
       exponential_avg_probability =
@@ -439,21 +535,11 @@ void ShufflingChunkPool::CachingWorker(std::stop_token stop_token,
                        reminder;
       reminder = n - std::floor(n);
       const size_t positions_to_cache = static_cast<size_t>(std::floor(n));
-      // Traverse and extend the cache chain.
-      std::unique_ptr<CacheNode>* current = &it->cache[local_index];
-      for (size_t i = 0; i < positions_to_cache; ++i) {
-        if (*current) {
-          current = &(*current)->next;
-          continue;
-        }
-        if (i >= cache_request.items.size()) break;
-        auto node = std::make_unique<CacheNode>();
-        node->frame = cache_request.items[i];
-        *current = std::move(node);
-        current = &(*current)->next;
-        newly_cached_.fetch_add(1, std::memory_order_acq_rel);
-        cached_positions_.fetch_add(1, std::memory_order_acq_rel);
-      }
+      // Extend the cache chain.
+      const size_t added = it->metadata.AddCachedPositions(
+          local_index, cache_request.items, positions_to_cache);
+      newly_cached_.fetch_add(added, std::memory_order_acq_rel);
+      cached_positions_.fetch_add(added, std::memory_order_acq_rel);
 
       const size_t dropped =
           cache_request.items.size() > positions_to_cache
@@ -468,123 +554,409 @@ void ShufflingChunkPool::CachingWorker(std::stop_token stop_token,
   }
 }
 
-struct ShufflingChunkPool::ChunkData {
-  std::vector<FrameType> data;
-  std::string sort_key;
-  size_t local_index = 0;
-  size_t global_index = 0;
-  uint32_t use_count = 0;
-  ChunkSourceItem* source_item = nullptr;
+struct ShufflingChunkPool::LookaheadSlot {
+  ChunkData chunk;
+  // Keeps the descriptor open while the read is in flight.
+  FileDescriptorCache::Lease file;
+  // Stored chunk bytes, valid if read_ok.
+  std::string buffer;
+  std::chrono::steady_clock::time_point submit_time;
+  // Set when the read has completed, or immediately if the chunk is to be
+  // loaded synchronously. Guarded by lookahead_mutex_.
+  bool done = false;
+  bool read_ok = false;
 };
 
 std::optional<std::variant<TrainingChunk, FrameType>>
-ShufflingChunkPool::GetNextChunkData() {
+ShufflingChunkPool::GetNextChunkData(ChunkLoadingThreadContext* context) {
+  if (config_.io_lookahead_depth() > 0) return GetNextLookaheadChunk();
+  const size_t batch_size =
+      std::max<size_t>(config_.chunk_claim_batch_size(), 1);
+  std::deque<ChunkData>& claimed = context->claimed_chunks;
   while (true) {
-    ChunkData chunk_data;
-    ChunkStatus status;
-    {
+    if (claimed.empty()) {
+      // Dropped chunks count as attempts too, so that the lock is released
+      // now and then even if every chunk has been dropped.
+      bool end = false;
       absl::MutexLock lock(&chunk_sources_mutex_);
-      status = GetChunkInfo(chunk_data);
-      if (status == ChunkStatus::kEnd) return std::nullopt;
-      if (status == ChunkStatus::kRetry) continue;
+      for (size_t attempt = 0; attempt < batch_size && !end; ++attempt) {
+        ChunkData chunk_data;
+        const ChunkStatus status = GetChunkInfo(chunk_data);
+        end = status == ChunkStatus::kEnd;
+        if (status == ChunkStatus::kOk) {
+          claimed.push_back(std::move(chunk_data));
+        }
+      }
+      if (claimed.empty()) {
+        if (end) return std::nullopt;
+        continue;
+      }
+    }
+    ChunkData chunk_data = std::move(claimed.front());
+    claimed.pop_front();
+    if (auto result = TakeChunk(chunk_data)) return result;
+  }
+}
+
+std::optional<std::variant<TrainingChunk, FrameType>>
+ShufflingChunkPool::TakeChunk(ChunkData& chunk_data) {
+  const bool hanse_enabled = config_.hanse_sampling_threshold() > 0;
+  if (hanse_enabled) {
+    if (chunk_data.weight < 0.0f) {
+      // Another claim of the same chunk may have published it since.
+      absl::MutexLock lock(&chunk_sources_mutex_);
+      ChunkSourceItem* const item = FindSourceItem(chunk_data);
+      if (!item) return std::nullopt;
+      chunk_data.weight = item->metadata.weight(chunk_data.local_index);
+    }
+    (chunk_data.weight < 0.0f ? hanse_cache_misses_ : hanse_cache_hits_)
+        .fetch_add(1, std::memory_order_acq_rel);
+    if (!ComputeMissingWeight(chunk_data)) {
+      MarkDropped(chunk_data);
+      return std::nullopt;
+    }
+  }
+
+  {
+    absl::MutexLock lock(&chunk_sources_mutex_);
+    ChunkSourceItem* const item = FindSourceItem(chunk_data);
+    if (!item) return std::nullopt;
+    if (hanse_enabled) {
+      ChunkMetadata& metadata = item->metadata;
+      if (metadata.weight(chunk_data.local_index) < 0.0f) {
+        metadata.set_weight(chunk_data.local_index, chunk_data.weight);
+        max_weight_ =
+            std::max(max_weight_, metadata.weight(chunk_data.local_index));
+        AddSample(chunk_weight_stats_, static_cast<double>(chunk_data.weight));
+      }
+      if (!HanseAccept(metadata.weight(chunk_data.local_index))) {
+        return std::nullopt;
+      }
+    }
 
-      const bool hanse_enabled = config_.hanse_sampling_threshold() > 0;
-      if (hanse_enabled && !HanseAccept(chunk_data)) continue;
+    // Increment use_count for this chunk.
+    assert(item->metadata.size() > chunk_data.local_index);
+    chunk_data.use_count =
+        item->metadata.IncrementUseCount(chunk_data.local_index);
 
-      // Increment use_count for this chunk.
-      assert(chunk_data.source_item->use_counts.size() >
-             chunk_data.local_index);
-      chunk_data.use_count =
-          chunk_data.source_item->use_counts[chunk_data.local_index]++;
+    // Check cache if configured.
+    if (cachehit_output_queue_.has_value()) {
+      if (auto cached_frame =
+              item->metadata.PopCachedPosition(chunk_data.local_index)) {
+        cache_hits_.fetch_add(1, std::memory_order_acq_rel);
+        cached_positions_.fetch_sub(1, std::memory_order_acq_rel);
+        return *cached_frame;
+      }
+      cache_misses_.fetch_add(1, std::memory_order_acq_rel);
+    }
+  }
 
-      // Check cache if configured.
-      if (cachehit_output_queue_.has_value()) {
-        auto& cache_chain =
-            chunk_data.source_item->cache[chunk_data.local_index];
-        if (cache_chain) {
-          cache_hits_.fetch_add(1, std::memory_order_acq_rel);
-          cached_positions_.fetch_sub(1, std::memory_order_acq_rel);
-          FrameType cached_frame = cache_chain->frame;
-          cache_chain = std::move(cache_chain->next);
-          return cached_frame;
+  if (chunk_data.data.empty() && !LoadChunkData(chunk_data)) {
+    MarkDropped(chunk_data);
+    return std::nullopt;
+  }
+
+  TrainingChunk chunk;
+  chunk.sort_key = std::move(chunk_data.sort_key);
+  chunk.index_within_sort_key = chunk_data.local_index;
+  chunk.use_count = chunk_data.use_count;
+  chunk.global_index = chunk_data.global_index;
+  chunk.frames = std::move(chunk_data.data);
+  return chunk;
+}
+
+std::optional<std::variant<TrainingChunk, FrameType>>
+ShufflingChunkPool::GetNextLookaheadChunk() {
+  while (true) {
+    std::unique_ptr<LookaheadSlot> slot;
+    {
+      absl::MutexLock lock(&lookahead_mutex_);
+      auto front_done = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(
+                            lookahead_mutex_) {
+        return !lookahead_slots_.empty() && lookahead_slots_.front()->done;
+      };
+      while (!lookahead_mutex_.AwaitWithTimeout(absl::Condition(&front_done),
+                                                absl::Milliseconds(100))) {
+        if (stop_source_.stop_requested() || output_queue()->IsClosed()) {
+          return std::nullopt;
         }
-        cache_misses_.fetch_add(1, std::memory_order_acq_rel);
       }
+      slot = std::move(lookahead_slots_.front());
+      lookahead_slots_.pop_front();
+    }
 
-      if (chunk_data.data.empty()) {
-        if (!LoadChunkData(chunk_data)) continue;
+    // Decode outside of the locks, so that output workers decode in parallel.
+    ChunkData& chunk_data = slot->chunk;
+    if (slot->read_ok) {
+      auto data = chunk_data.source->DecodeStoredChunk(chunk_data.local_index,
+                                                       slot->buffer);
+      if (!data || data->empty()) {
+        MarkDropped(chunk_data);
+        continue;
       }
+      CacheDecodedChunk(chunk_data.global_index, *data);
+      chunk_data.data = std::move(*data);
     }
+    if (auto result = TakeChunk(chunk_data)) return result;
+  }
+}
 
-    TrainingChunk chunk;
-    chunk.sort_key = std::move(chunk_data.sort_key);
-    chunk.index_within_sort_key = chunk_data.local_index;
-    chunk.use_count = chunk_data.use_count;
-    chunk.global_index = chunk_data.global_index;
-    chunk.frames = std::move(chunk_data.data);
+void ShufflingChunkPool::LookaheadWorker(std::stop_token stop_token) {
+  const size_t depth = config_.io_lookahead_depth();
+  // Reads of the whole window are queued at once and issued in file order;
+  // the output workers still consume the slots in shuffle order.
+  IoScheduler scheduler(depth);
+  while (!stop_token.stop_requested()) {
+    size_t to_draw;
+    {
+      absl::MutexLock lock(&lookahead_mutex_);
+      if (scheduler.in_flight() == 0 && scheduler.queued() == 0) {
+        // Nothing to reap, wait for the output workers to make room.
+        auto has_room = [this, depth]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(
+                            lookahead_mutex_) {
+          return lookahead_slots_.size() < depth;
+        };
+        lookahead_mutex_.AwaitWithTimeout(absl::Condition(&has_room),
+                                          absl::Milliseconds(100));
+      }
+      to_draw = depth - std::min(depth, lookahead_slots_.size());
+    }
 
-    return chunk;
+    // Draw the next chunks of the shuffled stream.
+    std::vector<std::unique_ptr<LookaheadSlot>> drawn;
+    if (to_draw > 0) {
+      absl::MutexLock lock(&chunk_sources_mutex_);
+      while (drawn.size() < to_draw) {
+        ChunkData chunk_data;
+        const ChunkStatus status = GetChunkInfo(chunk_data);
+        if (status == ChunkStatus::kEnd) break;
+        if (status == ChunkStatus::kRetry) continue;
+        auto& slot = drawn.emplace_back(std::make_unique<LookaheadSlot>());
+        slot->chunk = std::move(chunk_data);
+      }
+    }
+
+    for (auto& slot : drawn) {
+      const ChunkData& chunk = slot->chunk;
+      auto stored =
+          decoded_chunk_cache_ &&
+                  decoded_chunk_cache_->Get(chunk.global_index).has_value()
+              ? std::nullopt
+              : chunk.source->GetStoredChunk(chunk.local_index);
+      if (!stored) {
+        // Loaded by the output worker (from memory, or synchronously).
+        slot->done = true;
+        continue;
+      }
+      slot->buffer.resize(stored->size);
+      slot->submit_time = std::chrono::steady_clock::now();
+      slot->file = std::move(stored->file);
+      scheduler.Enqueue({.fd = slot->file.fd(),
+                         .offset = stored->offset,
+                         .buffer = slot->buffer,
+                         .tag = reinterpret_cast<uint64_t>(slot.get())});
+    }
+    {
+      absl::MutexLock lock(&lookahead_mutex_);
+      for (auto& slot : drawn) lookahead_slots_.push_back(std::move(slot));
+    }
+    // Other stages may hold the whole I/O budget, so don't block for long.
+    scheduler.Dispatch(absl::Milliseconds(100));
+    lookahead_in_flight_ = scheduler.in_flight();
+    lookahead_queued_ = scheduler.queued();
+    if (scheduler.in_flight() == 0) continue;
+
+    // Slots are only popped once done, so the completed ones are still alive.
+    const auto completions = scheduler.Wait();
+    const auto now = std::chrono::steady_clock::now();
+    absl::MutexLock lock(&lookahead_mutex_);
+    for (const auto& completion : completions) {
+      auto* slot = reinterpret_cast<LookaheadSlot*>(completion.tag);
+      slot->done = true;
+      slot->read_ok = completion.ok;
+      slot->file = {};
+      if (!completion.ok) {
+        lookahead_read_failures_.fetch_add(1, std::memory_order_acq_rel);
+      }
+      AddSample(lookahead_read_latency_ms_,
+                std::chrono::duration<double, std::milli>(now -
+                                                          slot->submit_time)
+                    .count());
+    }
+    lookahead_in_flight_ = scheduler.in_flight();
   }
 }
 
 bool ShufflingChunkPool::LoadChunkData(ChunkData& chunk_data) {
-  std::optional<std::vector<FrameType>> data =
-      chunk_data.source_item->source->GetChunkData(chunk_data.local_index);
+  if (decoded_chunk_cache_) {
+    if (auto cached = decoded_chunk_cache_->Get(chunk_data.global_index)) {
+      decoded_cache_hits_.fetch_add(1, std::memory_order_acq_rel);
+      chunk_data.data = **cached;
+      return true;
+    }
+  }
 
-  if (!data || data->empty()) {
-    chunk_data.source_item->dropped_chunks.insert(chunk_data.local_index);
-    dropped_chunks_metric_.fetch_add(1, std::memory_order_acq_rel);
-    return false;
+  std::optional<std::vector<FrameType>> data;
+  {
+    IoBudget::Lease lease(IoBudget::Global());
+    data = chunk_data.source->GetChunkData(chunk_data.local_index);
   }
+  if (!data || data->empty()) return false;
 
+  CacheDecodedChunk(chunk_data.global_index, *data);
   chunk_data.data = std::move(*data);
   return true;
 }
 
+void ShufflingChunkPool::CacheDecodedChunk(
+    size_t global_index, const std::vector<FrameType>& data) {
+  if (!decoded_chunk_cache_) return;
+  // Every chunk decoded while the cache is enabled was a miss.
+  decoded_cache_misses_.fetch_add(1, std::memory_order_acq_rel);
+  // The cache keeps its own copy, as the consumers modify the frames.
+  decoded_chunk_cache_->Insert(
+      global_index, std::make_shared<const std::vector<FrameType>>(data),
+      data.size() * sizeof(FrameType));
+}
+
 ShufflingChunkPool::ChunkStatus ShufflingChunkPool::GetChunkInfo(
     ChunkData& out_chunk_data) {
   std::optional<size_t> chunk_index = stream_shuffler_.GetNextItem();
+  const auto sources = source_table_.load();
 
-  if (!chunk_index && !chunk_sources_.empty()) {
-    size_t total_chunks = chunk_sources_.back().start_chunk_index +
-                          chunk_sources_.back().source->GetChunkCount();
-    size_t lower_bound = total_chunks > chunk_pool_size_
-                             ? total_chunks - chunk_pool_size_
-                             : chunk_sources_.front().start_chunk_index;
-    stream_shuffler_.Reset(lower_bound, total_chunks);
-    reshuffles_.fetch_add(1, std::memory_order_acq_rel);
+  if (!chunk_index && !sources->empty()) {
+    Reshuffle(*sources);
     chunk_index = stream_shuffler_.GetNextItem();
+  } else if (chunk_index && !reshuffle_pending_ &&
+             reshuffle_pool_.num_threads() > 0) {
+    // Request the next shuffler once half of the window has been drawn.
+    const auto [lower_bound, upper_bound] = ReshuffleBounds(*sources);
+    if (2 * stream_shuffler_.size() <= upper_bound - lower_bound) {
+      reshuffle_pending_ = true;
+      absl::MutexLock lock(&reshuffle_mutex_);
+      reshuffle_requested_ = true;
+    }
   }
 
   if (!chunk_index) return ChunkStatus::kEnd;
 
-  auto it =
-      absl::c_lower_bound(chunk_sources_, *chunk_index,
-                          [](const auto& source_item, size_t chunk_idx) {
-                            return source_item.start_chunk_index +
-                                       source_item.source->GetChunkCount() <=
-                                   chunk_idx;
-                          });
-
-  if (ABSL_PREDICT_FALSE(it == chunk_sources_.end() ||
-                         *chunk_index < it->start_chunk_index)) {
+  const ChunkSourceItem* const it = FindSourceByIndex(*sources, *chunk_index);
+  if (ABSL_PREDICT_FALSE(!it)) {
     LOG(WARNING) << "Chunk index " << *chunk_index
                  << " out of range for available chunk sources.";
     return ChunkStatus::kRetry;
   }
 
   out_chunk_data.local_index = *chunk_index - it->start_chunk_index;
-  if (it->dropped_chunks.contains(out_chunk_data.local_index)) {
+  if (it->metadata.dropped(out_chunk_data.local_index)) {
     return ChunkStatus::kRetry;
   }
 
-  out_chunk_data.source_item = &(*it);
+  out_chunk_data.source = it->source;
   out_chunk_data.sort_key = it->source->GetChunkSortKey();
   out_chunk_data.global_index = *chunk_index;
+  out_chunk_data.weight = it->metadata.weight(out_chunk_data.local_index);
 
   return ChunkStatus::kOk;
 }
 
+std::pair<size_t, size_t> ShufflingChunkPool::ReshuffleBounds(
+    const SourceTable& table) const {
+  if (table.empty()) return {0, 0};
+  const size_t total_chunks = table.back()->start_chunk_index +
+                              table.back()->source->GetChunkCount();
+  const size_t lower_bound = total_chunks > chunk_pool_size_
+                                 ? total_chunks - chunk_pool_size_
+                                 : table.front()->start_chunk_index;
+  return {lower_bound, total_chunks};
+}
+
+void ShufflingChunkPool::Reshuffle(const SourceTable& table) {
+  const auto start = std::chrono::steady_clock::now();
+  const auto [lower_bound, upper_bound] = ReshuffleBounds(table);
+  std::unique_ptr<StreamShuffler> next;
+  if (reshuffle_pending_) {
+    absl::MutexLock lock(&reshuffle_mutex_);
+    next = std::move(next_shuffler_);
+  }
+  if (next) {
+    // Built from an earlier table, so only catch up with the window since.
+    next->SetUpperBound(upper_bound);
+    next->SetLowerBound(lower_bound);
+    std::swap(stream_shuffler_, *next);
+    reshuffle_pending_ = false;
+    absl::MutexLock lock(&reshuffle_mutex_);
+    retired_shuffler_ = std::move(next);
+  } else {
+    // Not requested or not ready yet; a late one is used next time.
+    stream_shuffler_.Reset(lower_bound, upper_bound);
+  }
+  reshuffles_.fetch_add(1, std::memory_order_acq_rel);
+  AddSample(reshuffle_latency_ms_,
+            std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start)
+                .count());
+}
+
+void ShufflingChunkPool::ReshuffleWorker(std::stop_token stop_token) {
+  while (!stop_token.stop_requested()) {
+    bool requested;
+    std::unique_ptr<StreamShuffler> retired;
+    {
+      absl::MutexLock lock(&reshuffle_mutex_);
+      auto has_work = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(
+                          reshuffle_mutex_) {
+        return reshuffle_requested_ || retired_shuffler_ != nullptr;
+      };
+      if (!reshuffle_mutex_.AwaitWithTimeout(absl::Condition(&has_work),
+                                             absl::Milliseconds(100))) {
+        continue;
+      }
+      requested = std::exchange(reshuffle_requested_, false);
+      retired = std::move(retired_shuffler_);
+    }
+    // Freeing the exhausted shuffler can take a while too.
+    retired.reset();
+    if (!requested) continue;
+
+    const auto [lower_bound, upper_bound] =
+        ReshuffleBounds(*source_table_.load());
+    auto next = std::make_unique<StreamShuffler>();
+    next->Reset(lower_bound, upper_bound);
+    absl::MutexLock lock(&reshuffle_mutex_);
+    next_shuffler_ = std::move(next);
+  }
+}
+
+ShufflingChunkPool::ChunkSourceItem* ShufflingChunkPool::FindSourceByIndex(
+    const SourceTable& table, size_t global_index) {
+  auto it = absl::c_lower_bound(
+      table, global_index, [](const auto& item, size_t chunk_idx) {
+        return item->start_chunk_index + item->source->GetChunkCount() <=
+               chunk_idx;
+      });
+  if (it == table.end() || global_index < (*it)->start_chunk_index) {
+    return nullptr;
+  }
+  return it->get();
+}
+
+ShufflingChunkPool::ChunkSourceItem* ShufflingChunkPool::FindSourceItem(
+    const ChunkData& chunk_data) {
+  ChunkSourceItem* const item =
+      FindSourceByIndex(*source_table_.load(), chunk_data.global_index);
+  if (!item || item->source != chunk_data.source) return nullptr;
+  return item;
+}
+
+void ShufflingChunkPool::MarkDropped(const ChunkData& chunk_data) {
+  dropped_chunks_metric_.fetch_add(1, std::memory_order_acq_rel);
+  absl::MutexLock lock(&chunk_sources_mutex_);
+  if (ChunkSourceItem* const item = FindSourceItem(chunk_data)) {
+    item->metadata.MarkDropped(chunk_data.local_index);
+  }
+}
+
 double ShufflingChunkPool::ComputeHanseProbability(float weight) {
   if (max_weight_ <= 0.0f) return 1.0;
   return std::pow(weight / max_weight_, config_.hanse_sampling_gamma());
@@ -598,23 +970,31 @@ float ShufflingChunkPool::ComputeChunkWeight(
   });
 }
 
-bool ShufflingChunkPool::HanseAccept(ChunkData& chunk_data) {
-  assert(chunk_data.source_item);
-  assert(chunk_data.source_item->weight.size() > chunk_data.local_index);
-
-  if (chunk_data.source_item->weight[chunk_data.local_index] < 0.0f) {
-    hanse_cache_misses_.fetch_add(1, std::memory_order_acq_rel);
-    if (!LoadChunkData(chunk_data)) return false;
-    const float weight = ComputeChunkWeight(chunk_data.data);
-    chunk_data.source_item->weight[chunk_data.local_index] = weight;
-    max_weight_ = std::max(max_weight_, weight);
-    AddSample(chunk_weight_stats_, static_cast<double>(weight));
-  } else {
-    hanse_cache_hits_.fetch_add(1, std::memory_order_acq_rel);
+bool ShufflingChunkPool::ComputeMissingWeight(ChunkData& chunk_data) {
+  if (chunk_data.weight >= 0.0f) return true;
+  // With uniform position weights the frame count is enough, and a rejected
+  // chunk is then never read.
+  std::optional<size_t> frame_count;
+  if (chunk_data.data.empty() &&
+      HasUniformPositionSamplingWeight(config_.position_sampling())) {
+    frame_count =
+        chunk_data.source->GetChunkFrameCount(chunk_data.local_index);
+    if (frame_count) {
+      hanse_frame_counts_peeked_.fetch_add(1, std::memory_order_acq_rel);
+    }
   }
+  if (!frame_count && chunk_data.data.empty() && !LoadChunkData(chunk_data)) {
+    return false;
+  }
+  chunk_data.weight = frame_count
+                          ? static_cast<float>(*frame_count) *
+                                config_.position_sampling().default_weight()
+                          : ComputeChunkWeight(chunk_data.data);
+  return true;
+}
 
-  const double p = ComputeHanseProbability(
-      chunk_data.source_item->weight[chunk_data.local_index]);
+bool ShufflingChunkPool::HanseAccept(float weight) {
+  const double p = ComputeHanseProbability(weight);
   const double u = absl::Uniform<double>(bitgen_, 0.0, 1.0);
   if (u >= p) {
     hanse_rejected_.fetch_add(1, std::memory_order_acq_rel);
@@ -623,62 +1003,76 @@ bool ShufflingChunkPool::HanseAccept(ChunkData& chunk_data) {
   return true;
 }
 
-void ShufflingChunkPool::AddNewChunkSource(std::unique_ptr<ChunkSource> source)
-    ABSL_EXCLUSIVE_LOCKS_REQUIRED(chunk_sources_mutex_) {
-  // Add new chunk source to the end of the deque.
-  size_t old_upper_bound = 0;
-  if (!chunk_sources_.empty()) {
-    const auto& last_source = chunk_sources_.back();
-    old_upper_bound =
-        last_source.start_chunk_index + last_source.source->GetChunkCount();
-  }
-
-  size_t count = source->GetChunkCount();
-  chunk_sources_.push_back(
-      {.start_chunk_index = old_upper_bound,
-       .source = std::move(source),
-       .dropped_chunks = {},
-       .use_counts = std::vector<uint16_t>(count, 0),
-       .weight = std::vector<float>(count, -1.0f),
-       .cache = std::vector<std::unique_ptr<CacheNode>>(
-           cachehit_output_queue_.has_value() ? count : 0)});
+std::shared_ptr<ShufflingChunkPool::ChunkSourceItem>
+ShufflingChunkPool::MakeSourceItem(std::unique_ptr<ChunkSource> source,
+                                   size_t start_chunk_index) const {
+  const size_t count = source->GetChunkCount();
+  return std::make_shared<ChunkSourceItem>(ChunkSourceItem{
+      .start_chunk_index = start_chunk_index,
+      .source = std::move(source),
+      .metadata = ChunkMetadata(count, cachehit_output_queue_.has_value())});
+}
 
-  // Calculate current window bounds.
-  size_t new_upper_bound = chunk_sources_.back().start_chunk_index +
-                           chunk_sources_.back().source->GetChunkCount();
+void ShufflingChunkPool::AddNewChunkSource(
+    std::unique_ptr<ChunkSource> source) {
+  const size_t count = source->GetChunkCount();
+  std::vector<std::shared_ptr<ChunkSourceItem>> evicted;
+  {
+    absl::MutexLock ingestion_lock(&ingestion_mutex_);
+    const auto current = source_table_.load();
+    const size_t old_upper_bound =
+        current->empty() ? 0
+                         : current->back()->start_chunk_index +
+                               current->back()->source->GetChunkCount();
+    const size_t new_upper_bound = old_upper_bound + count;
+
+    // Drop the oldest sources while the window without them is still full.
+    // The new source is always kept.
+    size_t first_kept = 0;
+    while (first_kept < current->size()) {
+      const ChunkSourceItem& item = *(*current)[first_kept];
+      const size_t window_start =
+          item.start_chunk_index + item.source->GetChunkCount();
+      if (new_upper_bound - window_start < chunk_pool_size_) break;
+      ++first_kept;
+    }
 
-  // Remove old chunks if window exceeds chunk_pool_size_.
-  while (!chunk_sources_.empty() && chunk_sources_.size() > 1) {
-    size_t window_start = chunk_sources_.front().start_chunk_index +
-                          chunk_sources_.front().source->GetChunkCount();
-    size_t window_size = new_upper_bound - window_start;
+    // Build the new table without holding chunk_sources_mutex_.
+    auto table = std::make_shared<SourceTable>(current->begin() + first_kept,
+                                               current->end());
+    table->push_back(MakeSourceItem(std::move(source), old_upper_bound));
+    evicted.assign(current->begin(), current->begin() + first_kept);
+    const size_t window_start = table->front()->start_chunk_index;
+    const size_t new_lower_bound = new_upper_bound > chunk_pool_size_
+                                       ? new_upper_bound - chunk_pool_size_
+                                       : window_start;
 
-    if (window_size < chunk_pool_size_) break;
+    absl::MutexLock lock(&chunk_sources_mutex_);
+    source_table_.store(std::move(table));
+    chunks_since_anchor_ += count;
+    for (const auto& item : evicted) {
+      cached_positions_.fetch_sub(item->metadata.cached_positions(),
+                                  std::memory_order_acq_rel);
+    }
+    stream_shuffler_.SetUpperBound(new_upper_bound);
+    stream_shuffler_.SetLowerBound(new_lower_bound);
+  }
 
-    // Count cached positions in the evicted source.
-    if (cachehit_output_queue_.has_value()) {
-      size_t evicted_cached = 0;
-      for (const auto& cache_chain : chunk_sources_.front().cache) {
-        const CacheNode* node = cache_chain.get();
-        while (node) {
-          ++evicted_cached;
-          node = node->next.get();
-        }
+  for (const auto& item : evicted) {
+    resident_bytes_.fetch_sub(item->source->GetResidentBytes(),
+                              std::memory_order_acq_rel);
+    evicted_io_stats_.Add(item->source->FlushIoStats());
+    // Frees the decoded chunks of the source right away, without scanning
+    // the cache: the cost is one lookup per evicted chunk, which is paid
+    // once per ingested chunk anyway.
+    if (decoded_chunk_cache_) {
+      const size_t end =
+          item->start_chunk_index + item->source->GetChunkCount();
+      for (size_t i = item->start_chunk_index; i < end; ++i) {
+        decoded_chunk_cache_->Erase(i);
       }
-      cached_positions_.fetch_sub(evicted_cached, std::memory_order_acq_rel);
     }
-
-    // Remove the oldest chunk source (front of deque).
-    chunk_sources_.pop_front();
   }
-
-  // Update stream shuffler bounds with the sliding window.
-  size_t window_start = chunk_sources_.front().start_chunk_index;
-  size_t new_lower_bound = new_upper_bound > chunk_pool_size_
-                               ? new_upper_bound - chunk_pool_size_
-                               : window_start;
-  stream_shuffler_.SetUpperBound(new_upper_bound);
-  stream_shuffler_.SetLowerBound(new_lower_bound);
 }
 
 StageMetricProto ShufflingChunkPool::FlushMetrics() {
@@ -701,17 +1095,16 @@ StageMetricProto ShufflingChunkPool::FlushMetrics() {
 
   // Get chunk sources statistics and pool state.
   {
-    absl::MutexLock lock(&chunk_sources_mutex_);
+    const auto sources = source_table_.load();
     auto* chunk_sources_metric = stage_metric.add_gauge_metrics();
     chunk_sources_metric->set_name("chunk_sources");
-    chunk_sources_metric->set_value(
-        static_cast<uint64_t>(chunk_sources_.size()));
+    chunk_sources_metric->set_value(static_cast<uint64_t>(sources->size()));
 
     size_t upper = 0;
     size_t current = 0;
-    if (!chunk_sources_.empty()) {
-      const auto& first = chunk_sources_.front();
-      const auto& last = chunk_sources_.back();
+    if (!sources->empty()) {
+      const auto& first = *sources->front();
+      const auto& last = *sources->back();
       upper = last.start_chunk_index + last.source->GetChunkCount();
       current = upper - first.start_chunk_index;
     }
@@ -725,6 +1118,29 @@ StageMetricProto ShufflingChunkPool::FlushMetrics() {
     auto* total_chunks_metric = stage_metric.add_gauge_metrics();
     total_chunks_metric->set_name("chunks_total");
     total_chunks_metric->set_value(static_cast<uint64_t>(upper));
+
+    ChunkSourceIoStats io_stats = evicted_io_stats_.Flush();
+    for (const auto& item : *sources) {
+      io_stats += item->source->FlushIoStats();
+    }
+    AddIoStatsMetrics(stage_metric, io_stats);
+  }
+
+  // Startup indexing progress.
+  {
+    auto* candidates = stage_metric.add_gauge_metrics();
+    candidates->set_name("startup_candidate_sources");
+    candidates->set_value(startup_candidate_sources_.load());
+
+    auto* sources = stage_metric.add_gauge_metrics();
+    sources->set_name("startup_indexed_sources");
+    sources->set_value(startup_indexed_sources_.load());
+    sources->set_capacity(startup_candidate_sources_.load());
+
+    auto* chunks = stage_metric.add_gauge_metrics();
+    chunks->set_name("startup_indexed_chunks");
+    chunks->set_value(startup_indexed_chunks_.load());
+    chunks->set_capacity(static_cast<uint64_t>(chunk_pool_size_));
   }
 
   // Get anchor-related metrics.
@@ -756,11 +1172,67 @@ StageMetricProto ShufflingChunkPool::FlushMetrics() {
     rejected->set_name("hanse_rejected");
     rejected->set_count(hanse_rejected_.exchange(0, std::memory_order_acq_rel));
 
+    auto* peeked = stage_metric.add_count_metrics();
+    peeked->set_name("hanse_frame_counts_peeked");
+    peeked->set_count(
+        hanse_frame_counts_peeked_.exchange(0, std::memory_order_acq_rel));
+
     auto* resh = stage_metric.add_count_metrics();
     resh->set_name("reshuffles");
     resh->set_count(reshuffles_.exchange(0, std::memory_order_acq_rel));
   }
 
+  // Decoded chunk cache metrics.
+  if (decoded_chunk_cache_) {
+    auto* hits = stage_metric.add_count_metrics();
+    hits->set_name("decoded_cache_hits");
+    hits->set_count(decoded_cache_hits_.exchange(0, std::memory_order_acq_rel));
+
+    auto* misses = stage_metric.add_count_metrics();
+    misses->set_name("decoded_cache_misses");
+    misses->set_count(
+        decoded_cache_misses_.exchange(0, std::memory_order_acq_rel));
+
+    auto* bytes = stage_metric.add_gauge_metrics();
+    bytes->set_name("decoded_cache_bytes");
+    bytes->set_value(decoded_chunk_cache_->charge());
+    bytes->set_capacity(decoded_chunk_cache_->capacity());
+
+    auto* chunks = stage_metric.add_gauge_metrics();
+    chunks->set_name("decoded_cache_chunks");
+    chunks->set_value(decoded_chunk_cache_->size());
+  }
+
+  if (config_.io_lookahead_depth() > 0) {
+    auto* in_flight = stage_metric.add_gauge_metrics();
+    in_flight->set_name("lookahead_in_flight");
+    in_flight->set_value(lookahead_in_flight_.load());
+    in_flight->set_capacity(config_.io_lookahead_depth());
+    auto* queued = stage_metric.add_gauge_metrics();
+    queued->set_name("lookahead_queued");
+    queued->set_value(lookahead_queued_.load());
+    queued->set_capacity(config_.io_lookahead_depth());
+
+    auto* failures = stage_metric.add_count_metrics();
+    failures->set_name("lookahead_read_failures");
+    failures->set_count(
+        lookahead_read_failures_.exchange(0, std::memory_order_acq_rel));
+
+    absl::MutexLock lock(&lookahead_mutex_);
+    if (lookahead_read_latency_ms_.count() > 0) {
+      lookahead_read_latency_ms_.set_name("lookahead_read_latency_ms");
+      UpdateFrom(*stage_metric.add_statistics_metrics(),
+                 lookahead_read_latency_ms_);
+    }
+    lookahead_read_latency_ms_.Clear();
+  }
+
+  if (config_.resident_window()) {
+    auto* resident = stage_metric.add_gauge_metrics();
+    resident->set_name("resident_bytes");
+    resident->set_value(resident_bytes_.load());
+  }
+
   // Position cache metrics.
   if (cachehit_output_queue_.has_value()) {
     LoadMetricProto caching_load;
@@ -812,6 +1284,24 @@ StageMetricProto ShufflingChunkPool::FlushMetrics() {
       UpdateFrom(*stage_metric.add_statistics_metrics(), chunk_weight_stats_);
     }
     chunk_weight_stats_.Clear();
+
+    size_t metadata_bytes = 0;
+    size_t chunks = 0;
+    for (const auto& item : *source_table_.load()) {
+      metadata_bytes += item->metadata.metadata_bytes();
+      chunks += item->metadata.size();
+    }
+    auto* metadata_metric = stage_metric.add_gauge_metrics();
+    metadata_metric->set_name("metadata_bytes_per_chunk");
+    metadata_metric->set_value(
+        chunks > 0 ? (metadata_bytes + chunks / 2) / chunks : 0);
+
+    if (reshuffle_latency_ms_.count() > 0) {
+      reshuffle_latency_ms_.set_name("reshuffle_latency_ms");
+      UpdateFrom(*stage_metric.add_statistics_metrics(),
+                 reshuffle_latency_ms_);
+    }
+    reshuffle_latency_ms_.Clear();
   }
 
   *stage_metric.add_queue_metrics() =
@@ -826,13 +1316,14 @@ StageMetricProto ShufflingChunkPool::FlushMetrics() {
 std::pair<std::string, int> ShufflingChunkPool::ResetAnchor() {
   absl::MutexLock anchor_lock(&anchor_mutex_);
   absl::MutexLock sources_lock(&chunk_sources_mutex_);
+  const auto sources = source_table_.load();
 
-  if (chunk_sources_.empty()) {
+  if (sources->empty()) {
     int previous_count = chunks_since_anchor_.exchange(0);
     return {anchor_, previous_count};
   }
 
-  anchor_ = chunk_sources_.back().source->GetChunkSortKey();
+  anchor_ = sources->back()->source->GetChunkSortKey();
   int previous_count = chunks_since_anchor_.exchange(0);
   return {anchor_, previous_count};
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <atomic>
+#include <deque>
 #include <filesystem>
 #include <memory>
 #include <optional>
@@ -8,15 +9,16 @@
 #include <string>
 #include <string_view>
 #include <thread>
+#include <utility>
 #include <variant>
 #include <vector>
 
 #include "absl/base/thread_annotations.h"
-#include "absl/container/flat_hash_set.h"
 #include "absl/random/random.h"
 #include "absl/synchronization/mutex.h"
 #include "loader/chunk_source/chunk_source.h"
 #include "loader/data_loader_metrics.h"
+#include "loader/stages/chunk_metadata.h"
 #include "loader/stages/chunk_source_loader.h"
 #include "loader/stages/stage.h"
 #include "loader/stages/training_chunk.h"
@@ -25,6 +27,7 @@
 #include "proto/training_metrics.pb.h"
 #include "utils/metrics/load_metric.h"
 #include "utils/queue.h"
+#include "utils/sharded_lru_cache.h"
 #include "utils/stream_shuffler.h"
 #include "utils/thread_pool.h"
 
@@ -56,27 +59,43 @@ class ShufflingChunkPool : public Stage {
   Queue<TrainingChunk>* output_queue() { return &primary_output_queue_; }
 
  private:
-  struct CacheNode {
-    FrameType frame;
-    std::unique_ptr<CacheNode> next;
-  };
-
+  // A source in the window. The per-chunk state is guarded by
+  // chunk_sources_mutex_.
   struct ChunkSourceItem {
     size_t start_chunk_index;
-    std::unique_ptr<ChunkSource> source;
-    absl::flat_hash_set<size_t> dropped_chunks;
-    // Per-chunk counters and cached weights.
-    std::vector<uint16_t> use_counts;
-    std::vector<float> weight;
-    std::vector<std::unique_ptr<CacheNode>> cache;
+    // Shared with chunks being read, which keep it open after eviction.
+    std::shared_ptr<ChunkSource> source;
+    // Use counts, dropped flags, cached weights and positions.
+    ChunkMetadata metadata;
   };
 
+  // Sources of the window, oldest first. A published table is never modified:
+  // ingestion publishes a new one, and an evicted source is freed once no
+  // reader holds a table (or a drawn chunk) referencing it.
+  using SourceTable = std::vector<std::shared_ptr<ChunkSourceItem>>;
+
   struct SourceIngestionThreadContext {
     LoadMetricUpdater load_metric_updater;
   };
 
+  // A chunk drawn from the shuffler.
+  struct ChunkData {
+    std::vector<FrameType> data;
+    std::string sort_key;
+    size_t local_index = 0;
+    size_t global_index = 0;
+    uint32_t use_count = 0;
+    // Keeps the source open while the chunk is read without
+    // chunk_sources_mutex_, even if it is evicted meanwhile.
+    std::shared_ptr<ChunkSource> source;
+    // Hanse weight when drawn, negative if not known yet.
+    float weight = -1.0f;
+  };
+
   struct ChunkLoadingThreadContext {
     LoadMetricUpdater load_metric_updater;
+    // Chunks drawn from the shuffler but not taken yet.
+    std::deque<ChunkData> claimed_chunks;
   };
 
   struct CachingThreadContext {
@@ -88,22 +107,67 @@ class ShufflingChunkPool : public Stage {
       std::vector<std::unique_ptr<ChunkSource>> uninitialized_sources);
   void SourceIngestionWorker(std::stop_token stop_token,
                              SourceIngestionThreadContext* context);
+  // Loads the source data into memory (resident_window mode).
+  void MakeSourceResident(ChunkSource& source);
   void OutputWorker(std::stop_token stop_token,
                     ChunkLoadingThreadContext* context);
   void CachingWorker(std::stop_token stop_token, CachingThreadContext* context);
+  std::shared_ptr<ChunkSourceItem> MakeSourceItem(
+      std::unique_ptr<ChunkSource> source, size_t start_chunk_index) const;
+  // Appends a source to the window and evicts the sources that fell out of
+  // it. Only the publication of the new table and the shuffler bounds happen
+  // under chunk_sources_mutex_.
   void AddNewChunkSource(std::unique_ptr<ChunkSource> source)
-      ABSL_EXCLUSIVE_LOCKS_REQUIRED(chunk_sources_mutex_);
-  std::optional<std::variant<TrainingChunk, FrameType>> GetNextChunkData()
+      ABSL_LOCKS_EXCLUDED(chunk_sources_mutex_, ingestion_mutex_);
+  // Returns the source containing the global chunk index, or nullptr.
+  static ChunkSourceItem* FindSourceByIndex(const SourceTable& table,
+                                            size_t global_index);
+  std::optional<std::variant<TrainingChunk, FrameType>> GetNextChunkData(
+      ChunkLoadingThreadContext* context)
       ABSL_LOCKS_EXCLUDED(chunk_sources_mutex_);
+  std::optional<std::variant<TrainingChunk, FrameType>> GetNextLookaheadChunk()
+      ABSL_LOCKS_EXCLUDED(chunk_sources_mutex_, lookahead_mutex_);
+  void LookaheadWorker(std::stop_token stop_token);
+  // Builds the shuffler of the next reshuffle when requested, so that
+  // GetChunkInfo() only has to swap it in.
+  void ReshuffleWorker(std::stop_token stop_token)
+      ABSL_LOCKS_EXCLUDED(reshuffle_mutex_);
+  // Returns the [lower, upper) shuffler bounds of a reshuffle of the window.
+  std::pair<size_t, size_t> ReshuffleBounds(const SourceTable& table) const;
+  // Restarts the shuffler over the whole window, with the prepared shuffler
+  // if there is one.
+  void Reshuffle(const SourceTable& table)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(chunk_sources_mutex_)
+          ABSL_LOCKS_EXCLUDED(reshuffle_mutex_);
 
   enum class ChunkStatus { kOk, kRetry, kEnd };
-  struct ChunkData;
+  struct LookaheadSlot;
 
+  // Draws the next chunk from the shuffler, and pins its source.
   ChunkStatus GetChunkInfo(ChunkData& out_chunk_data)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(chunk_sources_mutex_);
-  bool LoadChunkData(ChunkData& chunk_data)
+  // Returns the window entry of a drawn chunk, or nullptr if its source has
+  // been evicted since.
+  ChunkSourceItem* FindSourceItem(const ChunkData& chunk_data)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(chunk_sources_mutex_);
-  bool HanseAccept(ChunkData& chunk_data)
+  // Applies Hanse sampling, use counts and the position cache to a drawn
+  // chunk, loading its data if not done yet. Reads and decodes happen without
+  // chunk_sources_mutex_, which is only taken to publish the weight and use
+  // count. Returns std::nullopt if the chunk is skipped.
+  std::optional<std::variant<TrainingChunk, FrameType>> TakeChunk(
+      ChunkData& chunk_data) ABSL_LOCKS_EXCLUDED(chunk_sources_mutex_);
+  bool LoadChunkData(ChunkData& chunk_data)
+      ABSL_LOCKS_EXCLUDED(chunk_sources_mutex_);
+  // Adds a freshly decoded chunk to the decoded chunk cache, if enabled, and
+  // counts it as a cache miss.
+  void CacheDecodedChunk(size_t global_index,
+                         const std::vector<FrameType>& data);
+  // Fills in the Hanse weight of the chunk if it wasn't known when drawn.
+  bool ComputeMissingWeight(ChunkData& chunk_data)
+      ABSL_LOCKS_EXCLUDED(chunk_sources_mutex_);
+  void MarkDropped(const ChunkData& chunk_data)
+      ABSL_LOCKS_EXCLUDED(chunk_sources_mutex_);
+  bool HanseAccept(float weight)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(chunk_sources_mutex_);
   float ComputeChunkWeight(absl::Span<const FrameType> frames);
   double ComputeHanseProbability(float weight);
@@ -122,14 +186,40 @@ class ShufflingChunkPool : public Stage {
   ThreadPool source_ingestion_pool_;
   ThreadPool chunk_loading_pool_;
   ThreadPool caching_pool_;
+  ThreadPool lookahead_pool_;
+  ThreadPool reshuffle_pool_;
 
   std::atomic<int64_t> dropped_chunks_metric_{0};
 
+  // Decoded chunks keyed by global chunk index, if enabled.
+  using DecodedChunkCache =
+      ShardedLruCache<size_t, std::shared_ptr<const std::vector<FrameType>>>;
+  std::unique_ptr<DecodedChunkCache> decoded_chunk_cache_;
+
+  // Serializes publishers of source_table_.
+  absl::Mutex ingestion_mutex_ ABSL_ACQUIRED_BEFORE(chunk_sources_mutex_);
   absl::Mutex chunk_sources_mutex_;
-  std::deque<ChunkSourceItem> chunk_sources_
-      ABSL_GUARDED_BY(chunk_sources_mutex_);
+  // Loaded without locks by readers that only look at the sources. Stored
+  // under chunk_sources_mutex_, so that code holding it and modifying
+  // per-chunk state never touches a source after its eviction was accounted.
+  std::atomic<std::shared_ptr<const SourceTable>> source_table_{
+      std::make_shared<const SourceTable>()};
   StreamShuffler stream_shuffler_ ABSL_GUARDED_BY(chunk_sources_mutex_);
+  // Whether the next shuffler has been requested from ReshuffleWorker() and
+  // not swapped in yet.
+  bool reshuffle_pending_ ABSL_GUARDED_BY(chunk_sources_mutex_) = false;
+  StatisticsProtoDouble reshuffle_latency_ms_
+      ABSL_GUARDED_BY(chunk_sources_mutex_);
+  absl::Mutex reshuffle_mutex_ ABSL_ACQUIRED_AFTER(chunk_sources_mutex_);
+  bool reshuffle_requested_ ABSL_GUARDED_BY(reshuffle_mutex_) = false;
+  std::unique_ptr<StreamShuffler> next_shuffler_
+      ABSL_GUARDED_BY(reshuffle_mutex_);
+  // The exhausted shuffler, freed by ReshuffleWorker().
+  std::unique_ptr<StreamShuffler> retired_shuffler_
+      ABSL_GUARDED_BY(reshuffle_mutex_);
   float max_weight_ ABSL_GUARDED_BY(chunk_sources_mutex_) = 0.0f;
+  // I/O stats of sources that left the window since the last FlushMetrics().
+  ChunkSourceIoCounters evicted_io_stats_;
   std::jthread initialization_thread_;
   std::vector<std::unique_ptr<SourceIngestionThreadContext>>
       source_ingestion_thread_contexts_;
@@ -149,6 +239,8 @@ class ShufflingChunkPool : public Stage {
   std::atomic<uint64_t> hanse_cache_hits_{0};
   std::atomic<uint64_t> hanse_cache_misses_{0};
   std::atomic<uint64_t> hanse_rejected_{0};
+  // Hanse weights taken from ChunkSource::GetChunkFrameCount().
+  std::atomic<uint64_t> hanse_frame_counts_peeked_{0};
   std::atomic<uint64_t> reshuffles_{0};
   std::atomic<uint64_t> cache_hits_{0};
   std::atomic<uint64_t> cache_misses_{0};
@@ -157,9 +249,28 @@ class ShufflingChunkPool : public Stage {
   std::atomic<uint64_t> dropped_cache_positions_{0};
   std::atomic<uint64_t> chunk_source_not_found_{0};
   std::atomic<uint64_t> cached_positions_{0};
+  std::atomic<uint64_t> decoded_cache_hits_{0};
+  std::atomic<uint64_t> decoded_cache_misses_{0};
+  // Startup indexing progress, final once initialization is done.
+  std::atomic<uint64_t> startup_candidate_sources_{0};
+  std::atomic<uint64_t> startup_indexed_sources_{0};
+  std::atomic<uint64_t> startup_indexed_chunks_{0};
+  // Bytes held in memory by resident sources in the window.
+  std::atomic<uint64_t> resident_bytes_{0};
 
   StatisticsProtoDouble chunk_weight_stats_
       ABSL_GUARDED_BY(chunk_sources_mutex_);
+
+  // Chunks drawn by the lookahead worker, in shuffle order.
+  absl::Mutex lookahead_mutex_;
+  std::deque<std::unique_ptr<LookaheadSlot>> lookahead_slots_
+      ABSL_GUARDED_BY(lookahead_mutex_);
+  StatisticsProtoDouble lookahead_read_latency_ms_
+      ABSL_GUARDED_BY(lookahead_mutex_);
+  std::atomic<uint64_t> lookahead_in_flight_{0};
+  // Reads waiting for the I/O budget.
+  std::atomic<uint64_t> lookahead_queued_{0};
+  std::atomic<uint64_t> lookahead_read_failures_{0};
 };
 
 }  // namespace training
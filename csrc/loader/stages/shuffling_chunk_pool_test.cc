@@ -6,9 +6,12 @@
 #include <absl/cleanup/cleanup.h>
 #include <absl/log/log.h>
 #include <gtest/gtest.h>
+#include <unistd.h>
 
+#include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <memory>
 #include <set>
@@ -67,9 +70,22 @@ class MockChunkSource : public ChunkSource {
     return std::vector<FrameType>{frame};
   }
 
+  std::optional<size_t> GetChunkFrameCount(size_t /*index*/) const override {
+    return 1;
+  }
+
+  bool MakeResident() override {
+    resident_ = true;
+    return true;
+  }
+  size_t GetResidentBytes() const override {
+    return resident_ ? chunk_count_ * 100 : 0;
+  }
+
  private:
   std::string sort_key_;
   size_t chunk_count_;
+  bool resident_ = false;
 };
 
 class InvalidChunkSource : public ChunkSource {
@@ -84,16 +100,90 @@ class InvalidChunkSource : public ChunkSource {
     if (index >= 2) {
       throw std::out_of_range("Chunk index out of range");
     }
-    if (index == 0) {
+    return CountedDecode([index]() -> std::optional<std::vector<FrameType>> {
+      if (index == 0) {
+        return std::nullopt;
+      }
+      FrameType frame{};
+      frame.version = 42;
+      return std::vector<FrameType>{frame};
+    });
+  }
+
+ private:
+  std::string sort_key_;
+};
+
+// Reads chunks slowly, and records how many reads overlap.
+class SlowChunkSource : public MockChunkSource {
+ public:
+  using MockChunkSource::MockChunkSource;
+
+  std::optional<std::vector<FrameType>> GetChunkData(size_t index) override {
+    const int in_flight = ++in_flight_;
+    int seen = max_in_flight.load();
+    while (in_flight > seen &&
+           !max_in_flight.compare_exchange_weak(seen, in_flight)) {
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    --in_flight_;
+    return MockChunkSource::GetChunkData(index);
+  }
+
+  static inline std::atomic<int> max_in_flight{0};
+
+ private:
+  std::atomic<int> in_flight_{0};
+};
+
+// Stores one frame per chunk in a temporary file, and exposes it for
+// asynchronous reads.
+class FileBackedChunkSource : public ChunkSource {
+ public:
+  FileBackedChunkSource(const std::string& sort_key, size_t chunk_count)
+      : sort_key_(sort_key), chunk_count_(chunk_count), file_(tmpfile()) {
+    for (size_t i = 0; i < chunk_count; ++i) {
+      FrameType frame{};
+      frame.version = static_cast<uint32_t>(i);
+      fwrite(&frame, sizeof(frame), 1, file_);
+    }
+    fflush(file_);
+  }
+  ~FileBackedChunkSource() override { fclose(file_); }
+
+  std::string GetChunkSortKey() const override { return sort_key_; }
+  size_t GetChunkCount() const override { return chunk_count_; }
+
+  std::optional<std::vector<FrameType>> GetChunkData(size_t index) override {
+    std::vector<FrameType> frames(1);
+    if (pread(fileno(file_), frames.data(), sizeof(FrameType),
+              index * sizeof(FrameType)) != sizeof(FrameType)) {
       return std::nullopt;
     }
-    FrameType frame{};
-    frame.version = 42;
-    return std::vector<FrameType>{frame};
+    return frames;
+  }
+
+  std::optional<StoredChunk> GetStoredChunk(size_t index) const override {
+    return StoredChunk{.file = FileDescriptorCache::Lease(fileno(file_)),
+                       .offset = static_cast<off_t>(index * sizeof(FrameType)),
+                       .size = sizeof(FrameType)};
+  }
+
+  std::optional<std::vector<FrameType>> DecodeStoredChunk(
+      size_t, std::string_view stored) override {
+    std::vector<FrameType> frames(1);
+    if (stored.size() != sizeof(FrameType)) return std::nullopt;
+    std::memcpy(frames.data(), stored.data(), sizeof(FrameType));
+    ++decoded_stored_chunks;
+    return frames;
   }
 
+  static inline std::atomic<int> decoded_stored_chunks{0};
+
  private:
   std::string sort_key_;
+  size_t chunk_count_;
+  FILE* file_;
 };
 
 class ShufflingChunkPoolTest : public ::testing::Test {
@@ -339,6 +429,29 @@ TEST_F(ShufflingChunkPoolTest, OutputWorkerProducesChunks) {
   EXPECT_EQ(chunk.use_count, 0u);
 }
 
+TEST_F(ShufflingChunkPoolTest, LoadsChunksConcurrently) {
+  ChunkSourceWithPhase slow_source;
+  slow_source.source = std::make_unique<SlowChunkSource>("slow_source", 100);
+  slow_source.message_type = FilePathProvider::MessageType::kFile;
+  input_producer_->Put(std::move(slow_source));
+  MarkInitialScanComplete();
+
+  auto config = MakeConfig(100, /*source_ingestion_threads=*/1,
+                           /*loading_threads=*/4, /*queue_capacity=*/100);
+  config.set_chunk_claim_batch_size(2);
+  ShufflingChunkPool shuffling_chunk_pool(config);
+  shuffling_chunk_pool.SetInputs({input_queue_.get()});
+  shuffling_chunk_pool.Start();
+  CloseInputQueue();
+
+  auto* output_queue = shuffling_chunk_pool.output_queue();
+  for (int i = 0; i < 20; ++i) {
+    EXPECT_EQ(output_queue->Get().frames.size(), 1u);
+  }
+  // Reads are not serialized behind the pool lock.
+  EXPECT_GT(SlowChunkSource::max_in_flight.load(), 1);
+}
+
 TEST_F(ShufflingChunkPoolTest, DropsInvalidChunks) {
   ChunkSourceWithPhase invalid_source;
   invalid_source.source =
@@ -369,9 +482,18 @@ TEST_F(ShufflingChunkPoolTest, DropsInvalidChunks) {
   EXPECT_EQ(chunk.frames.front().version, 42);
 
   uint64_t dropped_latest = 0;
+  uint64_t failed_decodes = 0;
+  auto count_failed_decodes = [&](const StageMetricProto& metrics) {
+    for (const auto& metric : metrics.count_metrics()) {
+      if (metric.name() == "source_failed_decodes") {
+        failed_decodes += metric.count();
+      }
+    }
+  };
   bool found_dropped = false;
   for (int attempt = 0; attempt < 50 && !found_dropped; ++attempt) {
     auto metrics = shuffling_chunk_pool.FlushMetrics();
+    count_failed_decodes(metrics);
     for (const auto& metric : metrics.count_metrics()) {
       if (metric.name() == "dropped" && metric.count() > 0) {
         dropped_latest = metric.count();
@@ -385,6 +507,10 @@ TEST_F(ShufflingChunkPoolTest, DropsInvalidChunks) {
   }
   ASSERT_TRUE(found_dropped) << "dropped chunk metrics should be reported";
   EXPECT_GE(dropped_latest, 1u);
+  // The source stats are flushed before the drop count, so the failure may
+  // only show up in the next flush.
+  count_failed_decodes(shuffling_chunk_pool.FlushMetrics());
+  EXPECT_GE(failed_decodes, 1u);
 }
 
 TEST_F(ShufflingChunkPoolTest, NewChunkSourceProcessing) {
@@ -442,6 +568,275 @@ TEST_F(ShufflingChunkPoolTest, ChunkWindowManagement) {
   });
 }
 
+TEST_F(ShufflingChunkPoolTest, EvictsSourcesWhileSampling) {
+  AddMockChunkSourceToQueue("source_100", 30);
+  MarkInitialScanComplete();
+
+  ShufflingChunkPool shuffling_chunk_pool(MakeConfig(50));
+  shuffling_chunk_pool.SetInputs({input_queue_.get()});
+  shuffling_chunk_pool.Start();
+  auto* output_queue = shuffling_chunk_pool.output_queue();
+
+  // Sources arrive while the output workers keep sampling the window.
+  for (int i = 1; i <= 20; ++i) {
+    AddMockChunkSourceToQueue("source_" + std::to_string(100 + i), 10,
+                              FilePathProvider::MessageType::kFile);
+    output_queue->Get();
+  }
+
+  uint64_t sources = 0;
+  uint64_t current = 0;
+  uint64_t total = 0;
+  for (int attempt = 0; attempt < 200 && total < 230; ++attempt) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    const auto metrics = shuffling_chunk_pool.FlushMetrics();
+    for (const auto& metric : metrics.gauge_metrics()) {
+      if (metric.name() == "chunk_sources") sources = metric.value();
+      if (metric.name() == "chunks_current") current = metric.value();
+      if (metric.name() == "chunks_total") total = metric.value();
+    }
+  }
+  EXPECT_EQ(total, 230u);
+  // The window keeps the newest sources that cover chunk_pool_size.
+  EXPECT_EQ(sources, 5u);
+  EXPECT_EQ(current, 50u);
+  for (int i = 0; i < 100; ++i) output_queue->Get();
+
+  CloseInputQueue();
+}
+
+TEST_F(ShufflingChunkPoolTest, StartupIndexingStopsOnceWindowIsCovered) {
+  for (int i = 0; i < 10; ++i) {
+    AddMockChunkSourceToQueue("source_" + std::to_string(i), 10);
+  }
+  MarkInitialScanComplete();
+
+  auto config = MakeConfig(25);
+  config.set_startup_indexing_threads(3);
+  ShufflingChunkPool shuffling_chunk_pool(config);
+  shuffling_chunk_pool.SetInputs({input_queue_.get()});
+  shuffling_chunk_pool.Start();
+  shuffling_chunk_pool.output_queue()->WaitForSizeAtLeast(1);
+
+  uint64_t candidates = 0;
+  uint64_t indexed_sources = 0;
+  uint64_t indexed_chunks = 0;
+  uint64_t total_chunks = 0;
+  const auto metrics = shuffling_chunk_pool.FlushMetrics();
+  for (const auto& metric : metrics.gauge_metrics()) {
+    if (metric.name() == "startup_candidate_sources") {
+      candidates = metric.value();
+    } else if (metric.name() == "startup_indexed_sources") {
+      indexed_sources = metric.value();
+    } else if (metric.name() == "startup_indexed_chunks") {
+      indexed_chunks = metric.value();
+    } else if (metric.name() == "chunks_total") {
+      total_chunks = metric.value();
+    }
+  }
+  EXPECT_EQ(candidates, 10u);
+  EXPECT_EQ(indexed_sources, 3u);
+  EXPECT_EQ(indexed_chunks, 30u);
+  EXPECT_EQ(total_chunks, 30u);
+
+  CloseInputQueue();
+}
+
+TEST_F(ShufflingChunkPoolTest, DecodedChunkCacheServesRepeatedChunks) {
+  AddMockChunkSourceToQueue("source", 5);
+  MarkInitialScanComplete();
+
+  auto config = MakeConfig(5);
+  config.set_decoded_chunk_cache_bytes(1 << 20);
+  ShufflingChunkPool shuffling_chunk_pool(config);
+  shuffling_chunk_pool.SetInputs({input_queue_.get()});
+  shuffling_chunk_pool.Start();
+
+  auto* output_queue = shuffling_chunk_pool.output_queue();
+  for (int i = 0; i < 20; ++i) {
+    const auto chunk = output_queue->Get();
+    ASSERT_EQ(chunk.frames.size(), 1);
+    EXPECT_EQ(chunk.frames[0].version, chunk.index_within_sort_key);
+  }
+
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t cached_chunks = 0;
+  const auto metrics = shuffling_chunk_pool.FlushMetrics();
+  for (const auto& metric : metrics.count_metrics()) {
+    if (metric.name() == "decoded_cache_hits") hits = metric.count();
+    if (metric.name() == "decoded_cache_misses") misses = metric.count();
+  }
+  for (const auto& metric : metrics.gauge_metrics()) {
+    if (metric.name() == "decoded_cache_chunks") cached_chunks = metric.value();
+  }
+  EXPECT_EQ(misses, 5u);
+  EXPECT_GE(hits, 15u);
+  EXPECT_EQ(cached_chunks, 5u);
+
+  CloseInputQueue();
+}
+
+TEST_F(ShufflingChunkPoolTest, EvictionDropsDecodedChunksOfSource) {
+  AddMockChunkSourceToQueue("source_a", 5);
+  MarkInitialScanComplete();
+
+  auto config = MakeConfig(5);
+  config.set_decoded_chunk_cache_bytes(1 << 20);
+  ShufflingChunkPool shuffling_chunk_pool(config);
+  shuffling_chunk_pool.SetInputs({input_queue_.get()});
+  shuffling_chunk_pool.Start();
+
+  auto* output_queue = shuffling_chunk_pool.output_queue();
+  for (int i = 0; i < 10; ++i) output_queue->Get();
+
+  // The new source evicts source_a. Once only source_b is output, no chunk
+  // of source_a is being decoded any more.
+  AddMockChunkSourceToQueue("source_b", 5);
+  int source_b_in_a_row = 0;
+  while (source_b_in_a_row < 10) {
+    const auto chunk = output_queue->Get();
+    source_b_in_a_row =
+        chunk.sort_key == "source_b" ? source_b_in_a_row + 1 : 0;
+  }
+
+  uint64_t cached_chunks = 0;
+  const auto metrics = shuffling_chunk_pool.FlushMetrics();
+  for (const auto& metric : metrics.gauge_metrics()) {
+    if (metric.name() == "decoded_cache_chunks") cached_chunks = metric.value();
+  }
+  EXPECT_EQ(cached_chunks, 5u);
+
+  CloseInputQueue();
+}
+
+TEST_F(ShufflingChunkPoolTest, ResidentWindowLoadsKeptSources) {
+  AddMockChunkSourceToQueue("source_a", 10);
+  AddMockChunkSourceToQueue("source_b", 10);
+  AddMockChunkSourceToQueue("source_c", 10);
+  MarkInitialScanComplete();
+
+  auto config = MakeConfig(15);
+  config.set_resident_window(true);
+  ShufflingChunkPool shuffling_chunk_pool(config);
+  shuffling_chunk_pool.SetInputs({input_queue_.get()});
+  shuffling_chunk_pool.Start();
+  shuffling_chunk_pool.output_queue()->Get();
+
+  // Only the two newest sources are needed for the window.
+  uint64_t resident_bytes = 0;
+  const auto metrics = shuffling_chunk_pool.FlushMetrics();
+  for (const auto& metric : metrics.gauge_metrics()) {
+    if (metric.name() == "resident_bytes") resident_bytes = metric.value();
+  }
+  EXPECT_EQ(resident_bytes, 2000u);
+
+  CloseInputQueue();
+}
+
+TEST_F(ShufflingChunkPoolTest, LookaheadReadsChunksAsynchronously) {
+  for (const char* sort_key : {"source_a", "source_b"}) {
+    ChunkSourceWithPhase item;
+    item.source = std::make_unique<FileBackedChunkSource>(sort_key, 8);
+    item.message_type = FilePathProvider::MessageType::kFile;
+    input_producer_->Put(std::move(item));
+  }
+  MarkInitialScanComplete();
+  FileBackedChunkSource::decoded_stored_chunks = 0;
+
+  auto config = MakeConfig(16, 1, 2);
+  config.set_io_lookahead_depth(4);
+  ShufflingChunkPool shuffling_chunk_pool(config);
+  shuffling_chunk_pool.SetInputs({input_queue_.get()});
+  shuffling_chunk_pool.Start();
+
+  // Every chunk of the window is output exactly once per pass.
+  std::multiset<std::pair<std::string, size_t>> seen;
+  auto* output_queue = shuffling_chunk_pool.output_queue();
+  for (int i = 0; i < 32; ++i) {
+    const auto chunk = output_queue->Get();
+    ASSERT_EQ(chunk.frames.size(), 1);
+    EXPECT_EQ(chunk.frames[0].version, chunk.index_within_sort_key);
+    seen.emplace(chunk.sort_key, chunk.index_within_sort_key);
+  }
+  for (const auto& key : seen) EXPECT_EQ(seen.count(key), 2u);
+  EXPECT_GE(FileBackedChunkSource::decoded_stored_chunks.load(), 32);
+
+  bool has_in_flight_metric = false;
+  const auto metrics = shuffling_chunk_pool.FlushMetrics();
+  for (const auto& metric : metrics.gauge_metrics()) {
+    if (metric.name() == "lookahead_in_flight") {
+      has_in_flight_metric = true;
+      EXPECT_EQ(metric.capacity(), 4u);
+    }
+  }
+  EXPECT_TRUE(has_in_flight_metric);
+
+  CloseInputQueue();
+}
+
+TEST_F(ShufflingChunkPoolTest, LookaheadCountsDecodedCacheMisses) {
+  ChunkSourceWithPhase item;
+  item.source = std::make_unique<FileBackedChunkSource>("source", 5);
+  item.message_type = FilePathProvider::MessageType::kFile;
+  input_producer_->Put(std::move(item));
+  MarkInitialScanComplete();
+
+  auto config = MakeConfig(5, 1, 2);
+  config.set_io_lookahead_depth(4);
+  config.set_decoded_chunk_cache_bytes(1 << 20);
+  ShufflingChunkPool shuffling_chunk_pool(config);
+  shuffling_chunk_pool.SetInputs({input_queue_.get()});
+  shuffling_chunk_pool.Start();
+
+  auto* output_queue = shuffling_chunk_pool.output_queue();
+  for (int i = 0; i < 20; ++i) output_queue->Get();
+
+  // Chunks decoded by the lookahead path are misses too.
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  const auto metrics = shuffling_chunk_pool.FlushMetrics();
+  for (const auto& metric : metrics.count_metrics()) {
+    if (metric.name() == "decoded_cache_hits") hits = metric.count();
+    if (metric.name() == "decoded_cache_misses") misses = metric.count();
+  }
+  EXPECT_GE(misses, 5u);
+  EXPECT_GE(hits + misses, 20u);
+
+  CloseInputQueue();
+}
+
+TEST_F(ShufflingChunkPoolTest, BlockShufflingReadsBlocksInFileOrder) {
+  AddMockChunkSourceToQueue("source_a", 7);
+  AddMockChunkSourceToQueue("source_b", 7);
+  MarkInitialScanComplete();
+
+  auto config = MakeConfig(14, 1, 1);
+  config.set_shuffle_block_size(4);
+  config.set_shuffle_open_blocks(1);
+  ShufflingChunkPool shuffling_chunk_pool(config);
+  shuffling_chunk_pool.SetInputs({input_queue_.get()});
+  shuffling_chunk_pool.Start();
+
+  // With one open block, each block of a source is output in one run:
+  // chunks 0-3 and 4-6 of each source.
+  std::set<std::pair<std::string, size_t>> seen;
+  std::pair<std::string, size_t> previous;
+  auto* output_queue = shuffling_chunk_pool.output_queue();
+  for (int i = 0; i < 14; ++i) {
+    const auto chunk = output_queue->Get();
+    const auto current =
+        std::make_pair(chunk.sort_key, chunk.index_within_sort_key);
+    if (current.second != 0 && current.second != 4) {
+      EXPECT_EQ(previous, std::make_pair(current.first, current.second - 1));
+    }
+    EXPECT_TRUE(seen.insert(current).second);
+    previous = current;
+  }
+
+  CloseInputQueue();
+}
+
 // Test the ShufflingChunkPoolConfig structure
 TEST_F(ShufflingChunkPoolTest, ChunkSorting) {
   // Add chunk sources in non-sorted order (by sort key)
@@ -527,6 +922,45 @@ TEST_F(ShufflingChunkPoolTest, StreamShufflerResetWhenExhausted) {
       << "Expect at least one chunk to report a reuse count";
 }
 
+TEST_F(ShufflingChunkPoolTest, PreparedReshufflesCoverTheWindow) {
+  AddMockChunkSourceToQueue("source1", 15);
+  AddMockChunkSourceToQueue("source2", 25);
+  MarkInitialScanComplete();
+
+  ShufflingChunkPool shuffling_chunk_pool(MakeConfig(40));
+  shuffling_chunk_pool.SetInputs({input_queue_.get()});
+  shuffling_chunk_pool.Start();
+  auto* output_queue = shuffling_chunk_pool.output_queue();
+
+  // Every epoch draws each chunk of the window once, whether its shuffler was
+  // prepared in the background or not.
+  for (int epoch = 0; epoch < 6; ++epoch) {
+    std::set<std::pair<std::string, size_t>> chunks;
+    for (int i = 0; i < 40; ++i) {
+      auto chunk = output_queue->Get();
+      EXPECT_TRUE(chunks.emplace(chunk.sort_key, chunk.index_within_sort_key)
+                      .second)
+          << "epoch " << epoch;
+    }
+  }
+
+  uint64_t reshuffles = 0;
+  int64_t latency_samples = 0;
+  const auto metrics = shuffling_chunk_pool.FlushMetrics();
+  for (const auto& metric : metrics.count_metrics()) {
+    if (metric.name() == "reshuffles") reshuffles = metric.count();
+  }
+  for (const auto& metric : metrics.statistics_metrics()) {
+    if (metric.name() == "reshuffle_latency_ms") {
+      latency_samples = metric.count();
+    }
+  }
+  EXPECT_GE(reshuffles, 5u);
+  EXPECT_EQ(latency_samples, static_cast<int64_t>(reshuffles));
+
+  CloseInputQueue();
+}
+
 TEST_F(ShufflingChunkPoolTest, HanseMetrics_NoRejection_CacheAndReshuffles) {
   // Single chunk so we will continually reuse the same chunk.
   AddMockChunkSourceToQueue("source1", 1);
@@ -557,8 +991,10 @@ TEST_F(ShufflingChunkPoolTest, HanseMetrics_NoRejection_CacheAndReshuffles) {
   // Flush metrics and validate Hanse counters and reshuffles.
   auto metrics = pool.FlushMetrics();
   uint64_t cache_hits = 0, cache_misses = 0, rejected = 0, reshuffles = 0;
+  uint64_t peeked = 0;
   for (const auto& m : metrics.count_metrics()) {
     if (m.name() == "hanse_cache_hits") cache_hits = m.count();
+    if (m.name() == "hanse_frame_counts_peeked") peeked = m.count();
     if (m.name() == "hanse_cache_misses") cache_misses = m.count();
     if (m.name() == "hanse_rejected") rejected = m.count();
     if (m.name() == "reshuffles") reshuffles = m.count();
@@ -566,6 +1002,8 @@ TEST_F(ShufflingChunkPoolTest, HanseMetrics_NoRejection_CacheAndReshuffles) {
 
   // First access computes and caches num_records => 1 miss, then hits.
   EXPECT_EQ(cache_misses, 1u);
+  // The weight came from the frame count, without decoding the chunk.
+  EXPECT_EQ(peeked, 1u);
   EXPECT_GE(cache_hits, 1u);
   // With threshold=1 and one frame, p = 1 => no rejections.
   EXPECT_EQ(rejected, 0u);
@@ -65,6 +65,7 @@ void SimpleChunkExtractor::ProcessSource(
       ++chunks_processed_;
     }
   }
+  io_counters_.Add(source->FlushIoStats());
   ++sources_processed_;
 }
 
@@ -97,6 +98,7 @@ StageMetricProto SimpleChunkExtractor::FlushMetrics() {
   add_count("chunks_processed", chunks_processed_);
   add_count("chunks_dropped", chunks_dropped_);
   add_count("sources_processed", sources_processed_);
+  AddIoStatsMetrics(metric, io_counters_.Flush());
 
   *metric.add_queue_metrics() = MetricsFromQueue("output", *output_queue());
   return metric;
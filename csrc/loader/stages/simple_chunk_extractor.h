@@ -44,6 +44,8 @@ class SimpleChunkExtractor
   std::atomic<uint64_t> chunks_processed_{0};
   std::atomic<uint64_t> chunks_dropped_{0};
   std::atomic<uint64_t> sources_processed_{0};
+  // Of the processed sources.
+  ChunkSourceIoCounters io_counters_;
   absl::BitGen bitgen_;
   ThreadPool thread_pool_{1};
 };
@@ -0,0 +1,149 @@
+// Measures chunk decompression throughput of the gzip decode paths in
+// utils/gz.h against the original streaming implementation.
+
+#include <absl/flags/flag.h>
+#include <absl/flags/parse.h>
+#include <absl/log/globals.h>
+#include <absl/log/initialize.h>
+#include <absl/log/log.h>
+#include <absl/strings/str_format.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "loader/chunk_source/tar_chunk_source.h"
+#include "utils/gz.h"
+
+ABSL_FLAG(std::string, input, "",
+          "A .tar file with gzipped chunks, or a single .gz chunk file.");
+ABSL_FLAG(int64_t, max_chunks, 10000, "Maximum number of chunks to load.");
+ABSL_FLAG(int64_t, iterations, 5, "Number of passes over all chunks.");
+
+namespace lczero {
+namespace training {
+namespace {
+
+namespace fs = std::filesystem;
+
+// The decoder before the ISIZE/reused-state rewrite: fresh z_stream for every
+// buffer, 16 KB bounce buffer, growing output string.
+std::string LegacyGunzipBuffer(std::string_view buffer) {
+  z_stream strm = {};
+  int ret = inflateInit2(&strm, 16 + MAX_WBITS);
+  if (ret != Z_OK) throw GunzipError("Failed to initialize zlib inflate");
+  strm.avail_in = buffer.size();
+  strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(buffer.data()));
+  constexpr size_t kChunkSize = 16384;
+  std::string output;
+  std::array<char, kChunkSize> temp_buffer;
+  do {
+    strm.avail_out = kChunkSize;
+    strm.next_out = reinterpret_cast<Bytef*>(temp_buffer.data());
+    ret = inflate(&strm, Z_NO_FLUSH);
+    if (ret == Z_STREAM_ERROR || ret == Z_NEED_DICT || ret == Z_DATA_ERROR ||
+        ret == Z_MEM_ERROR) {
+      inflateEnd(&strm);
+      throw GunzipError("zlib inflate error");
+    }
+    output.append(temp_buffer.begin(),
+                  temp_buffer.begin() + (kChunkSize - strm.avail_out));
+  } while (strm.avail_out == 0);
+  inflateEnd(&strm);
+  if (ret != Z_STREAM_END) throw GunzipError("Incomplete gzip decompression");
+  return output;
+}
+
+std::vector<std::string> LoadChunks(const fs::path& path, size_t max_chunks) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) LOG(FATAL) << "Failed to open " << path;
+  const std::string contents((std::istreambuf_iterator<char>(file)),
+                             std::istreambuf_iterator<char>());
+  if (path.extension() != ".tar") return {contents};
+
+  std::vector<std::string> chunks;
+  TarChunkSource source(path, ChunkSourceLoaderConfig::V6TrainingData);
+  for (const auto& entry : source.files()) {
+    if (chunks.size() >= max_chunks) break;
+    if (!entry.is_gzip) continue;
+    chunks.push_back(contents.substr(entry.offset, entry.size));
+  }
+  return chunks;
+}
+
+void Run(std::string_view name, const std::vector<std::string>& chunks,
+         int64_t iterations,
+         const std::function<size_t(std::string_view)>& decode) {
+  size_t bytes = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int64_t i = 0; i < iterations; ++i) {
+    for (const auto& chunk : chunks) bytes += decode(chunk);
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  const double decoded_chunks = static_cast<double>(chunks.size()) * iterations;
+  std::cout << absl::StrFormat("%-28s %10.1f MB/s %10.2f us/chunk\n", name,
+                               bytes / elapsed.count() / 1e6,
+                               elapsed.count() * 1e6 / decoded_chunks);
+}
+
+void RunBenchmark(const fs::path& path, size_t max_chunks,
+                  int64_t iterations) {
+  const auto chunks = LoadChunks(path, max_chunks);
+  if (chunks.empty()) LOG(FATAL) << "No gzipped chunks found in " << path;
+  size_t compressed = 0;
+  size_t max_size = 0;
+  for (const auto& chunk : chunks) {
+    compressed += chunk.size();
+    max_size = std::max<size_t>(max_size, *GzipUncompressedSize(chunk));
+  }
+  std::cout << absl::StrFormat(
+      "%zu chunks, %.1f KB compressed on average, %lld iteration(s)\n",
+      chunks.size(), compressed / 1e3 / chunks.size(),
+      static_cast<long long>(iterations));
+
+  Run("legacy GunzipBuffer", chunks, iterations,
+      [](std::string_view chunk) { return LegacyGunzipBuffer(chunk).size(); });
+
+  std::vector<const InflateBackend*> backends = {&ZlibInflateBackend()};
+  if (&DefaultInflateBackend() != &ZlibInflateBackend()) {
+    backends.push_back(&DefaultInflateBackend());
+  }
+  std::string output(max_size, '\0');
+  for (const auto* backend : backends) {
+    Run(absl::StrFormat("GunzipBuffer (%s)", backend->name()), chunks,
+        iterations, [backend](std::string_view chunk) {
+          return GunzipBuffer(chunk, *backend).size();
+        });
+    Run(absl::StrFormat("GunzipInto (%s)", backend->name()), chunks,
+        iterations, [backend, &output](std::string_view chunk) {
+          return GunzipInto(chunk, output, *backend);
+        });
+  }
+}
+
+}  // namespace
+}  // namespace training
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  absl::InitializeLog();
+  absl::SetStderrThreshold(absl::LogSeverityAtLeast::kWarning);
+
+  const std::string input = absl::GetFlag(FLAGS_input);
+  if (input.empty()) LOG(FATAL) << "--input flag is required.";
+  lczero::training::RunBenchmark(input, absl::GetFlag(FLAGS_max_chunks),
+                                 absl::GetFlag(FLAGS_iterations));
+  return 0;
+}
@@ -0,0 +1,120 @@
+// Converts .tar archives of gzipped chunks into the loader-native .lczpack
+// format (see loader/chunk_source/packed_chunk_format.h).
+
+#include <absl/flags/flag.h>
+#include <absl/flags/parse.h>
+#include <absl/log/globals.h>
+#include <absl/log/initialize.h>
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "loader/chunk_source/packed_chunk_format.h"
+#include "loader/chunk_source/tar_chunk_source.h"
+#include "proto/data_loader_config.pb.h"
+
+ABSL_FLAG(std::string, input, "",
+          "A .tar file, or a directory whose .tar files are converted.");
+ABSL_FLAG(std::string, output_dir, ".",
+          "Directory where the .lczpack files are written.");
+ABSL_FLAG(std::string, frame_format, "V6TrainingData",
+          "Frame format of the input chunks (V6TrainingData or "
+          "V7TrainingData).");
+ABSL_FLAG(int32_t, gzip_level, 1,
+          "zlib level of the stored chunks, or 0 to store them uncompressed "
+          "(several times larger, but served without decompression).");
+
+namespace lczero {
+namespace training {
+namespace {
+
+namespace fs = std::filesystem;
+
+std::vector<fs::path> CollectInputs(const fs::path& input) {
+  if (!fs::is_directory(input)) return {input};
+  std::vector<fs::path> files;
+  for (const auto& entry : fs::directory_iterator(input)) {
+    if (entry.is_regular_file() && entry.path().extension() == ".tar") {
+      files.push_back(entry.path());
+    }
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+// Writes into a temporary file and renames it when done, so that a loader
+// watching the output directory never sees a partial archive.
+void ConvertTar(const fs::path& tar_path, const fs::path& output_dir,
+                ChunkSourceLoaderConfig::FrameFormat frame_format,
+                int gzip_level) {
+  TarChunkSource source(tar_path, frame_format);
+  const fs::path output_path =
+      output_dir / tar_path.filename().replace_extension(".lczpack");
+  const fs::path temp_path = fs::path(output_path).concat(".tmp");
+
+  PackedChunkWriter writer(temp_path, gzip_level);
+  size_t skipped = 0;
+  for (size_t i = 0; i < source.GetChunkCount(); ++i) {
+    const auto frames = source.GetChunkData(i);
+    if (!frames) {
+      ++skipped;
+      continue;
+    }
+    writer.AddChunk(*frames);
+  }
+  writer.Finish();
+  fs::rename(temp_path, output_path);
+  if (skipped) {
+    LOG(WARNING) << "Skipped " << skipped << " undecodable chunk(s) of "
+                 << tar_path.string();
+  }
+  LOG(INFO) << "Wrote " << output_path.string() << ": "
+            << source.GetChunkCount() - skipped << " chunk(s), "
+            << writer.bytes_written() << " bytes.";
+}
+
+}  // namespace
+}  // namespace training
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  using lczero::training::ChunkSourceLoaderConfig;
+  namespace fs = std::filesystem;
+
+  absl::ParseCommandLine(argc, argv);
+  absl::InitializeLog();
+  absl::SetStderrThreshold(absl::LogSeverityAtLeast::kInfo);
+
+  const std::string input = absl::GetFlag(FLAGS_input);
+  if (input.empty()) LOG(FATAL) << "--input flag is required.";
+  ChunkSourceLoaderConfig::FrameFormat frame_format;
+  if (!ChunkSourceLoaderConfig::FrameFormat_Parse(
+          absl::GetFlag(FLAGS_frame_format), &frame_format)) {
+    LOG(FATAL) << "Unknown --frame_format: "
+               << absl::GetFlag(FLAGS_frame_format);
+  }
+  const int gzip_level = absl::GetFlag(FLAGS_gzip_level);
+  if (gzip_level < 0 || gzip_level > 9) {
+    LOG(FATAL) << "--gzip_level must be between 0 and 9.";
+  }
+
+  const fs::path output_dir(absl::GetFlag(FLAGS_output_dir));
+  fs::create_directories(output_dir);
+
+  int failures = 0;
+  for (const auto& tar_path : lczero::training::CollectInputs(input)) {
+    try {
+      lczero::training::ConvertTar(tar_path, output_dir, frame_format,
+                                   gzip_level);
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "Failed to convert " << tar_path.string() << ": "
+                 << e.what();
+      ++failures;
+    }
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,195 @@
+// Measures StreamShuffler draws over large windows against the original
+// implementation, which walked the buckets linearly to find a drawn item.
+
+#include <absl/container/fixed_array.h>
+#include <absl/flags/flag.h>
+#include <absl/flags/parse.h>
+#include <absl/log/globals.h>
+#include <absl/log/initialize.h>
+#include <absl/log/log.h>
+#include <absl/random/random.h>
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_format.h>
+#include <absl/strings/str_split.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "utils/stream_shuffler.h"
+
+ABSL_FLAG(std::string, sizes, "1000000,10000000,100000000",
+          "Comma-separated window sizes, in items.");
+ABSL_FLAG(int64_t, draws, 2000000, "Number of draws per window size.");
+ABSL_FLAG(int64_t, slide_every, 1000,
+          "The window slides by this many items every this many draws.");
+ABSL_FLAG(int64_t, bucket_size, 524288, "Bucket size of both shufflers.");
+
+namespace lczero {
+namespace training {
+namespace {
+
+// StreamShuffler before the bucket index: size_t items, and a linear walk
+// over the buckets for every draw. Item mode only.
+class LegacyStreamShuffler {
+ public:
+  void SetBucketSize(size_t bucket_size) { bucket_size_ = bucket_size; }
+
+  void SetUpperBound(size_t upper_bound) {
+    stream_size_ += upper_bound - upper_bound_;
+    while (upper_bound_ < upper_bound) {
+      if (buckets_.empty() || buckets_.back().GetRemainingCapacity() == 0) {
+        buckets_.emplace_back(upper_bound_, bucket_size_);
+      }
+      upper_bound_ = std::min(
+          upper_bound, upper_bound_ + buckets_.back().GetRemainingCapacity());
+      buckets_.back().Extend(upper_bound_);
+    }
+  }
+
+  void SetLowerBound(size_t lower_bound) {
+    lower_bound_ = lower_bound;
+    while (!buckets_.empty() &&
+           buckets_.front().upper_bound() <= lower_bound_) {
+      stream_size_ -= buckets_.front().size();
+      buckets_.pop_front();
+    }
+    if (!buckets_.empty()) {
+      auto old_size = buckets_.front().size();
+      buckets_.front().DeclareLowerBound(lower_bound_);
+      stream_size_ -= old_size - buckets_.front().size();
+    }
+  }
+
+  std::optional<size_t> GetNextItem() {
+    auto try_fetch = [&]() -> size_t {
+      size_t item_idx = absl::Uniform(gen_, size_t{0}, stream_size_);
+      --stream_size_;
+      for (auto& bucket : buckets_) {
+        if (item_idx < bucket.size()) return bucket.Fetch(item_idx);
+        item_idx -= bucket.size();
+      }
+      throw std::logic_error("LegacyStreamShuffler: item index out of bounds");
+    };
+    while (stream_size_ > 0) {
+      if (auto item = try_fetch(); item >= lower_bound_) return item;
+    }
+    return std::nullopt;
+  }
+
+ private:
+  class Bucket {
+   public:
+    Bucket(size_t lower_bound, size_t capacity)
+        : upper_bound_(lower_bound), items_(capacity) {}
+    size_t GetRemainingCapacity() const {
+      return items_.size() - items_count_;
+    }
+    void Extend(size_t new_upper_bound) {
+      const size_t increase = new_upper_bound - upper_bound_;
+      std::iota(items_.begin() + items_count_,
+                items_.begin() + items_count_ + increase, upper_bound_);
+      items_count_ += increase;
+      upper_bound_ = new_upper_bound;
+    }
+    size_t Fetch(size_t item_idx) {
+      size_t item = items_[item_idx];
+      std::swap(items_[item_idx], items_[--items_count_]);
+      return item;
+    }
+    void DeclareLowerBound(size_t new_lower_bound) {
+      if (upper_bound_ - new_lower_bound < 2 * items_count_) return;
+      std::sort(items_.begin(), items_.begin() + items_count_,
+                std::greater<size_t>());
+      auto it = std::upper_bound(items_.begin(), items_.begin() + items_count_,
+                                 new_lower_bound, std::greater<size_t>());
+      items_count_ = it - items_.begin();
+    }
+    size_t upper_bound() const { return upper_bound_; }
+    size_t size() const { return items_count_; }
+
+   private:
+    size_t upper_bound_ = 0;
+    size_t items_count_ = 0;
+    absl::FixedArray<size_t> items_;
+  };
+
+  absl::BitGen gen_;
+  std::deque<Bucket> buckets_;
+  size_t stream_size_ = 0;
+  size_t upper_bound_ = 0;
+  size_t lower_bound_ = 0;
+  size_t bucket_size_ = 524288;
+};
+
+// Fills a window of `size` items, then draws from it while the window slides
+// forward as the pool's does when new chunks arrive.
+template <typename Shuffler>
+void Run(std::string_view name, size_t size, int64_t draws,
+         int64_t slide_every, size_t bucket_size) {
+  const auto fill_start = std::chrono::steady_clock::now();
+  Shuffler shuffler;
+  shuffler.SetBucketSize(bucket_size);
+  shuffler.SetUpperBound(size);
+  const std::chrono::duration<double> fill =
+      std::chrono::steady_clock::now() - fill_start;
+
+  size_t checksum = 0;
+  size_t upper = size;
+  const auto start = std::chrono::steady_clock::now();
+  for (int64_t i = 0; i < draws; ++i) {
+    if (slide_every > 0 && i % slide_every == slide_every - 1) {
+      upper += slide_every;
+      shuffler.SetUpperBound(upper);
+      shuffler.SetLowerBound(upper - size);
+    }
+    const std::optional<size_t> item = shuffler.GetNextItem();
+    if (!item) LOG(FATAL) << name << " ran out of items.";
+    checksum += *item;
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << absl::StrFormat("%-22s %12zu items %10.1f ms fill %9.1f ns/draw"
+                               "  (checksum %zu)\n",
+                               name, size, fill.count() * 1e3,
+                               elapsed.count() * 1e9 / draws, checksum % 1000);
+}
+
+void RunBenchmark(const std::string& sizes, int64_t draws, int64_t slide_every,
+                  size_t bucket_size) {
+  for (absl::string_view size_str : absl::StrSplit(sizes, ',')) {
+    size_t size;
+    if (!absl::SimpleAtoi(size_str, &size) || size == 0) {
+      LOG(FATAL) << "Invalid window size: " << size_str;
+    }
+    Run<LegacyStreamShuffler>("legacy StreamShuffler", size, draws,
+                              slide_every, bucket_size);
+    Run<StreamShuffler>("StreamShuffler", size, draws, slide_every,
+                        bucket_size);
+  }
+}
+
+}  // namespace
+}  // namespace training
+}  // namespace lczero
+
+int main(int argc, char** argv) {
+  absl::ParseCommandLine(argc, argv);
+  absl::InitializeLog();
+  absl::SetStderrThreshold(absl::LogSeverityAtLeast::kWarning);
+
+  lczero::training::RunBenchmark(absl::GetFlag(FLAGS_sizes),
+                                 absl::GetFlag(FLAGS_draws),
+                                 absl::GetFlag(FLAGS_slide_every),
+                                 absl::GetFlag(FLAGS_bucket_size));
+  return 0;
+}
@@ -0,0 +1,317 @@
+#include "utils/async_file_reader.h"
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/log/log.h>
+#include <absl/strings/str_cat.h>
+#include <absl/synchronization/mutex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define LCZERO_HAVE_IO_URING 1
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include "utils/file_io.h"
+#include "utils/thread_pool.h"
+
+namespace lczero {
+namespace training {
+namespace {
+
+#ifdef LCZERO_HAVE_IO_URING
+
+// Minimal io_uring driver on top of the raw syscalls, so that no liburing
+// dependency is needed.
+class IoUringBackend : public AsyncFileReader::Backend {
+ public:
+  // Returns nullptr if io_uring is not available (old kernel, or disabled
+  // e.g. by a seccomp policy).
+  static std::unique_ptr<IoUringBackend> Create(unsigned entries) {
+    io_uring_params params = {};
+    const int fd = static_cast<int>(
+        syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      LOG(INFO) << "io_uring is not available: " << strerror(errno);
+      return nullptr;
+    }
+    if (!SupportsRead(fd)) {
+      LOG(INFO) << "io_uring does not support IORING_OP_READ.";
+      close(fd);
+      return nullptr;
+    }
+    auto backend = std::unique_ptr<IoUringBackend>(new IoUringBackend(fd));
+    if (!backend->Map(params)) return nullptr;
+    return backend;
+  }
+
+  ~IoUringBackend() override {
+    if (sqes_) munmap(sqes_, sqes_size_);
+    if (cq_ring_ && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_) munmap(sq_ring_, sq_ring_size_);
+    close(ring_fd_);
+  }
+
+  std::string_view name() const override { return "io_uring"; }
+
+  void Submit(std::span<const AsyncFileReader::Request> requests) override {
+    for (const auto& request : requests) {
+      auto [it, inserted] = pending_.try_emplace(request.tag, request);
+      assert(inserted);
+      Push(it->second);
+    }
+    SubmitQueued(static_cast<unsigned>(requests.size()));
+  }
+
+  std::vector<AsyncFileReader::Completion> Wait() override {
+    std::vector<AsyncFileReader::Completion> completions;
+    while (completions.empty()) {
+      Enter(0, 1, IORING_ENTER_GETEVENTS);
+      unsigned resubmitted = 0;
+      uint32_t head = *cq_head_;
+      const uint32_t tail =
+          std::atomic_ref<uint32_t>(*cq_tail_).load(std::memory_order_acquire);
+      for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+        auto it = pending_.find(cqe.user_data);
+        assert(it != pending_.end());
+        Pending& pending = it->second;
+        if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+          Push(pending);
+          ++resubmitted;
+          continue;
+        }
+        if (cqe.res > 0) {
+          pending.done += static_cast<size_t>(cqe.res);
+          if (pending.done < pending.request.buffer.size()) {
+            // Short read, continue where it stopped.
+            Push(pending);
+            ++resubmitted;
+            continue;
+          }
+        }
+        completions.push_back({.tag = pending.request.tag, .ok = cqe.res > 0});
+        pending_.erase(it);
+      }
+      std::atomic_ref<uint32_t>(*cq_head_).store(head,
+                                                 std::memory_order_release);
+      if (resubmitted) SubmitQueued(resubmitted);
+    }
+    return completions;
+  }
+
+ private:
+  // Asks the kernel whether it knows IORING_OP_READ. Both the opcode and the
+  // probe were added in Linux 5.6, so older kernels fail the probe itself.
+  static bool SupportsRead(int ring_fd) {
+    constexpr size_t kMaxOps = 256;
+    std::vector<char> buffer(sizeof(io_uring_probe) +
+                             kMaxOps * sizeof(io_uring_probe_op));
+    auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe,
+                kMaxOps) < 0) {
+      return false;
+    }
+    return probe->last_op >= IORING_OP_READ &&
+           (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+  }
+
+  struct Pending {
+    explicit Pending(const AsyncFileReader::Request& request)
+        : request(request) {}
+    AsyncFileReader::Request request;
+    size_t done = 0;
+  };
+
+  explicit IoUringBackend(int ring_fd) : ring_fd_(ring_fd) {}
+
+  bool Map(const io_uring_params& params) {
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = MapRing(sq_ring_size_, IORING_OFF_SQ_RING);
+    if (!sq_ring_) return false;
+    cq_ring_ =
+        single_mmap ? sq_ring_ : MapRing(cq_ring_size_, IORING_OFF_CQ_RING);
+    if (!cq_ring_) return false;
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = MapRing(sqes_size_, IORING_OFF_SQES);
+    if (!sqes) return false;
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_tail_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  void* MapRing(size_t size, off_t offset) {
+    void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+    if (ptr == MAP_FAILED) {
+      LOG(WARNING) << "Failed to map io_uring: " << strerror(errno);
+      return nullptr;
+    }
+    return ptr;
+  }
+
+  // Queues a read of the remaining part of the request. Without SQPOLL the
+  // kernel consumes all queued entries in SubmitQueued(), and the ring has
+  // room for every read in flight, so it never overflows.
+  void Push(const Pending& pending) {
+    const uint32_t tail = *sq_tail_;
+    const uint32_t index = tail & *sq_mask_;
+    io_uring_sqe& sqe = sqes_[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = pending.request.fd;
+    sqe.off = static_cast<uint64_t>(pending.request.offset) + pending.done;
+    sqe.addr = reinterpret_cast<uint64_t>(pending.request.buffer.data() +
+                                          pending.done);
+    sqe.len =
+        static_cast<uint32_t>(pending.request.buffer.size() - pending.done);
+    sqe.user_data = pending.request.tag;
+    sq_array_[index] = index;
+    std::atomic_ref<uint32_t>(*sq_tail_).store(tail + 1,
+                                               std::memory_order_release);
+  }
+
+  // Returns the number of queued entries the kernel consumed.
+  unsigned Enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    while (true) {
+      const long result = syscall(__NR_io_uring_enter, ring_fd_, to_submit,
+                                  min_complete, flags, nullptr, 0);
+      if (result >= 0) return static_cast<unsigned>(result);
+      if (errno == EINTR) continue;
+      throw std::runtime_error(
+          absl::StrCat("io_uring_enter failed: ", strerror(errno)));
+    }
+  }
+
+  // Hands `count` queued entries to the kernel. It may take fewer than asked
+  // in one call (e.g. when short of memory), so the rest is passed again.
+  void SubmitQueued(unsigned count) {
+    while (count > 0) {
+      const unsigned submitted = Enter(count, 0, 0);
+      if (submitted == 0) {
+        throw std::runtime_error("io_uring_enter submitted no entries.");
+      }
+      count -= std::min(submitted, count);
+    }
+  }
+
+  const int ring_fd_;
+  void* sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  void* cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+  uint32_t* sq_tail_ = nullptr;
+  uint32_t* sq_mask_ = nullptr;
+  uint32_t* sq_array_ = nullptr;
+  uint32_t* cq_head_ = nullptr;
+  uint32_t* cq_tail_ = nullptr;
+  uint32_t* cq_mask_ = nullptr;
+  io_uring_cqe* cqes_ = nullptr;
+  absl::flat_hash_map<uint64_t, Pending> pending_;
+};
+
+#endif  // LCZERO_HAVE_IO_URING
+
+// Blocking preads on a thread per queue slot.
+class ThreadPoolBackend : public AsyncFileReader::Backend {
+ public:
+  explicit ThreadPoolBackend(size_t threads) : pool_(threads) {}
+
+  std::string_view name() const override { return "threads"; }
+
+  void Submit(std::span<const AsyncFileReader::Request> requests) override {
+    for (const auto& request : requests) {
+      pool_.Enqueue([this, request]() {
+        const bool ok = PreadFully(request.fd, request.buffer.data(),
+                                   request.buffer.size(), request.offset);
+        absl::MutexLock lock(&mutex_);
+        completions_.push_back({.tag = request.tag, .ok = ok});
+      });
+    }
+  }
+
+  std::vector<AsyncFileReader::Completion> Wait() override {
+    absl::MutexLock lock(&mutex_);
+    mutex_.Await(absl::Condition(
+        +[](std::vector<AsyncFileReader::Completion>* completions) {
+          return !completions->empty();
+        },
+        &completions_));
+    return std::exchange(completions_, {});
+  }
+
+ private:
+  absl::Mutex mutex_;
+  std::vector<AsyncFileReader::Completion> completions_
+      ABSL_GUARDED_BY(mutex_);
+  // Declared last, so that pending reads finish before the rest is destroyed.
+  ThreadPool pool_;
+};
+
+}  // namespace
+
+AsyncFileReader::AsyncFileReader(size_t queue_depth, bool allow_io_uring)
+    : queue_depth_(std::max<size_t>(queue_depth, 1)) {
+#ifdef LCZERO_HAVE_IO_URING
+  if (allow_io_uring) {
+    backend_ = IoUringBackend::Create(static_cast<unsigned>(queue_depth_));
+  }
+#endif
+  if (!backend_) backend_ = std::make_unique<ThreadPoolBackend>(queue_depth_);
+  LOG(INFO) << "AsyncFileReader using " << backend_->name()
+            << " with queue depth " << queue_depth_;
+}
+
+AsyncFileReader::~AsyncFileReader() {
+  // The kernel (or the threads) may still write into the caller's buffers.
+  // A destructor must not throw, so a failing backend is only reported.
+  try {
+    while (in_flight_ > 0) in_flight_ -= backend_->Wait().size();
+  } catch (const std::exception& e) {
+    LOG(ERROR) << "AsyncFileReader gave up waiting for " << in_flight_
+               << " read(s): " << e.what();
+  }
+}
+
+void AsyncFileReader::Submit(std::span<const Request> requests) {
+  if (requests.empty()) return;
+  assert(in_flight_ + requests.size() <= queue_depth_);
+  backend_->Submit(requests);
+  in_flight_ += requests.size();
+}
+
+std::vector<AsyncFileReader::Completion> AsyncFileReader::Wait() {
+  assert(in_flight_ > 0);
+  auto completions = backend_->Wait();
+  in_flight_ -= completions.size();
+  return completions;
+}
+
+}  // namespace training
+}  // namespace lczero
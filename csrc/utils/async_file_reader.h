@@ -0,0 +1,69 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace lczero {
+namespace training {
+
+// Reads byte ranges of files asynchronously, keeping up to `queue_depth` reads
+// in flight. Uses io_uring when the kernel allows it, and a pool of pread
+// threads otherwise. Not thread-safe: one thread submits and reaps.
+class AsyncFileReader {
+ public:
+  struct Request {
+    int fd;
+    off_t offset;
+    // Filled completely, or the read fails.
+    std::span<char> buffer;
+    // Returned in the completion; unique among the reads in flight.
+    uint64_t tag;
+  };
+
+  struct Completion {
+    uint64_t tag;
+    bool ok;
+  };
+
+  class Backend {
+   public:
+    virtual ~Backend() = default;
+    virtual std::string_view name() const = 0;
+    virtual void Submit(std::span<const Request> requests) = 0;
+    // Blocks until at least one read completes, then returns all completed
+    // reads.
+    virtual std::vector<Completion> Wait() = 0;
+  };
+
+  // `allow_io_uring` = false forces the thread backend.
+  explicit AsyncFileReader(size_t queue_depth, bool allow_io_uring = true);
+  ~AsyncFileReader();
+
+  AsyncFileReader(const AsyncFileReader&) = delete;
+  AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+
+  std::string_view backend_name() const { return backend_->name(); }
+  size_t queue_depth() const { return queue_depth_; }
+  size_t in_flight() const { return in_flight_; }
+
+  // Starts the reads. At most queue_depth() - in_flight() requests may be
+  // submitted.
+  void Submit(std::span<const Request> requests);
+  // Blocks until at least one read completes. Must only be called with reads
+  // in flight.
+  std::vector<Completion> Wait();
+
+ private:
+  const size_t queue_depth_;
+  size_t in_flight_ = 0;
+  std::unique_ptr<Backend> backend_;
+};
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,97 @@
+#include "utils/async_file_reader.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace lczero {
+namespace training {
+namespace {
+
+class AsyncFileReaderTest : public ::testing::TestWithParam<bool> {
+ protected:
+  void SetUp() override {
+    path_ = std::filesystem::temp_directory_path() /
+            ("async_file_reader_test_" +
+             std::to_string(
+                 std::chrono::steady_clock::now().time_since_epoch().count()));
+    contents_.resize(1 << 20);
+    for (size_t i = 0; i < contents_.size(); ++i) {
+      contents_[i] = static_cast<char>((i * 31 + i / 4093) % 251);
+    }
+    std::ofstream(path_, std::ios::binary) << contents_;
+    fd_ = open(path_.c_str(), O_RDONLY);
+    ASSERT_GE(fd_, 0);
+  }
+
+  void TearDown() override {
+    close(fd_);
+    std::filesystem::remove(path_);
+  }
+
+  std::filesystem::path path_;
+  std::string contents_;
+  int fd_ = -1;
+};
+
+TEST_P(AsyncFileReaderTest, ReadsRanges) {
+  AsyncFileReader reader(8, GetParam());
+  const std::vector<std::pair<off_t, size_t>> ranges = {
+      {0, 100}, {4096, 65536}, {12345, 1}, {1000000, 48576}, {77, 300000}};
+  std::vector<std::string> buffers;
+  std::vector<AsyncFileReader::Request> requests;
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    buffers.emplace_back(ranges[i].second, '\0');
+  }
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    requests.push_back({.fd = fd_,
+                        .offset = ranges[i].first,
+                        .buffer = buffers[i],
+                        .tag = 100 + i});
+  }
+  reader.Submit(requests);
+  EXPECT_EQ(reader.in_flight(), ranges.size());
+
+  std::vector<bool> done(ranges.size(), false);
+  while (reader.in_flight() > 0) {
+    for (const auto& completion : reader.Wait()) {
+      ASSERT_GE(completion.tag, 100u);
+      const size_t i = completion.tag - 100;
+      ASSERT_LT(i, ranges.size());
+      EXPECT_TRUE(completion.ok);
+      EXPECT_FALSE(done[i]);
+      done[i] = true;
+      EXPECT_EQ(buffers[i],
+                contents_.substr(ranges[i].first, ranges[i].second));
+    }
+  }
+  for (bool d : done) EXPECT_TRUE(d);
+}
+
+TEST_P(AsyncFileReaderTest, FailsPastEndOfFile) {
+  AsyncFileReader reader(2, GetParam());
+  std::string buffer(200, '\0');
+  const AsyncFileReader::Request request = {
+      .fd = fd_,
+      .offset = static_cast<off_t>(contents_.size() - 100),
+      .buffer = buffer,
+      .tag = 7};
+  reader.Submit({&request, 1});
+  const auto completions = reader.Wait();
+  ASSERT_EQ(completions.size(), 1u);
+  EXPECT_EQ(completions[0].tag, 7u);
+  EXPECT_FALSE(completions[0].ok);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, AsyncFileReaderTest,
+                         ::testing::Values(true, false));
+
+}  // namespace
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,197 @@
+#include "utils/fd_cache.h"
+
+#include <absl/log/log.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include "utils/file_io.h"
+
+namespace lczero {
+namespace training {
+
+FileDescriptorCache::Lease::Lease(Lease&& other) noexcept
+    : cache_(std::exchange(other.cache_, nullptr)),
+      id_(other.id_),
+      fd_(std::exchange(other.fd_, -1)) {}
+
+FileDescriptorCache::Lease& FileDescriptorCache::Lease::operator=(
+    Lease&& other) noexcept {
+  if (this != &other) {
+    Reset();
+    cache_ = std::exchange(other.cache_, nullptr);
+    id_ = other.id_;
+    fd_ = std::exchange(other.fd_, -1);
+  }
+  return *this;
+}
+
+void FileDescriptorCache::Lease::Reset() {
+  if (cache_) cache_->Release(id_);
+  cache_ = nullptr;
+  fd_ = -1;
+}
+
+FileDescriptorCache& FileDescriptorCache::Global() {
+  static FileDescriptorCache* cache = new FileDescriptorCache();
+  return *cache;
+}
+
+FileDescriptorCache::~FileDescriptorCache() {
+  for (const auto& [id, entry] : entries_) {
+    if (entry.fd >= 0) close(entry.fd);
+  }
+}
+
+void FileDescriptorCache::SetCapacity(size_t capacity) {
+  absl::MutexLock lock(&mutex_);
+  capacity_ = capacity;
+  EvictIdle();
+}
+
+size_t FileDescriptorCache::capacity() const {
+  absl::MutexLock lock(&mutex_);
+  return capacity_;
+}
+
+size_t FileDescriptorCache::open_count() const {
+  absl::MutexLock lock(&mutex_);
+  return open_count_;
+}
+
+uint64_t FileDescriptorCache::Adopt(
+    const std::filesystem::path& path, int flags, int advice, int fd,
+    const struct stat& st, std::shared_ptr<FileReadCounters> counters) {
+  absl::MutexLock lock(&mutex_);
+  const uint64_t id = next_id_++;
+  Entry& entry = entries_[id];
+  entry.path = path.string();
+  entry.flags = flags;
+  entry.advice = advice;
+  entry.device = st.st_dev;
+  entry.inode = st.st_ino;
+  entry.counters = std::move(counters);
+  entry.fd = fd;
+  entry.idle_position = idle_.insert(idle_.end(), id);
+  ++open_count_;
+  EvictIdle();
+  return id;
+}
+
+std::optional<FileDescriptorCache::Lease> FileDescriptorCache::Acquire(
+    uint64_t id) {
+  std::string path;
+  int flags;
+  int advice;
+  dev_t device;
+  ino_t inode;
+  std::shared_ptr<FileReadCounters> counters;
+  {
+    absl::MutexLock lock(&mutex_);
+    auto it = entries_.find(id);
+    assert(it != entries_.end());
+    Entry& entry = it->second;
+    if (entry.fd >= 0) return Borrow(id, entry);
+    path = entry.path;
+    flags = entry.flags;
+    advice = entry.advice;
+    device = entry.device;
+    inode = entry.inode;
+    counters = entry.counters;
+  }
+
+  // Opening may block on slow storage, so it's done without the lock.
+  const int fd = open(path.c_str(), flags);
+  if (fd < 0) {
+    LOG(WARNING) << "Failed to reopen " << path << ": " << strerror(errno);
+    return std::nullopt;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_dev != device || st.st_ino != inode) {
+    LOG(WARNING) << "Not reopening " << path << ", it was replaced.";
+    close(fd);
+    return std::nullopt;
+  }
+  if (advice != POSIX_FADV_NORMAL) posix_fadvise(fd, 0, 0, advice);
+  if (counters) {
+    counters->file_opens.fetch_add(1, std::memory_order_relaxed);
+    counters->file_reopens.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  absl::MutexLock lock(&mutex_);
+  Entry& entry = entries_.at(id);
+  if (entry.fd >= 0) {
+    // Another thread reopened it meanwhile.
+    close(fd);
+  } else {
+    entry.fd = fd;
+    ++open_count_;
+  }
+  Lease lease = Borrow(id, entry);
+  EvictIdle();
+  return lease;
+}
+
+FileDescriptorCache::Lease FileDescriptorCache::Borrow(uint64_t id,
+                                                       Entry& entry) {
+  if (entry.borrowers++ == 0 && entry.idle_position != idle_.end()) {
+    idle_.erase(entry.idle_position);
+    entry.idle_position = idle_.end();
+  }
+  return Lease(this, id, entry.fd);
+}
+
+void FileDescriptorCache::Release(uint64_t id) {
+  absl::MutexLock lock(&mutex_);
+  auto it = entries_.find(id);
+  assert(it != entries_.end());
+  Entry& entry = it->second;
+  if (--entry.borrowers > 0) return;
+  if (entry.removed) {
+    close(entry.fd);
+    --open_count_;
+    entries_.erase(it);
+    return;
+  }
+  entry.idle_position = idle_.insert(idle_.end(), id);
+  EvictIdle();
+}
+
+void FileDescriptorCache::Remove(uint64_t id) {
+  absl::MutexLock lock(&mutex_);
+  auto it = entries_.find(id);
+  assert(it != entries_.end());
+  Entry& entry = it->second;
+  if (entry.borrowers > 0) {
+    entry.removed = true;
+    return;
+  }
+  if (entry.fd >= 0) {
+    idle_.erase(entry.idle_position);
+    close(entry.fd);
+    --open_count_;
+  }
+  entries_.erase(it);
+}
+
+void FileDescriptorCache::EvictIdle() {
+  if (capacity_ == 0) return;
+  while (open_count_ > capacity_ && !idle_.empty()) {
+    Entry& entry = entries_.at(idle_.front());
+    idle_.pop_front();
+    entry.idle_position = idle_.end();
+    close(entry.fd);
+    entry.fd = -1;
+    --open_count_;
+    if (entry.counters) {
+      entry.counters->file_evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <absl/base/thread_annotations.h>
+#include <absl/container/flat_hash_map.h>
+#include <absl/synchronization/mutex.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace lczero {
+namespace training {
+
+struct FileReadCounters;
+
+// Process-wide LRU of open read-only file descriptors. Files adopted by it
+// (see ReadOnlyFile) don't keep their descriptor for life but borrow it for
+// every read, and the least recently used idle descriptors are closed once
+// more than capacity() are open. A closed descriptor is reopened by the next
+// read, provided the path still refers to the same file. Borrowed descriptors
+// are never closed, so the capacity is exceeded while all of them are in use.
+// A capacity of 0 (the default) disables the cache. Thread-safe.
+class FileDescriptorCache {
+ public:
+  // A borrowed descriptor, open for the lifetime of the lease.
+  class Lease {
+   public:
+    Lease() = default;
+    // A descriptor not managed by the cache, e.g. one owned by the caller.
+    explicit Lease(int fd) : fd_(fd) {}
+    ~Lease() { Reset(); }
+    Lease(Lease&& other) noexcept;
+    Lease& operator=(Lease&& other) noexcept;
+
+    int fd() const { return fd_; }
+
+   private:
+    friend class FileDescriptorCache;
+    Lease(FileDescriptorCache* cache, uint64_t id, int fd)
+        : cache_(cache), id_(id), fd_(fd) {}
+    void Reset();
+
+    FileDescriptorCache* cache_ = nullptr;
+    uint64_t id_ = 0;
+    int fd_ = -1;
+  };
+
+  // The cache shared by all stages.
+  static FileDescriptorCache& Global();
+
+  FileDescriptorCache() = default;
+  ~FileDescriptorCache();
+  FileDescriptorCache(const FileDescriptorCache&) = delete;
+  FileDescriptorCache& operator=(const FileDescriptorCache&) = delete;
+
+  // Only files opened afterwards are affected by enabling the cache; disabling
+  // it keeps the descriptors of adopted files open. Lowering the capacity
+  // closes idle descriptors right away.
+  void SetCapacity(size_t capacity);
+  size_t capacity() const;
+  // Descriptors currently open, borrowed or idle.
+  size_t open_count() const;
+
+  // Takes ownership of `fd`, opened from `path` with `flags` and described by
+  // `st`. `advice` is given to posix_fadvise() again on reopen. Reopens and
+  // evictions are accounted in `counters` if set. Returns the id to borrow the
+  // descriptor with.
+  uint64_t Adopt(const std::filesystem::path& path, int flags, int advice,
+                 int fd, const struct stat& st,
+                 std::shared_ptr<FileReadCounters> counters);
+  // Returns the descriptor of an adopted file, reopening it if it was
+  // evicted. Returns std::nullopt (with a warning) if it can't be reopened or
+  // the path now refers to another file.
+  std::optional<Lease> Acquire(uint64_t id);
+  // Closes the descriptor once it's not borrowed anymore, and forgets it.
+  void Remove(uint64_t id);
+
+ private:
+  struct Entry {
+    std::string path;
+    int flags;
+    int advice;
+    dev_t device;
+    ino_t inode;
+    std::shared_ptr<FileReadCounters> counters;
+    // -1 when evicted.
+    int fd;
+    size_t borrowers = 0;
+    bool removed = false;
+    // Position in idle_, valid while open and not borrowed.
+    std::list<uint64_t>::iterator idle_position;
+  };
+
+  void Release(uint64_t id);
+  // Borrows the open descriptor of `entry`.
+  Lease Borrow(uint64_t id, Entry& entry) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Closes idle descriptors, least recently used first, down to the capacity.
+  void EvictIdle() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  mutable absl::Mutex mutex_;
+  size_t capacity_ ABSL_GUARDED_BY(mutex_) = 0;
+  size_t open_count_ ABSL_GUARDED_BY(mutex_) = 0;
+  uint64_t next_id_ ABSL_GUARDED_BY(mutex_) = 1;
+  absl::flat_hash_map<uint64_t, Entry> entries_ ABSL_GUARDED_BY(mutex_);
+  // Open descriptors that are not borrowed, least recently used first.
+  std::list<uint64_t> idle_ ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,140 @@
+#include "utils/fd_cache.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "utils/file_io.h"
+
+namespace lczero {
+namespace training {
+namespace {
+
+class FileDescriptorCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = std::filesystem::temp_directory_path() /
+           ("fd_cache_test_" +
+            std::to_string(
+                std::chrono::steady_clock::now().time_since_epoch().count()));
+    std::filesystem::create_directories(dir_);
+    counters_ = std::make_shared<FileReadCounters>();
+  }
+
+  void TearDown() override { std::filesystem::remove_all(dir_); }
+
+  // Writes a file with `contents` and adopts it into `cache`.
+  uint64_t AddFile(FileDescriptorCache& cache, const std::string& name,
+                   const std::string& contents) {
+    const auto path = dir_ / name;
+    std::ofstream(path, std::ios::binary) << contents;
+    const int flags = O_RDONLY | O_CLOEXEC;
+    const int fd = open(path.c_str(), flags);
+    EXPECT_GE(fd, 0);
+    struct stat st;
+    EXPECT_EQ(fstat(fd, &st), 0);
+    return cache.Adopt(path, flags, POSIX_FADV_NORMAL, fd, st, counters_);
+  }
+
+  static std::string ReadAll(const FileDescriptorCache::Lease& lease) {
+    std::string buffer(16, '\0');
+    const ssize_t size = pread(lease.fd(), buffer.data(), buffer.size(), 0);
+    buffer.resize(size < 0 ? 0 : size);
+    return buffer;
+  }
+
+  std::filesystem::path dir_;
+  std::shared_ptr<FileReadCounters> counters_;
+};
+
+TEST_F(FileDescriptorCacheTest, EvictsLeastRecentlyUsed) {
+  FileDescriptorCache cache;
+  cache.SetCapacity(2);
+  const uint64_t a = AddFile(cache, "a", "aaa");
+  const uint64_t b = AddFile(cache, "b", "bbb");
+  // Makes b the least recently used.
+  EXPECT_EQ(ReadAll(*cache.Acquire(a)), "aaa");
+  const uint64_t c = AddFile(cache, "c", "ccc");
+  EXPECT_EQ(cache.open_count(), 2u);
+  EXPECT_EQ(counters_->file_evictions.load(), 1u);
+  EXPECT_EQ(counters_->file_reopens.load(), 0u);
+
+  EXPECT_EQ(ReadAll(*cache.Acquire(b)), "bbb");
+  EXPECT_EQ(counters_->file_reopens.load(), 1u);
+  EXPECT_EQ(ReadAll(*cache.Acquire(c)), "ccc");
+  EXPECT_EQ(ReadAll(*cache.Acquire(a)), "aaa");
+  EXPECT_EQ(cache.open_count(), 2u);
+
+  cache.Remove(a);
+  cache.Remove(b);
+  cache.Remove(c);
+  EXPECT_EQ(cache.open_count(), 0u);
+}
+
+TEST_F(FileDescriptorCacheTest, KeepsBorrowedDescriptorsOpen) {
+  FileDescriptorCache cache;
+  cache.SetCapacity(1);
+  const uint64_t a = AddFile(cache, "a", "aaa");
+  std::optional<FileDescriptorCache::Lease> lease = cache.Acquire(a);
+  const uint64_t b = AddFile(cache, "b", "bbb");
+  // Only b is idle, so it's the one closed.
+  EXPECT_EQ(cache.open_count(), 1u);
+  EXPECT_EQ(ReadAll(*lease), "aaa");
+
+  // Removed while borrowed, closed once returned.
+  cache.Remove(a);
+  EXPECT_EQ(ReadAll(*lease), "aaa");
+  lease.reset();
+  EXPECT_EQ(cache.open_count(), 0u);
+  EXPECT_EQ(ReadAll(*cache.Acquire(b)), "bbb");
+  cache.Remove(b);
+}
+
+TEST_F(FileDescriptorCacheTest, DoesNotReopenReplacedFiles) {
+  FileDescriptorCache cache;
+  cache.SetCapacity(1);
+  const uint64_t a = AddFile(cache, "a", "aaa");
+  const uint64_t b = AddFile(cache, "b", "bbb");
+  // Written next to the old file first, so that it gets another inode.
+  std::ofstream(dir_ / "a.new", std::ios::binary) << "new";
+  std::filesystem::rename(dir_ / "a.new", dir_ / "a");
+  EXPECT_FALSE(cache.Acquire(a).has_value());
+  cache.Remove(a);
+  cache.Remove(b);
+}
+
+TEST_F(FileDescriptorCacheTest, ReadOnlyFileBorrowsFromGlobalCache) {
+  std::ofstream(dir_ / "file", std::ios::binary) << "contents";
+  FileDescriptorCache::Global().SetCapacity(2);
+  {
+    std::vector<std::unique_ptr<ReadOnlyFile>> files;
+    for (int i = 0; i < 5; ++i) {
+      files.push_back(std::make_unique<ReadOnlyFile>(
+          dir_ / "file", CachePolicy::kFadvise, counters_));
+    }
+    EXPECT_EQ(FileDescriptorCache::Global().open_count(), 2u);
+    for (const auto& file : files) {
+      std::string buffer(8, '\0');
+      ASSERT_TRUE(file->Read(buffer.data(), buffer.size(), 0));
+      EXPECT_EQ(buffer, "contents");
+    }
+    EXPECT_LE(FileDescriptorCache::Global().open_count(), 2u);
+  }
+  EXPECT_EQ(FileDescriptorCache::Global().open_count(), 0u);
+  EXPECT_GE(counters_->file_reopens.load(), 3u);
+  EXPECT_EQ(counters_->file_opens.load(), 5 + counters_->file_reopens.load());
+  FileDescriptorCache::Global().SetCapacity(0);
+}
+
+}  // namespace
+}  // namespace training
+}  // namespace lczero
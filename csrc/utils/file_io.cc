@@ -0,0 +1,166 @@
+#include "utils/file_io.h"
+
+#include <absl/log/log.h>
+#include <absl/strings/str_cat.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace lczero {
+namespace training {
+namespace {
+
+// Covers the logical block size of all common devices.
+constexpr size_t kDirectAlignment = 4096;
+// Larger reads (e.g. MakeResident()) go through the bounce buffer in pieces.
+constexpr size_t kMaxBounceBufferSize = size_t{1} << 20;
+
+constexpr size_t AlignUp(size_t value) {
+  return (value + kDirectAlignment - 1) & ~(kDirectAlignment - 1);
+}
+
+struct FreeDeleter {
+  void operator()(char* ptr) const { std::free(ptr); }
+};
+
+}  // namespace
+
+bool PreadFully(int fd, void* buffer, size_t size, off_t offset) {
+  char* out = static_cast<char*>(buffer);
+  while (size > 0) {
+    const ssize_t read = pread(fd, out, size, offset);
+    if (read < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    if (read == 0) return false;
+    out += read;
+    size -= static_cast<size_t>(read);
+    offset += read;
+  }
+  return true;
+}
+
+ReadOnlyFile::ReadOnlyFile(const std::filesystem::path& path,
+                           CachePolicy policy,
+                           std::shared_ptr<FileReadCounters> counters)
+    : policy_(policy), counters_(std::move(counters)) {
+  int flags = O_RDONLY | O_CLOEXEC;
+  if (policy_ == CachePolicy::kDirect) {
+    fd_ = open(path.c_str(), flags | O_DIRECT);
+    if (fd_ < 0 && errno == EINVAL) {
+      LOG_FIRST_N(WARNING, 1) << "O_DIRECT is not supported for " << path
+                              << ", using fadvise hints instead.";
+      policy_ = CachePolicy::kFadvise;
+    } else {
+      flags |= O_DIRECT;
+    }
+  }
+  if (policy_ != CachePolicy::kDirect) {
+    fd_ = open(path.c_str(), flags);
+  }
+  if (fd_ < 0) {
+    throw std::runtime_error(
+        absl::StrCat("Failed to open ", path.string(), ": ", strerror(errno)));
+  }
+  struct stat st;
+  if (fstat(fd_, &st) != 0) {
+    const int error = errno;
+    close(fd_);
+    throw std::runtime_error(
+        absl::StrCat("Failed to stat ", path.string(), ": ", strerror(error)));
+  }
+  size_ = static_cast<uint64_t>(st.st_size);
+  const int advice = policy_ == CachePolicy::kFadvise ? POSIX_FADV_RANDOM
+                                                      : POSIX_FADV_NORMAL;
+  if (advice != POSIX_FADV_NORMAL) posix_fadvise(fd_, 0, 0, advice);
+  if (counters_) counters_->file_opens.fetch_add(1, std::memory_order_relaxed);
+  FileDescriptorCache& cache = FileDescriptorCache::Global();
+  if (cache.capacity() > 0) {
+    cache_id_ = cache.Adopt(path, flags, advice, fd_, st, counters_);
+    fd_ = -1;
+  }
+}
+
+ReadOnlyFile::~ReadOnlyFile() {
+  if (cache_id_) {
+    FileDescriptorCache::Global().Remove(cache_id_);
+  } else {
+    close(fd_);
+  }
+}
+
+std::optional<FileDescriptorCache::Lease> ReadOnlyFile::Borrow() const {
+  if (!cache_id_) return FileDescriptorCache::Lease(fd_);
+  return FileDescriptorCache::Global().Acquire(cache_id_);
+}
+
+bool ReadOnlyFile::Read(void* buffer, size_t size, off_t offset) const {
+  const auto lease = Borrow();
+  if (!lease) return false;
+  const int fd = lease->fd();
+  const bool ok = policy_ == CachePolicy::kDirect
+                      ? ReadDirect(fd, static_cast<char*>(buffer), size, offset)
+                      : PreadFully(fd, buffer, size, offset);
+  if (ok) {
+    CountRead(size);
+    if (policy_ == CachePolicy::kDirect && counters_) {
+      counters_->cache_bypassed_reads.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  return ok;
+}
+
+bool ReadOnlyFile::ReadDirect(int fd, char* buffer, size_t size,
+                              off_t offset) const {
+  if (size == 0) return true;
+  // Room for the unaligned head plus at least one block of payload.
+  const size_t bounce_size =
+      std::min(kMaxBounceBufferSize, AlignUp(size + kDirectAlignment));
+  std::unique_ptr<char, FreeDeleter> bounce(
+      static_cast<char*>(std::aligned_alloc(kDirectAlignment, bounce_size)));
+  if (!bounce) return false;
+  while (size > 0) {
+    const off_t begin = offset & ~static_cast<off_t>(kDirectAlignment - 1);
+    const size_t skip = static_cast<size_t>(offset - begin);
+    const size_t length = std::min(bounce_size, AlignUp(skip + size));
+    ssize_t read;
+    do {
+      read = pread(fd, bounce.get(), length, begin);
+    } while (read < 0 && errno == EINTR);
+    // Reads only come back short at the end of the file.
+    if (read <= static_cast<ssize_t>(skip)) return false;
+    const size_t copied = std::min(size, static_cast<size_t>(read) - skip);
+    std::memcpy(buffer, bounce.get() + skip, copied);
+    buffer += copied;
+    size -= copied;
+    offset += copied;
+  }
+  return true;
+}
+
+void ReadOnlyFile::CountRead(size_t size) const {
+  if (counters_) {
+    counters_->bytes_read.fetch_add(size, std::memory_order_relaxed);
+  }
+}
+
+void ReadOnlyFile::Release(off_t offset, size_t size) const {
+  if (policy_ != CachePolicy::kFadvise || size == 0) return;
+  const auto lease = Borrow();
+  if (!lease) return;
+  posix_fadvise(lease->fd(), offset, static_cast<off_t>(size),
+                POSIX_FADV_DONTNEED);
+  if (counters_) {
+    counters_->cache_bypassed_reads.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+
+#include "utils/fd_cache.h"
+
+namespace lczero {
+namespace training {
+
+// Reads exactly `size` bytes at `offset`, retrying on short reads and EINTR.
+// Returns false on I/O error or if the file ends before `size` bytes are read.
+bool PreadFully(int fd, void* buffer, size_t size, off_t offset);
+
+// How reads through ReadOnlyFile interact with the page cache.
+enum class CachePolicy {
+  // Plain buffered reads.
+  kBuffered,
+  // Buffered reads, with POSIX_FADV_RANDOM on open and POSIX_FADV_DONTNEED
+  // for ranges passed to Release().
+  kFadvise,
+  // O_DIRECT reads through aligned bounce buffers.
+  kDirect,
+};
+
+// Read statistics, usually shared by all files opened by one stage.
+struct FileReadCounters {
+  std::atomic<uint64_t> bytes_read{0};
+  // Reads that went around the page cache (kDirect), or whose pages were
+  // dropped from it afterwards (kFadvise).
+  std::atomic<uint64_t> cache_bypassed_reads{0};
+  // Descriptors opened, reopens after an eviction from the
+  // FileDescriptorCache included.
+  std::atomic<uint64_t> file_opens{0};
+  std::atomic<uint64_t> file_reopens{0};
+  std::atomic<uint64_t> file_evictions{0};
+};
+
+// A file opened for positional reads under a page cache policy. Read() is
+// safe to call concurrently. Throws std::runtime_error if the file can't be
+// opened. kDirect falls back to kFadvise on filesystems without O_DIRECT
+// support. If the global FileDescriptorCache is enabled, the descriptor is
+// handed over to it after opening, and borrowed from it for every read.
+class ReadOnlyFile {
+ public:
+  ReadOnlyFile(const std::filesystem::path& path, CachePolicy policy,
+               std::shared_ptr<FileReadCounters> counters = nullptr);
+  ~ReadOnlyFile();
+
+  ReadOnlyFile(const ReadOnlyFile&) = delete;
+  ReadOnlyFile& operator=(const ReadOnlyFile&) = delete;
+
+  // Effective policy, after the O_DIRECT fallback.
+  CachePolicy policy() const { return policy_; }
+  // Returns the descriptor, open as long as the lease is held. Under kDirect,
+  // reads from it must be block aligned. Returns std::nullopt if an evicted
+  // descriptor can't be reopened.
+  std::optional<FileDescriptorCache::Lease> Borrow() const;
+  uint64_t size() const { return size_; }
+
+  // Same contract as PreadFully().
+  bool Read(void* buffer, size_t size, off_t offset) const;
+  // Accounts for `size` bytes read from a Borrow()ed descriptor, e.g. with
+  // AsyncFileReader.
+  void CountRead(size_t size) const;
+  // Tells the kernel the range won't be read again soon. Drops its pages from
+  // the page cache under kFadvise, no-op otherwise.
+  void Release(off_t offset, size_t size) const;
+
+ private:
+  bool ReadDirect(int fd, char* buffer, size_t size, off_t offset) const;
+
+  // Set when the descriptor is owned by the file rather than by the
+  // FileDescriptorCache, which knows it as cache_id_ otherwise.
+  int fd_ = -1;
+  uint64_t cache_id_ = 0;
+  uint64_t size_ = 0;
+  CachePolicy policy_;
+  std::shared_ptr<FileReadCounters> counters_;
+};
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,95 @@
+#include "utils/file_io.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace lczero {
+namespace training {
+namespace {
+
+class ReadOnlyFileTest : public ::testing::TestWithParam<CachePolicy> {
+ protected:
+  void SetUp() override {
+    path_ = std::filesystem::temp_directory_path() /
+            ("file_io_test_" +
+             std::to_string(
+                 std::chrono::steady_clock::now().time_since_epoch().count()));
+    // Not a multiple of the O_DIRECT alignment, so that the tail is partial.
+    contents_.resize((3 << 20) + 1234);
+    for (size_t i = 0; i < contents_.size(); ++i) {
+      contents_[i] = static_cast<char>((i * 31 + i / 4093) % 251);
+    }
+    std::ofstream(path_, std::ios::binary) << contents_;
+    counters_ = std::make_shared<FileReadCounters>();
+  }
+
+  void TearDown() override { std::filesystem::remove(path_); }
+
+  std::filesystem::path path_;
+  std::string contents_;
+  std::shared_ptr<FileReadCounters> counters_;
+};
+
+TEST_P(ReadOnlyFileTest, ReadsRanges) {
+  ReadOnlyFile file(path_, GetParam(), counters_);
+  EXPECT_EQ(file.size(), contents_.size());
+  const std::vector<std::pair<off_t, size_t>> ranges = {
+      {0, 100},
+      {4096, 65536},
+      {12345, 1},
+      {4095, 2},
+      {77, (2 << 20) + 5},
+      {static_cast<off_t>(contents_.size()) - 5000, 5000},
+      {100, 0}};
+  size_t bytes = 0;
+  for (const auto& [offset, size] : ranges) {
+    std::string buffer(size, '\0');
+    ASSERT_TRUE(file.Read(buffer.data(), size, offset)) << offset;
+    EXPECT_EQ(buffer, contents_.substr(offset, size)) << offset;
+    bytes += size;
+  }
+  EXPECT_EQ(counters_->bytes_read.load(), bytes);
+  EXPECT_EQ(counters_->cache_bypassed_reads.load(),
+            file.policy() == CachePolicy::kDirect ? ranges.size() : 0);
+}
+
+TEST_P(ReadOnlyFileTest, FailsPastEnd) {
+  ReadOnlyFile file(path_, GetParam(), counters_);
+  std::string buffer(100, '\0');
+  EXPECT_FALSE(file.Read(buffer.data(), buffer.size(), contents_.size() - 50));
+  EXPECT_FALSE(file.Read(buffer.data(), buffer.size(), contents_.size() + 1));
+  EXPECT_EQ(counters_->bytes_read.load(), 0);
+}
+
+TEST_P(ReadOnlyFileTest, CountsReleasedRanges) {
+  ReadOnlyFile file(path_, GetParam(), counters_);
+  file.CountRead(1000);
+  file.Release(0, 1000);
+  file.Release(0, 0);
+  EXPECT_EQ(counters_->bytes_read.load(), 1000);
+  EXPECT_EQ(counters_->cache_bypassed_reads.load(),
+            file.policy() == CachePolicy::kFadvise ? 1 : 0);
+}
+
+TEST(ReadOnlyFileOpenTest, ThrowsForMissingFile) {
+  EXPECT_THROW(
+      ReadOnlyFile("/nonexistent/file_io_test", CachePolicy::kBuffered),
+      std::runtime_error);
+}
+
+INSTANTIATE_TEST_SUITE_P(Policies, ReadOnlyFileTest,
+                         ::testing::Values(CachePolicy::kBuffered,
+                                           CachePolicy::kFadvise,
+                                           CachePolicy::kDirect));
+
+}  // namespace
+}  // namespace training
+}  // namespace lczero
@@ -3,49 +3,184 @@
 #include <absl/log/log.h>
 #include <zlib.h>
 
-#include <array>
+#ifdef HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
 #include <stdexcept>
 
 namespace lczero {
 namespace training {
+namespace {
 
-std::string GunzipBuffer(std::string_view buffer) {
-  z_stream strm = {};
-  int ret = inflateInit2(&strm, 16 + MAX_WBITS);
-  if (ret != Z_OK) {
-    throw GunzipError("Failed to initialize zlib inflate");
+// Smallest possible gzip member: 10 byte header, empty deflate block, 8 byte
+// trailer.
+constexpr size_t kMinGzipSize = 18;
+// Initial guess when the trailer can't be trusted.
+constexpr size_t kMinOutputSize = 65536;
+
+bool HasGzipMagic(std::string_view buffer) {
+  return buffer.size() >= 2 && static_cast<unsigned char>(buffer[0]) == 0x1f &&
+         static_cast<unsigned char>(buffer[1]) == 0x8b;
+}
+
+// Per-thread inflate stream, initialized once and reset between buffers.
+class ZlibInflateStream {
+ public:
+  ZlibInflateStream() {
+    if (inflateInit2(&strm_, 16 + MAX_WBITS) != Z_OK) {
+      throw GunzipError("Failed to initialize zlib inflate");
+    }
   }
+  ~ZlibInflateStream() { inflateEnd(&strm_); }
 
-  strm.avail_in = buffer.size();
-  strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(buffer.data()));
+  z_stream* Reset() {
+    if (inflateReset(&strm_) != Z_OK) {
+      throw GunzipError("Failed to reset zlib inflate");
+    }
+    return &strm_;
+  }
 
-  constexpr size_t kChunkSize = 16384;
-  std::string output;
-  std::array<char, kChunkSize> temp_buffer;
+ private:
+  z_stream strm_ = {};
+};
+
+class ZlibBackend : public InflateBackend {
+ public:
+  std::string_view name() const override { return "zlib"; }
 
-  do {
-    strm.avail_out = kChunkSize;
-    strm.next_out = reinterpret_cast<Bytef*>(temp_buffer.data());
+  std::optional<size_t> Inflate(std::string_view input,
+                                std::span<char> output) const override {
+    thread_local ZlibInflateStream stream;
+    z_stream* strm = stream.Reset();
+    strm->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    strm->avail_in = static_cast<uInt>(input.size());
+    strm->next_out = reinterpret_cast<Bytef*>(output.data());
+    strm->avail_out = static_cast<uInt>(output.size());
 
-    ret = inflate(&strm, Z_NO_FLUSH);
-    if (ret == Z_STREAM_ERROR || ret == Z_NEED_DICT || ret == Z_DATA_ERROR ||
-        ret == Z_MEM_ERROR) {
-      inflateEnd(&strm);
-      throw GunzipError("zlib inflate error");
+    const int ret = inflate(strm, Z_FINISH);
+    if (ret == Z_STREAM_END) return strm->total_out;
+    if (ret == Z_BUF_ERROR || ret == Z_OK) {
+      if (strm->avail_out == 0) return std::nullopt;
+      throw GunzipError("Incomplete gzip decompression");
     }
+    throw GunzipError("zlib inflate error");
+  }
+};
 
-    size_t bytes_written = kChunkSize - strm.avail_out;
-    output.append(temp_buffer.begin(), temp_buffer.begin() + bytes_written);
-  } while (strm.avail_out == 0);
+#ifdef HAVE_LIBDEFLATE
+class LibdeflateBackend : public InflateBackend {
+ public:
+  std::string_view name() const override { return "libdeflate"; }
 
-  inflateEnd(&strm);
+  std::optional<size_t> Inflate(std::string_view input,
+                                std::span<char> output) const override {
+    struct Deleter {
+      void operator()(libdeflate_decompressor* d) const {
+        libdeflate_free_decompressor(d);
+      }
+    };
+    thread_local std::unique_ptr<libdeflate_decompressor, Deleter>
+        decompressor(libdeflate_alloc_decompressor());
+    if (!decompressor) {
+      throw GunzipError("Failed to allocate libdeflate decompressor");
+    }
 
-  if (ret != Z_STREAM_END) {
-    throw GunzipError("Incomplete gzip decompression");
+    size_t actual_size = 0;
+    switch (libdeflate_gzip_decompress(decompressor.get(), input.data(),
+                                       input.size(), output.data(),
+                                       output.size(), &actual_size)) {
+      case LIBDEFLATE_SUCCESS:
+        return actual_size;
+      case LIBDEFLATE_INSUFFICIENT_SPACE:
+        return std::nullopt;
+      default:
+        throw GunzipError("libdeflate inflate error");
+    }
   }
+};
+#endif
 
+}  // namespace
+
+const InflateBackend& ZlibInflateBackend() {
+  static const ZlibBackend backend;
+  return backend;
+}
+
+const InflateBackend& DefaultInflateBackend() {
+#ifdef HAVE_LIBDEFLATE
+  static const LibdeflateBackend backend;
+  return backend;
+#else
+  return ZlibInflateBackend();
+#endif
+}
+
+std::optional<uint32_t> GzipUncompressedSize(std::string_view buffer) {
+  if (buffer.size() < kMinGzipSize || !HasGzipMagic(buffer)) {
+    return std::nullopt;
+  }
+  const auto* trailer =
+      reinterpret_cast<const unsigned char*>(buffer.data() + buffer.size() - 4);
+  return static_cast<uint32_t>(trailer[0]) |
+         (static_cast<uint32_t>(trailer[1]) << 8) |
+         (static_cast<uint32_t>(trailer[2]) << 16) |
+         (static_cast<uint32_t>(trailer[3]) << 24);
+}
+
+size_t GunzipInto(std::string_view buffer, std::span<char> output,
+                  const InflateBackend& backend) {
+  const auto size = backend.Inflate(buffer, output);
+  if (!size) throw GunzipError("Gzip output buffer too small");
+  return *size;
+}
+
+std::string GunzipBuffer(std::string_view buffer,
+                         const InflateBackend& backend) {
+  const auto trailer_size = GzipUncompressedSize(buffer);
+  if (!trailer_size) throw GunzipError("Not a gzip stream");
+
+  // The trailer is exact for the single-member files we produce; growing is
+  // only needed for multi-member or >4GB streams and corrupted trailers.
+  size_t capacity = *trailer_size;
+  if (capacity > buffer.size() * kMaxGzipExpansionRatio) {
+    capacity = kMinOutputSize;
+  }
+  std::string output;
+  while (true) {
+    output.resize(capacity);
+    if (const auto size = backend.Inflate(buffer, output)) {
+      output.resize(*size);
+      return output;
+    }
+    if (capacity >= buffer.size() * kMaxGzipExpansionRatio) {
+      throw GunzipError("Gzip stream expands beyond the deflate limit");
+    }
+    capacity = std::max(capacity * 2, kMinOutputSize);
+  }
+}
+
+std::string GzipBuffer(std::string_view buffer, int level) {
+  z_stream strm = {};
+  if (deflateInit2(&strm, level, Z_DEFLATED, 16 + MAX_WBITS, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    throw GunzipError("Failed to initialize zlib deflate");
+  }
+  std::string output(deflateBound(&strm, buffer.size()), '\0');
+  strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(buffer.data()));
+  strm.avail_in = static_cast<uInt>(buffer.size());
+  strm.next_out = reinterpret_cast<Bytef*>(output.data());
+  strm.avail_out = static_cast<uInt>(output.size());
+  const int ret = deflate(&strm, Z_FINISH);
+  deflateEnd(&strm);
+  if (ret != Z_STREAM_END) throw GunzipError("zlib deflate error");
+  output.resize(strm.total_out);
   return output;
 }
 
 }  // namespace training
-}  // namespace lczero
\ No newline at end of file
+}  // namespace lczero
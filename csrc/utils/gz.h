@@ -1,8 +1,12 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <optional>
 #include <span>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 
 namespace lczero {
 namespace training {
@@ -12,7 +16,50 @@ class GunzipError : public std::runtime_error {
   using std::runtime_error::runtime_error;
 };
 
-std::string GunzipBuffer(std::string_view buffer);
+// Inflate implementation for single-member gzip buffers. Implementations keep
+// their decompressor state per thread, so a backend may be used concurrently.
+class InflateBackend {
+ public:
+  virtual ~InflateBackend() = default;
+
+  virtual std::string_view name() const = 0;
+
+  // Decompresses the gzip member at the start of `input` into `output`.
+  // Returns the number of bytes written, or std::nullopt if `output` is too
+  // small to hold the result. Throws GunzipError on malformed input.
+  virtual std::optional<size_t> Inflate(std::string_view input,
+                                        std::span<char> output) const = 0;
+};
+
+// zlib-based backend; always available.
+const InflateBackend& ZlibInflateBackend();
+// The fastest backend available in this build. It is libdeflate if the build
+// found it (HAVE_LIBDEFLATE), and zlib otherwise.
+const InflateBackend& DefaultInflateBackend();
+
+// Deflate can't expand data more than 1032:1, so a gzip trailer claiming a
+// larger size relative to the compressed size is corrupted.
+constexpr size_t kMaxGzipExpansionRatio = 1032;
+
+// Returns the uncompressed size stored in the gzip trailer (ISIZE), or
+// std::nullopt if `buffer` is not a gzip stream. ISIZE is the size modulo
+// 2^32 of the last member only, so it's a hint rather than a guarantee.
+std::optional<uint32_t> GzipUncompressedSize(std::string_view buffer);
+
+// Decompresses `buffer` into `output`, which must be large enough (see
+// GzipUncompressedSize()). Returns the number of bytes written. Throws
+// GunzipError on malformed input or if `output` is too small.
+size_t GunzipInto(std::string_view buffer, std::span<char> output,
+                  const InflateBackend& backend = DefaultInflateBackend());
+
+// Decompresses `buffer` into a string pre-sized from the gzip trailer.
+std::string GunzipBuffer(
+    std::string_view buffer,
+    const InflateBackend& backend = DefaultInflateBackend());
+
+// Compresses `buffer` into a single gzip member with the given zlib level
+// (1 is fastest). Throws GunzipError on failure.
+std::string GzipBuffer(std::string_view buffer, int level);
 
 }  // namespace training
-}  // namespace lczero
\ No newline at end of file
+}  // namespace lczero
@@ -0,0 +1,110 @@
+#include "utils/gz.h"
+
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+#include <string>
+#include <vector>
+
+namespace lczero {
+namespace training {
+namespace {
+
+std::string Gzip(std::string_view data) {
+  z_stream strm = {};
+  EXPECT_EQ(deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                         16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY),
+            Z_OK);
+  std::string output(deflateBound(&strm, data.size()), '\0');
+  strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  strm.avail_in = data.size();
+  strm.next_out = reinterpret_cast<Bytef*>(output.data());
+  strm.avail_out = output.size();
+  EXPECT_EQ(deflate(&strm, Z_FINISH), Z_STREAM_END);
+  output.resize(strm.total_out);
+  deflateEnd(&strm);
+  return output;
+}
+
+std::string MakePayload(size_t size) {
+  std::string payload(size, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    payload[i] = static_cast<char>((i * 7 + i / 113) % 251);
+  }
+  return payload;
+}
+
+std::vector<const InflateBackend*> Backends() {
+  return {&ZlibInflateBackend(), &DefaultInflateBackend()};
+}
+
+TEST(GzTest, RoundTrip) {
+  for (size_t size : {0, 1, 1000, 200000}) {
+    const std::string payload = MakePayload(size);
+    const std::string compressed = Gzip(payload);
+    for (const auto* backend : Backends()) {
+      EXPECT_EQ(GunzipBuffer(compressed, *backend), payload)
+          << backend->name() << " size " << size;
+    }
+  }
+}
+
+TEST(GzTest, UncompressedSizeFromTrailer) {
+  const std::string compressed = Gzip(MakePayload(12345));
+  EXPECT_EQ(GzipUncompressedSize(compressed), 12345u);
+  EXPECT_EQ(GzipUncompressedSize("not gzip data at all"), std::nullopt);
+  EXPECT_EQ(GzipUncompressedSize(compressed.substr(0, 10)), std::nullopt);
+}
+
+TEST(GzTest, InflatesIntoCallerBuffer) {
+  const std::string payload = MakePayload(5000);
+  const std::string compressed = Gzip(payload);
+  for (const auto* backend : Backends()) {
+    std::string output(payload.size(), '\0');
+    EXPECT_EQ(GunzipInto(compressed, output, *backend), payload.size());
+    EXPECT_EQ(output, payload);
+
+    std::string small(payload.size() - 1, '\0');
+    EXPECT_EQ(backend->Inflate(compressed, small), std::nullopt);
+    EXPECT_THROW(GunzipInto(compressed, small, *backend), GunzipError);
+  }
+}
+
+TEST(GzTest, GrowsWhenTrailerUnderstatesSize) {
+  // For concatenated members the trailer holds the size of the last one only.
+  // Only the first member is decoded.
+  const std::string first = MakePayload(100000);
+  const std::string compressed = Gzip(first) + Gzip("tail");
+  EXPECT_EQ(GzipUncompressedSize(compressed), 4u);
+  EXPECT_EQ(GunzipBuffer(compressed, ZlibInflateBackend()), first);
+}
+
+TEST(GzTest, RejectsMalformedInput) {
+  const std::string compressed = Gzip(MakePayload(5000));
+  for (const auto* backend : Backends()) {
+    EXPECT_THROW(GunzipBuffer("plain text, definitely not gzip", *backend),
+                 GunzipError);
+    EXPECT_THROW(GunzipBuffer(compressed.substr(0, compressed.size() / 2) +
+                                  compressed.substr(compressed.size() - 4),
+                              *backend),
+                 GunzipError);
+  }
+}
+
+TEST(GzTest, ReusesStateAcrossCalls) {
+  const std::string first = MakePayload(3000);
+  const std::string second = MakePayload(7000);
+  const std::string first_gz = Gzip(first);
+  const std::string second_gz = Gzip(second);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_EQ(GunzipBuffer(first_gz), first);
+    EXPECT_THROW(GunzipBuffer(first_gz.substr(0, first_gz.size() - 10) +
+                              first_gz.substr(first_gz.size() - 4)),
+                 GunzipError);
+    EXPECT_EQ(GunzipBuffer(second_gz), second);
+  }
+}
+
+}  // namespace
+}  // namespace training
+}  // namespace lczero
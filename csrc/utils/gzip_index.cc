@@ -0,0 +1,342 @@
+#include "utils/gzip_index.h"
+
+#include <absl/log/log.h>
+#include <absl/strings/str_cat.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+#include <utility>
+
+#include "utils/gz.h"
+
+namespace lczero {
+namespace training {
+namespace {
+
+// Largest distance a deflate stream can refer back to.
+constexpr size_t kWindowSize = 32768;
+constexpr size_t kInputSize = 65536;
+constexpr char kIndexMagic[8] = {'L', 'C', 'Z', 'G', 'Z', 'I', 'X', '1'};
+constexpr uint32_t kIndexVersion = 1;
+
+// Layout of an index file: this header, the access points, the caller's
+// metadata, and the windows of all access points.
+struct IndexHeader {
+  char magic[8];
+  uint32_t version;
+  // Of the access points and the metadata.
+  uint32_t crc32;
+  uint64_t file_size;
+  int64_t mtime_ns;
+  uint64_t uncompressed_size;
+  uint64_t point_count;
+  uint64_t metadata_size;
+};
+static_assert(sizeof(IndexHeader) == 56);
+
+// Owns an initialized z_stream.
+class InflateStream {
+ public:
+  explicit InflateStream(int window_bits) {
+    if (inflateInit2(&strm_, window_bits) != Z_OK) {
+      throw GunzipError("Failed to initialize zlib inflate");
+    }
+  }
+  ~InflateStream() { inflateEnd(&strm_); }
+  InflateStream(const InflateStream&) = delete;
+  InflateStream& operator=(const InflateStream&) = delete;
+
+  z_stream* get() { return &strm_; }
+
+ private:
+  z_stream strm_ = {};
+};
+
+uint32_t Crc32(uint32_t crc, const void* data, size_t size) {
+  return crc32(crc, static_cast<const Bytef*>(data), static_cast<uInt>(size));
+}
+
+}  // namespace
+
+GzipIndex::GzipIndex(GzipIndex&&) = default;
+GzipIndex& GzipIndex::operator=(GzipIndex&&) = default;
+GzipIndex::~GzipIndex() = default;
+
+GzipIndex GzipIndex::Build(const ReadOnlyFile& file,
+                           absl::FunctionRef<void(std::string_view)> consume,
+                           uint64_t span) {
+  GzipIndex index;
+  // Automatic gzip header detection, needed again for every member.
+  InflateStream stream(32 + MAX_WBITS);
+  z_stream* strm = stream.get();
+  std::vector<unsigned char> input(kInputSize);
+  std::vector<unsigned char> window(kWindowSize);
+  uint64_t read_offset = 0;
+  uint64_t total_in = 0;
+  uint64_t total_out = 0;
+  uint64_t last_point_out = 0;
+  int ret = Z_OK;
+  while (true) {
+    if (strm->avail_in == 0) {
+      const size_t size = std::min<uint64_t>(kInputSize,
+                                             file.size() - read_offset);
+      if (size == 0) break;
+      if (!file.Read(input.data(), size, read_offset)) {
+        throw GunzipError("Failed to read gzip file");
+      }
+      read_offset += size;
+      strm->next_in = input.data();
+      strm->avail_in = static_cast<uInt>(size);
+    }
+    // The previous member ended, and more input follows.
+    if (ret == Z_STREAM_END && inflateReset(strm) != Z_OK) {
+      throw GunzipError("Failed to reset zlib inflate");
+    }
+    // The output goes through `window` as a ring buffer, so that it always
+    // holds the last 32 KiB.
+    if (strm->avail_out == 0) {
+      strm->next_out = window.data();
+      strm->avail_out = kWindowSize;
+    }
+    unsigned char* const output = strm->next_out;
+    total_in += strm->avail_in;
+    total_out += strm->avail_out;
+    ret = inflate(strm, Z_BLOCK);
+    total_in -= strm->avail_in;
+    total_out -= strm->avail_out;
+    if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR) {
+      throw GunzipError(absl::StrCat("Corrupted gzip file at offset ",
+                                     total_in, ": ",
+                                     strm->msg ? strm->msg : "unknown error"));
+    }
+    consume(std::string_view(reinterpret_cast<const char*>(output),
+                             strm->next_out - output));
+
+    // At a block boundary that is not the end of the member.
+    if ((strm->data_type & 128) && !(strm->data_type & 64) &&
+        (index.points_.empty() || total_out - last_point_out >= span)) {
+      index.points_.push_back(
+          {.out = total_out,
+           .in = total_in,
+           .bits = static_cast<uint32_t>(strm->data_type & 7)});
+      const size_t position = kWindowSize - strm->avail_out;
+      index.windows_.append(
+          reinterpret_cast<const char*>(window.data()) + position,
+          kWindowSize - position);
+      index.windows_.append(reinterpret_cast<const char*>(window.data()),
+                            position);
+      last_point_out = total_out;
+    }
+  }
+  if (ret != Z_STREAM_END) throw GunzipError("Truncated gzip file");
+  index.uncompressed_size_ = total_out;
+  return index;
+}
+
+bool GzipIndex::Save(const std::filesystem::path& path, uint64_t file_size,
+                     int64_t mtime_ns, std::string_view metadata) const {
+  assert(windows_.size() == points_.size() * kWindowSize);
+  IndexHeader header = {};
+  std::memcpy(header.magic, kIndexMagic, sizeof(header.magic));
+  header.version = kIndexVersion;
+  header.crc32 = Crc32(Crc32(0, points_.data(),
+                             points_.size() * sizeof(AccessPoint)),
+                       metadata.data(), metadata.size());
+  header.file_size = file_size;
+  header.mtime_ns = mtime_ns;
+  header.uncompressed_size = uncompressed_size_;
+  header.point_count = points_.size();
+  header.metadata_size = metadata.size();
+
+  // Written under a temporary name, so that a concurrent reader never sees a
+  // partial index.
+  const std::filesystem::path temp_path = std::filesystem::path(path) += ".tmp";
+  FILE* file = fopen(temp_path.c_str(), "wb");
+  if (!file) {
+    LOG(WARNING) << "Failed to create " << temp_path << ": "
+                 << strerror(errno);
+    return false;
+  }
+  auto write = [file](const void* data, size_t size) {
+    return fwrite(data, 1, size, file) == size;
+  };
+  bool ok = write(&header, sizeof(header)) &&
+            write(points_.data(), points_.size() * sizeof(AccessPoint)) &&
+            write(metadata.data(), metadata.size()) &&
+            write(windows_.data(), windows_.size());
+  ok = (fclose(file) == 0) && ok;
+  std::error_code error;
+  if (ok) std::filesystem::rename(temp_path, path, error);
+  if (!ok || error) {
+    LOG(WARNING) << "Failed to write " << path;
+    std::filesystem::remove(temp_path, error);
+    return false;
+  }
+  return true;
+}
+
+std::optional<GzipIndex> GzipIndex::Load(const std::filesystem::path& path,
+                                         uint64_t file_size, int64_t mtime_ns,
+                                         std::string* metadata) {
+  std::error_code error;
+  if (!std::filesystem::exists(path, error)) return std::nullopt;
+  GzipIndex index;
+  try {
+    index.index_file_ =
+        std::make_unique<ReadOnlyFile>(path, CachePolicy::kBuffered);
+  } catch (const std::exception& e) {
+    LOG(WARNING) << e.what();
+    return std::nullopt;
+  }
+  const ReadOnlyFile& file = *index.index_file_;
+
+  IndexHeader header;
+  if (!file.Read(&header, sizeof(header), 0) ||
+      std::memcmp(header.magic, kIndexMagic, sizeof(kIndexMagic)) != 0 ||
+      header.version != kIndexVersion) {
+    LOG(WARNING) << path << " is not a gzip index";
+    return std::nullopt;
+  }
+  if (header.file_size != file_size || header.mtime_ns != mtime_ns) {
+    LOG(INFO) << path << " is stale, rebuilding it";
+    return std::nullopt;
+  }
+  const uint64_t points_size = header.point_count * sizeof(AccessPoint);
+  index.windows_offset_ = sizeof(header) + points_size + header.metadata_size;
+  if (header.point_count > file.size() / kWindowSize ||
+      index.windows_offset_ + header.point_count * kWindowSize !=
+          file.size()) {
+    LOG(WARNING) << path << " is truncated";
+    return std::nullopt;
+  }
+  index.points_.resize(header.point_count);
+  metadata->resize(header.metadata_size);
+  if (!file.Read(index.points_.data(), points_size, sizeof(header)) ||
+      !file.Read(metadata->data(), metadata->size(),
+                 sizeof(header) + points_size) ||
+      Crc32(Crc32(0, index.points_.data(), points_size), metadata->data(),
+            metadata->size()) != header.crc32) {
+    LOG(WARNING) << path << " is corrupted";
+    return std::nullopt;
+  }
+  index.uncompressed_size_ = header.uncompressed_size;
+  return index;
+}
+
+bool GzipIndex::ReadWindow(size_t index,
+                           std::span<unsigned char> window) const {
+  assert(window.size() == kWindowSize);
+  if (!index_file_) {
+    std::memcpy(window.data(), windows_.data() + index * kWindowSize,
+                kWindowSize);
+    return true;
+  }
+  return index_file_->Read(window.data(), kWindowSize,
+                           windows_offset_ + index * kWindowSize);
+}
+
+bool GzipIndex::Extract(const ReadOnlyFile& file, uint64_t offset,
+                        std::span<char> output, ReadStats* stats) const {
+  if (output.empty()) return true;
+  ReadStats unused;
+  if (!stats) stats = &unused;
+  if (offset + output.size() > uncompressed_size_ || points_.empty()) {
+    return false;
+  }
+  // The first point is at offset 0.
+  const auto it = std::upper_bound(
+      points_.begin(), points_.end(), offset,
+      [](uint64_t value, const AccessPoint& p) { return value < p.out; });
+  const size_t point_index = std::distance(points_.begin(), it) - 1;
+  const AccessPoint& point = points_[point_index];
+
+  try {
+    // Raw deflate from the access point; members that follow start with a
+    // gzip header again.
+    InflateStream stream(-MAX_WBITS);
+    z_stream* strm = stream.get();
+    if (point.bits) {
+      unsigned char byte;
+      ++stats->calls;
+      ++stats->bytes;
+      if (!file.Read(&byte, 1, point.in - 1)) return false;
+      inflatePrime(strm, point.bits, byte >> (8 - point.bits));
+    }
+    std::vector<unsigned char> window(kWindowSize);
+    if (!ReadWindow(point_index, window) ||
+        inflateSetDictionary(strm, window.data(), kWindowSize) != Z_OK) {
+      return false;
+    }
+
+    std::vector<unsigned char> input(kInputSize);
+    // Output before `offset` is inflated into `window`, which is not needed
+    // anymore.
+    uint64_t skip = offset - point.out;
+    size_t produced = 0;
+    uint64_t read_offset = point.in;
+    bool raw = true;
+    // Bytes of a gzip trailer left to skip after a raw member ended.
+    size_t trailer_left = 0;
+    while (produced < output.size()) {
+      if (strm->avail_in == 0) {
+        const size_t size =
+            std::min<uint64_t>(kInputSize, file.size() - read_offset);
+        if (size == 0) return false;
+        ++stats->calls;
+        stats->bytes += size;
+        if (!file.Read(input.data(), size, read_offset)) return false;
+        read_offset += size;
+        strm->next_in = input.data();
+        strm->avail_in = static_cast<uInt>(size);
+      }
+      if (trailer_left > 0) {
+        const size_t skipped = std::min<size_t>(trailer_left, strm->avail_in);
+        strm->next_in += skipped;
+        strm->avail_in -= skipped;
+        trailer_left -= skipped;
+        if (trailer_left == 0 && inflateReset2(strm, 16 + MAX_WBITS) != Z_OK) {
+          return false;
+        }
+        continue;
+      }
+      if (skip > 0) {
+        strm->next_out = window.data();
+        strm->avail_out = static_cast<uInt>(std::min<uint64_t>(skip,
+                                                               kWindowSize));
+      } else {
+        strm->next_out = reinterpret_cast<unsigned char*>(output.data()) +
+                         produced;
+        strm->avail_out = static_cast<uInt>(output.size() - produced);
+      }
+      const uInt available = strm->avail_out;
+      const int ret = inflate(strm, Z_NO_FLUSH);
+      const size_t written = available - strm->avail_out;
+      if (skip > 0) {
+        skip -= written;
+      } else {
+        produced += written;
+      }
+      if (ret == Z_STREAM_END) {
+        if (raw) {
+          raw = false;
+          trailer_left = 8;
+        } else if (inflateReset(strm) != Z_OK) {
+          return false;
+        }
+        continue;
+      }
+      if (ret != Z_OK && ret != Z_BUF_ERROR) return false;
+    }
+  } catch (const GunzipError& e) {
+    LOG(WARNING) << e.what();
+    return false;
+  }
+  return true;
+}
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <absl/functional/function_ref.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "utils/file_io.h"
+
+namespace lczero {
+namespace training {
+
+// Random access into a gzip file, after zlib's examples/zran.c. Building the
+// index inflates the file once, and every `span` bytes of output saves an
+// access point at a deflate block boundary: the input position and the last
+// 32 KiB of output, which is all the state inflate needs to resume there.
+// Extract() then only inflates from the nearest access point before the
+// requested range. Multi-member files (e.g. from pigz or concatenation) are
+// supported.
+//
+// The index can be saved to a file. A loaded index keeps only the access
+// point positions in memory and reads the windows from the index file on
+// demand. Extract() is safe to call concurrently.
+class GzipIndex {
+ public:
+  static constexpr uint64_t kDefaultSpan = uint64_t{1} << 20;
+
+  // Inflates all of `file`, passing the uncompressed stream to `consume` in
+  // order. Throws GunzipError if the file is not a valid gzip stream.
+  static GzipIndex Build(const ReadOnlyFile& file,
+                         absl::FunctionRef<void(std::string_view)> consume,
+                         uint64_t span = kDefaultSpan);
+
+  // Loads an index saved for a file with the given size and modification
+  // time. Returns std::nullopt if `path` doesn't exist, is not an index, or
+  // was built for a different version of the file. `metadata` receives the
+  // bytes passed to Save().
+  static std::optional<GzipIndex> Load(const std::filesystem::path& path,
+                                       uint64_t file_size, int64_t mtime_ns,
+                                       std::string* metadata);
+
+  GzipIndex(GzipIndex&&);
+  GzipIndex& operator=(GzipIndex&&);
+  ~GzipIndex();
+
+  // Writes the index together with caller-defined `metadata`, through a
+  // temporary file and a rename. Returns false (with a warning) on failure,
+  // e.g. if the directory is read-only.
+  bool Save(const std::filesystem::path& path, uint64_t file_size,
+            int64_t mtime_ns, std::string_view metadata) const;
+
+  // Reads of the gzip file done by Extract().
+  struct ReadStats {
+    uint64_t bytes = 0;
+    uint64_t calls = 0;
+  };
+
+  // Fills `output` with the uncompressed bytes at `offset`. Returns false if
+  // the file can't be read or is corrupted. Adds the reads to `stats` if
+  // given.
+  bool Extract(const ReadOnlyFile& file, uint64_t offset,
+               std::span<char> output, ReadStats* stats = nullptr) const;
+
+  uint64_t uncompressed_size() const { return uncompressed_size_; }
+  size_t access_point_count() const { return points_.size(); }
+
+ private:
+  struct AccessPoint {
+    // Offset in the uncompressed stream.
+    uint64_t out;
+    // Offset of the first whole input byte after the block boundary.
+    uint64_t in;
+    // Number of bits of the byte before `in` that belong to the next block.
+    uint32_t bits;
+    uint32_t padding = 0;
+  };
+  static_assert(sizeof(AccessPoint) == 24);
+
+  GzipIndex() = default;
+  // Copies the window of access point `index` into `window`.
+  bool ReadWindow(size_t index, std::span<unsigned char> window) const;
+
+  std::vector<AccessPoint> points_;
+  uint64_t uncompressed_size_ = 0;
+  // Windows of all access points, either in memory (freshly built) or in the
+  // index file (loaded) starting at windows_offset_.
+  std::string windows_;
+  std::unique_ptr<ReadOnlyFile> index_file_;
+  uint64_t windows_offset_ = 0;
+};
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,119 @@
+#include "utils/gzip_index.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "utils/gz.h"
+
+namespace lczero {
+namespace training {
+namespace {
+
+constexpr uint64_t kSpan = 65536;
+
+class GzipIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    test_dir_ =
+        std::filesystem::temp_directory_path() /
+        ("gzip_index_test_" +
+         std::to_string(
+             std::chrono::steady_clock::now().time_since_epoch().count()));
+    std::filesystem::create_directories(test_dir_);
+    path_ = test_dir_ / "data.gz";
+    // Compressible, but not so much that the blocks get huge.
+    contents_.resize((2 << 20) + 777);
+    uint32_t state = 12345;
+    for (auto& c : contents_) {
+      state = state * 1103515245 + 12345;
+      c = static_cast<char>('a' + (state >> 16) % 16);
+    }
+    // Two members, as written by pigz or by concatenating gzip files.
+    const size_t split = contents_.size() / 3;
+    std::ofstream(path_, std::ios::binary)
+        << GzipBuffer(std::string_view(contents_).substr(0, split), 6)
+        << GzipBuffer(std::string_view(contents_).substr(split), 6);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(test_dir_); }
+
+  void ExpectExtracts(const GzipIndex& index, const ReadOnlyFile& file) {
+    const std::vector<std::pair<uint64_t, size_t>> ranges = {
+        {0, 100},
+        {kSpan - 10, 20},
+        {contents_.size() / 3 - 50, 100},
+        {1 << 20, 3 * kSpan},
+        {contents_.size() - 1000, 1000},
+        {12345, 0}};
+    for (const auto& [offset, size] : ranges) {
+      std::string buffer(size, '\0');
+      ASSERT_TRUE(index.Extract(file, offset, buffer)) << offset;
+      EXPECT_EQ(buffer, contents_.substr(offset, size)) << offset;
+    }
+    std::string buffer(2, '\0');
+    EXPECT_FALSE(index.Extract(file, contents_.size() - 1, buffer));
+  }
+
+  std::filesystem::path test_dir_;
+  std::filesystem::path path_;
+  std::string contents_;
+};
+
+TEST_F(GzipIndexTest, BuildsAndExtracts) {
+  ReadOnlyFile file(path_, CachePolicy::kBuffered);
+  std::string inflated;
+  const GzipIndex index = GzipIndex::Build(
+      file, [&inflated](std::string_view data) { inflated.append(data); },
+      kSpan);
+  EXPECT_EQ(inflated, contents_);
+  EXPECT_EQ(index.uncompressed_size(), contents_.size());
+  EXPECT_GE(index.access_point_count(), contents_.size() / kSpan / 2);
+  ExpectExtracts(index, file);
+}
+
+TEST_F(GzipIndexTest, SavesAndLoads) {
+  ReadOnlyFile file(path_, CachePolicy::kBuffered);
+  const GzipIndex built =
+      GzipIndex::Build(file, [](std::string_view) {}, kSpan);
+  const auto index_path = test_dir_ / "data.gz.gzidx";
+  ASSERT_TRUE(built.Save(index_path, file.size(), 42, "metadata"));
+
+  std::string metadata;
+  auto loaded = GzipIndex::Load(index_path, file.size(), 42, &metadata);
+  ASSERT_TRUE(loaded.has_value());
+  EXPECT_EQ(metadata, "metadata");
+  EXPECT_EQ(loaded->access_point_count(), built.access_point_count());
+  ExpectExtracts(*loaded, file);
+
+  // Built for a different version of the file.
+  EXPECT_FALSE(GzipIndex::Load(index_path, file.size(), 43, &metadata));
+  EXPECT_FALSE(GzipIndex::Load(index_path, file.size() + 1, 42, &metadata));
+  EXPECT_FALSE(GzipIndex::Load(test_dir_ / "missing", file.size(), 42,
+                               &metadata));
+  std::filesystem::resize_file(index_path,
+                               std::filesystem::file_size(index_path) - 1);
+  EXPECT_FALSE(GzipIndex::Load(index_path, file.size(), 42, &metadata));
+}
+
+TEST_F(GzipIndexTest, RejectsCorruptedInput) {
+  std::ofstream(path_, std::ios::binary) << "not a gzip file";
+  ReadOnlyFile file(path_, CachePolicy::kBuffered);
+  EXPECT_THROW(GzipIndex::Build(file, [](std::string_view) {}), GunzipError);
+
+  const std::string compressed = GzipBuffer(contents_, 6);
+  std::ofstream(path_, std::ios::binary)
+      << std::string_view(compressed).substr(0, compressed.size() / 2);
+  ReadOnlyFile truncated(path_, CachePolicy::kBuffered);
+  EXPECT_THROW(GzipIndex::Build(truncated, [](std::string_view) {}),
+               GunzipError);
+}
+
+}  // namespace
+}  // namespace training
+}  // namespace lczero
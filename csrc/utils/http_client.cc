@@ -0,0 +1,350 @@
+#include "utils/http_client.h"
+
+#include <absl/log/log.h>
+#include <absl/strings/ascii.h>
+#include <absl/strings/match.h>
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_split.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <utility>
+
+namespace lczero {
+namespace training {
+namespace {
+
+// Applies to connecting, and to every send and receive.
+constexpr int kTimeoutSeconds = 30;
+// Longest response head accepted.
+constexpr size_t kMaxHeadSize = 64 * 1024;
+
+bool SendAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    const ssize_t sent = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data.remove_prefix(static_cast<size_t>(sent));
+  }
+  return true;
+}
+
+// Returns the number of bytes received, 0 at the end of the stream and -1 on
+// error.
+ssize_t Receive(int fd, char* buffer, size_t size) {
+  while (true) {
+    const ssize_t received = recv(fd, buffer, size, 0);
+    if (received >= 0 || errno != EINTR) return received;
+  }
+}
+
+int Connect(const std::string& host, const std::string& port) {
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* addresses = nullptr;
+  if (const int error =
+          getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses)) {
+    LOG(WARNING) << "Failed to resolve " << host << ": "
+                 << gai_strerror(error);
+    return -1;
+  }
+  int fd = -1;
+  for (addrinfo* address = addresses; address; address = address->ai_next) {
+    fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC,
+                address->ai_protocol);
+    if (fd < 0) continue;
+    const timeval timeout = {.tv_sec = kTimeoutSeconds, .tv_usec = 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, address->ai_addr, address->ai_addrlen) == 0) break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(addresses);
+  if (fd < 0) {
+    LOG(WARNING) << "Failed to connect to " << host << ":" << port << ": "
+                 << strerror(errno);
+  }
+  return fd;
+}
+
+// Parses an IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+std::optional<int64_t> ParseHttpDate(const std::string& date) {
+  tm parsed = {};
+  const char* end = strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT",
+                             &parsed);
+  if (!end || *end != '\0') return std::nullopt;
+  return static_cast<int64_t>(timegm(&parsed)) * 1000000000;
+}
+
+// Returns <first> of "bytes <first>-<last>/<size>".
+std::optional<uint64_t> ParseContentRangeStart(absl::string_view range) {
+  constexpr absl::string_view kUnit = "bytes ";
+  if (!absl::StartsWith(range, kUnit)) return std::nullopt;
+  range.remove_prefix(kUnit.size());
+  uint64_t first;
+  if (!absl::SimpleAtoi(range.substr(0, range.find('-')), &first)) {
+    return std::nullopt;
+  }
+  return first;
+}
+
+}  // namespace
+
+HttpClient::HttpClient(size_t max_connections)
+    : max_connections_(std::max<size_t>(max_connections, 1)) {}
+
+HttpClient::~HttpClient() {
+  for (auto& [host_port, connections] : idle_) {
+    for (auto& connection : connections) Close(connection);
+  }
+}
+
+HttpClient::Url HttpClient::ParseUrl(std::string_view url) {
+  constexpr std::string_view kScheme = "http://";
+  if (!url.starts_with(kScheme)) {
+    throw std::runtime_error(absl::StrCat("Unsupported URL: ", url));
+  }
+  url.remove_prefix(kScheme.size());
+  const size_t slash = url.find('/');
+  const std::string_view authority = url.substr(0, slash);
+  Url result;
+  result.target =
+      slash == std::string_view::npos ? "/" : std::string(url.substr(slash));
+  // An IPv6 address is bracketed, e.g. "[::1]:8080", as it contains colons.
+  size_t host_end = 0;
+  if (authority.starts_with('[')) {
+    host_end = authority.find(']');
+    if (host_end == std::string_view::npos) {
+      throw std::runtime_error(absl::StrCat("Unsupported URL: http://", url));
+    }
+    result.host = std::string(authority.substr(1, host_end - 1));
+    ++host_end;
+  } else {
+    host_end = std::min(authority.find(':'), authority.size());
+    result.host = std::string(authority.substr(0, host_end));
+  }
+  const std::string_view rest = authority.substr(host_end);
+  if (rest.empty()) {
+    result.port = "80";
+  } else if (rest.starts_with(':')) {
+    result.port = std::string(rest.substr(1));
+  }
+  if (result.host.empty() || result.port.empty()) {
+    throw std::runtime_error(absl::StrCat("Unsupported URL: http://", url));
+  }
+  return result;
+}
+
+void HttpClient::Close(Connection& connection) {
+  if (connection.fd >= 0) close(connection.fd);
+  connection.fd = -1;
+  connection.pending.clear();
+}
+
+HttpClient::Connection HttpClient::Acquire(const std::string& host_port) {
+  absl::MutexLock lock(&mutex_);
+  mutex_.Await(absl::Condition(
+      +[](HttpClient* client) ABSL_EXCLUSIVE_LOCKS_REQUIRED(client->mutex_) {
+        return client->in_use_ < client->max_connections_;
+      },
+      this));
+  ++in_use_;
+  auto it = idle_.find(host_port);
+  if (it == idle_.end() || it->second.empty()) return Connection();
+  Connection connection = std::move(it->second.back());
+  it->second.pop_back();
+  return connection;
+}
+
+void HttpClient::Release(const std::string& host_port, Connection connection) {
+  absl::MutexLock lock(&mutex_);
+  --in_use_;
+  if (connection.fd >= 0) idle_[host_port].push_back(std::move(connection));
+}
+
+std::optional<HttpClient::Response> HttpClient::Request(
+    const Url& url, std::string_view method, std::string_view extra_headers,
+    Connection& connection) {
+  const std::string request = absl::StrCat(
+      method, " ", url.target, " HTTP/1.1\r\nHost: ",
+      absl::StrContains(url.host, ':') ? absl::StrCat("[", url.host, "]")
+                                       : url.host,
+      url.port == "80" ? "" : absl::StrCat(":", url.port), "\r\n",
+      extra_headers, "\r\n");
+  // The server may have closed an idle connection meanwhile, which only shows
+  // when using it, so a reused connection gets one retry on a new one.
+  while (true) {
+    const bool reused = connection.fd >= 0;
+    if (!reused) {
+      connection.fd = Connect(url.host, url.port);
+      if (connection.fd < 0) return std::nullopt;
+    }
+    if (auto response = RequestOnce(url, request, connection)) {
+      return response;
+    }
+    Close(connection);
+    if (!reused) {
+      LOG(WARNING) << "Request to " << url.host << ":" << url.port
+                   << url.target << " failed";
+      return std::nullopt;
+    }
+  }
+}
+
+std::optional<HttpClient::Response> HttpClient::RequestOnce(
+    const Url& url, std::string_view request, Connection& connection) {
+  if (!SendAll(connection.fd, request)) return std::nullopt;
+
+  size_t head_end;
+  while ((head_end = connection.pending.find("\r\n\r\n")) ==
+         std::string::npos) {
+    if (connection.pending.size() > kMaxHeadSize) return std::nullopt;
+    std::array<char, 16384> buffer;
+    const ssize_t received =
+        Receive(connection.fd, buffer.data(), buffer.size());
+    if (received <= 0) return std::nullopt;
+    connection.pending.append(buffer.data(), static_cast<size_t>(received));
+  }
+  const std::string head = connection.pending.substr(0, head_end);
+  connection.pending.erase(0, head_end + 4);
+
+  const std::vector<absl::string_view> lines = absl::StrSplit(head, "\r\n");
+  // "HTTP/1.1 206 Partial Content"
+  const std::vector<absl::string_view> status_line =
+      absl::StrSplit(lines[0], absl::MaxSplits(' ', 2));
+  Response response;
+  if (status_line.size() < 2 || !absl::StartsWith(status_line[0], "HTTP/") ||
+      !absl::SimpleAtoi(status_line[1], &response.status)) {
+    LOG(WARNING) << "Malformed response from " << url.host << ": "
+                 << lines[0];
+    return std::nullopt;
+  }
+  response.keep_alive = status_line[0] != "HTTP/1.0";
+  for (size_t i = 1; i < lines.size(); ++i) {
+    const size_t colon = lines[i].find(':');
+    if (colon == absl::string_view::npos) continue;
+    response.headers[absl::AsciiStrToLower(lines[i].substr(0, colon))] =
+        std::string(absl::StripAsciiWhitespace(lines[i].substr(colon + 1)));
+  }
+  if (auto it = response.headers.find("connection");
+      it != response.headers.end()) {
+    response.keep_alive = !absl::EqualsIgnoreCase(it->second, "close");
+  }
+  if (response.headers.contains("transfer-encoding")) {
+    LOG(WARNING) << "Chunked responses from " << url.host
+                 << " are not supported";
+    return std::nullopt;
+  }
+  if (auto it = response.headers.find("content-length");
+      it != response.headers.end() &&
+      !absl::SimpleAtoi(it->second, &response.content_length)) {
+    return std::nullopt;
+  }
+  return response;
+}
+
+bool HttpClient::ReadBody(Connection& connection, char* out, size_t size) {
+  const size_t buffered = std::min(size, connection.pending.size());
+  if (out) std::memcpy(out, connection.pending.data(), buffered);
+  connection.pending.erase(0, buffered);
+  size -= buffered;
+  if (out) out += buffered;
+  std::array<char, 16384> discard;
+  while (size > 0) {
+    char* target = out ? out : discard.data();
+    const size_t length = out ? size : std::min(size, discard.size());
+    const ssize_t received = Receive(connection.fd, target, length);
+    if (received <= 0) return false;
+    size -= static_cast<size_t>(received);
+    if (out) out += received;
+  }
+  return true;
+}
+
+std::optional<HttpClient::FileInfo> HttpClient::Head(std::string_view url) {
+  Url parsed;
+  try {
+    parsed = ParseUrl(url);
+  } catch (const std::exception& e) {
+    LOG(WARNING) << e.what();
+    return std::nullopt;
+  }
+  const std::string host_port = absl::StrCat(parsed.host, ":", parsed.port);
+  Connection connection = Acquire(host_port);
+  const auto response = Request(parsed, "HEAD", "", connection);
+  std::optional<FileInfo> result;
+  if (response && response->status == 200 &&
+      response->headers.contains("content-length")) {
+    const auto it = response->headers.find("last-modified");
+    result = FileInfo{.size = response->content_length,
+                      .mtime_ns = it == response->headers.end()
+                                      ? std::nullopt
+                                      : ParseHttpDate(it->second)};
+  } else if (response) {
+    LOG(WARNING) << "HEAD " << url << " returned " << response->status;
+  }
+  if (!response || !response->keep_alive) Close(connection);
+  Release(host_port, std::move(connection));
+  return result;
+}
+
+bool HttpClient::GetRange(std::string_view url, uint64_t offset,
+                          std::span<char> buffer) {
+  if (buffer.empty()) return true;
+  Url parsed;
+  try {
+    parsed = ParseUrl(url);
+  } catch (const std::exception& e) {
+    LOG(WARNING) << e.what();
+    return false;
+  }
+  const std::string host_port = absl::StrCat(parsed.host, ":", parsed.port);
+  Connection connection = Acquire(host_port);
+  const uint64_t end = offset + buffer.size();
+  const auto response =
+      Request(parsed, "GET",
+              absl::StrCat("Range: bytes=", offset, "-", end - 1, "\r\n"),
+              connection);
+  bool ok = false;
+  if (response && response->status == 206) {
+    const auto it = response->headers.find("content-range");
+    if (it != response->headers.end() &&
+        ParseContentRangeStart(it->second) == offset &&
+        response->content_length == buffer.size()) {
+      ok = ReadBody(connection, buffer.data(), buffer.size());
+    } else {
+      LOG(WARNING) << "Unexpected range in response to " << url;
+    }
+  } else if (response && response->status == 200 &&
+             response->content_length >= end) {
+    // The server ignored the range and sends the whole file.
+    ok = ReadBody(connection, nullptr, offset) &&
+         ReadBody(connection, buffer.data(), buffer.size()) &&
+         ReadBody(connection, nullptr, response->content_length - end);
+  } else if (response) {
+    LOG(WARNING) << "GET " << url << " returned " << response->status;
+  }
+  if (!ok || !response->keep_alive) Close(connection);
+  Release(host_port, std::move(connection));
+  return ok;
+}
+
+}  // namespace training
+}  // namespace lczero
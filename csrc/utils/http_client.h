@@ -0,0 +1,92 @@
+#pragma once
+
+#include <absl/base/thread_annotations.h>
+#include <absl/container/flat_hash_map.h>
+#include <absl/synchronization/mutex.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lczero {
+namespace training {
+
+// Minimal HTTP/1.1 client for reading byte ranges of files from a static file
+// server over plain http:// (no TLS, no redirects, no chunked responses).
+// Connections are kept alive and reused per host, and up to `max_connections`
+// requests are in flight at once; further requests wait for a free
+// connection. Thread-safe.
+class HttpClient {
+ public:
+  struct FileInfo {
+    uint64_t size;
+    // From Last-Modified, if the server sends it.
+    std::optional<int64_t> mtime_ns;
+  };
+
+  explicit HttpClient(size_t max_connections = 8);
+  ~HttpClient();
+
+  HttpClient(const HttpClient&) = delete;
+  HttpClient& operator=(const HttpClient&) = delete;
+
+  // Returns the size and modification time of `url` with a HEAD request, or
+  // std::nullopt (with a warning) on failure.
+  std::optional<FileInfo> Head(std::string_view url);
+  // Fills `buffer` with the bytes of `url` at `offset` with a Range request.
+  // Returns false (with a warning) on failure.
+  bool GetRange(std::string_view url, uint64_t offset, std::span<char> buffer);
+
+ private:
+  struct Url {
+    std::string host;
+    std::string port;
+    std::string target;
+  };
+  struct Connection {
+    int fd = -1;
+    // Bytes received past the previous response.
+    std::string pending;
+  };
+  struct Response {
+    int status = 0;
+    // Header names are lowercased.
+    absl::flat_hash_map<std::string, std::string> headers;
+    uint64_t content_length = 0;
+    bool keep_alive = true;
+  };
+
+  // Throws std::runtime_error for URLs other than http://host[:port]/path.
+  // An IPv6 host is given in brackets, e.g. http://[::1]:8080/path.
+  static Url ParseUrl(std::string_view url);
+  // Sends a request and reads the response head. The body, if any, is then
+  // read by the caller. Takes care of stale keep-alive connections.
+  std::optional<Response> Request(const Url& url, std::string_view method,
+                                  std::string_view extra_headers,
+                                  Connection& connection);
+  std::optional<Response> RequestOnce(const Url& url,
+                                      std::string_view request,
+                                      Connection& connection);
+  // Reads exactly `size` body bytes into `out`, or discards them if null.
+  static bool ReadBody(Connection& connection, char* out, size_t size);
+  static void Close(Connection& connection);
+
+  // Waits for a free slot and returns an idle connection to the host, or an
+  // unconnected one.
+  Connection Acquire(const std::string& host_port);
+  // Returns the slot, and keeps the connection for reuse if still usable.
+  void Release(const std::string& host_port, Connection connection);
+
+  absl::Mutex mutex_;
+  const size_t max_connections_;
+  size_t in_use_ ABSL_GUARDED_BY(mutex_) = 0;
+  absl::flat_hash_map<std::string, std::vector<Connection>> idle_
+      ABSL_GUARDED_BY(mutex_);
+};
+
+}  // namespace training
+}  // namespace lczero
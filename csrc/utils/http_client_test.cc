@@ -0,0 +1,46 @@
+#include "utils/http_client.h"
+
+#include <gtest/gtest.h>
+
+#include <optional>
+#include <string>
+
+#include "utils/test_http_server.h"
+
+namespace lczero {
+namespace training {
+
+TEST(HttpClientTest, ReadsRangeOverIpv4) {
+  TestHttpServer server;
+  server.SetFile("/file", "0123456789");
+  HttpClient client;
+  const auto info = client.Head(server.url("/file"));
+  ASSERT_TRUE(info.has_value());
+  EXPECT_EQ(info->size, 10u);
+  std::string buffer(4, '\0');
+  ASSERT_TRUE(client.GetRange(server.url("/file"), 3, buffer));
+  EXPECT_EQ(buffer, "3456");
+}
+
+TEST(HttpClientTest, ReadsRangeOverIpv6) {
+  TestHttpServer server({}, /*ipv6=*/true);
+  server.SetFile("/file", "0123456789");
+  HttpClient client;
+  const auto info = client.Head(server.url("/file"));
+  ASSERT_TRUE(info.has_value());
+  EXPECT_EQ(info->size, 10u);
+  std::string buffer(4, '\0');
+  ASSERT_TRUE(client.GetRange(server.url("/file"), 3, buffer));
+  EXPECT_EQ(buffer, "3456");
+}
+
+TEST(HttpClientTest, RejectsUnsupportedUrls) {
+  HttpClient client;
+  EXPECT_EQ(client.Head("https://example.com/file"), std::nullopt);
+  EXPECT_EQ(client.Head("http://[::1/file"), std::nullopt);
+  EXPECT_EQ(client.Head("http://[::1]x/file"), std::nullopt);
+  EXPECT_EQ(client.Head("http://:8080/file"), std::nullopt);
+}
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,74 @@
+#include "utils/http_range_reader.h"
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace lczero {
+namespace training {
+
+HttpRangeReader::HttpRangeReader(size_t cache_bytes, size_t block_size,
+                                 size_t max_connections)
+    : block_size_(std::max<size_t>(block_size, 1)),
+      client_(max_connections),
+      cache_(cache_bytes) {}
+
+std::optional<HttpClient::FileInfo> HttpRangeReader::Stat(
+    std::string_view url) {
+  return client_.Head(url);
+}
+
+bool HttpRangeReader::Read(const std::string& url, uint64_t file_size,
+                           uint64_t offset, std::span<char> buffer) {
+  if (buffer.empty()) return true;
+  const uint64_t end = offset + buffer.size();
+  if (end > file_size) {
+    LOG(WARNING) << "Read past the end of " << url << ": " << end << " > "
+                 << file_size;
+    return false;
+  }
+  const uint64_t first_block = offset / block_size_;
+  const uint64_t last_block = (end - 1) / block_size_;
+  std::vector<Block> blocks(last_block - first_block + 1);
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    blocks[i] = cache_.Get({url, first_block + i}).value_or(nullptr);
+    (blocks[i] ? hits_ : misses_).fetch_add(1, std::memory_order_relaxed);
+  }
+
+  for (size_t i = 0; i < blocks.size();) {
+    if (blocks[i]) {
+      ++i;
+      continue;
+    }
+    size_t run_end = i;
+    while (run_end < blocks.size() && !blocks[run_end]) ++run_end;
+    const uint64_t begin = (first_block + i) * block_size_;
+    std::string data(
+        std::min<uint64_t>((first_block + run_end) * block_size_, file_size) -
+            begin,
+        '\0');
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    if (!client_.GetRange(url, begin, data)) return false;
+    for (; i < run_end; ++i) {
+      auto block = std::make_shared<const std::string>(data.substr(
+          (first_block + i) * block_size_ - begin, block_size_));
+      cache_.Insert({url, first_block + i}, block, block->size());
+      blocks[i] = std::move(block);
+    }
+  }
+
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    const uint64_t block_begin = (first_block + i) * block_size_;
+    const uint64_t copy_begin = std::max(offset, block_begin);
+    const uint64_t copy_end = std::min(end, block_begin + blocks[i]->size());
+    std::memcpy(buffer.data() + (copy_begin - offset),
+                blocks[i]->data() + (copy_begin - block_begin),
+                copy_end - copy_begin);
+  }
+  return true;
+}
+
+}  // namespace training
+}  // namespace lczero
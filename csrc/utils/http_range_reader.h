@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "utils/http_client.h"
+#include "utils/sharded_lru_cache.h"
+
+namespace lczero {
+namespace training {
+
+// Reads byte ranges of files on an HTTP server through a local in-memory cache
+// of fixed-size blocks, bounded in bytes. The missing blocks of a read are
+// fetched with one Range request per contiguous run, and concurrent reads go
+// out on separate connections. Files are assumed not to change while they are
+// read. Thread-safe.
+class HttpRangeReader {
+ public:
+  HttpRangeReader(size_t cache_bytes, size_t block_size,
+                  size_t max_connections);
+
+  // Size and modification time of `url`, see HttpClient::Head().
+  std::optional<HttpClient::FileInfo> Stat(std::string_view url);
+  // Fills `buffer` with the bytes at `offset` of `url`, a file of `file_size`
+  // bytes. Returns false (with a warning) on failure.
+  bool Read(const std::string& url, uint64_t file_size, uint64_t offset,
+            std::span<char> buffer);
+
+  size_t block_size() const { return block_size_; }
+  size_t cache_capacity() const { return cache_.capacity(); }
+  size_t cached_bytes() const { return cache_.charge(); }
+  // Return and reset the number of blocks found in and missing from the
+  // cache, and of the Range requests issued.
+  uint64_t FlushHits() { return hits_.exchange(0); }
+  uint64_t FlushMisses() { return misses_.exchange(0); }
+  uint64_t FlushRequests() { return requests_.exchange(0); }
+
+ private:
+  using BlockKey = std::pair<std::string, uint64_t>;
+  using Block = std::shared_ptr<const std::string>;
+
+  const size_t block_size_;
+  HttpClient client_;
+  ShardedLruCache<BlockKey, Block> cache_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> requests_{0};
+};
+
+}  // namespace training
+}  // namespace lczero
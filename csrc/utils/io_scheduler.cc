@@ -0,0 +1,104 @@
+#include "utils/io_scheduler.h"
+
+#include <algorithm>
+
+namespace lczero {
+namespace training {
+
+IoBudget& IoBudget::Global() {
+  static IoBudget* budget = new IoBudget();
+  return *budget;
+}
+
+void IoBudget::SetLimit(size_t limit) {
+  absl::MutexLock lock(&mutex_);
+  limit_ = limit;
+}
+
+size_t IoBudget::limit() const {
+  absl::MutexLock lock(&mutex_);
+  return limit_;
+}
+
+size_t IoBudget::in_use() const {
+  absl::MutexLock lock(&mutex_);
+  return in_use_;
+}
+
+bool IoBudget::HasRoom() const { return limit_ == 0 || in_use_ < limit_; }
+
+void IoBudget::Acquire() {
+  absl::MutexLock lock(&mutex_);
+  mutex_.Await(absl::Condition(this, &IoBudget::HasRoom));
+  ++in_use_;
+}
+
+bool IoBudget::AcquireWithTimeout(absl::Duration timeout) {
+  absl::MutexLock lock(&mutex_);
+  if (!mutex_.AwaitWithTimeout(absl::Condition(this, &IoBudget::HasRoom),
+                               timeout)) {
+    return false;
+  }
+  ++in_use_;
+  return true;
+}
+
+size_t IoBudget::TryAcquire(size_t count) {
+  absl::MutexLock lock(&mutex_);
+  const size_t taken =
+      limit_ == 0 ? count : std::min(count, limit_ - std::min(limit_, in_use_));
+  in_use_ += taken;
+  return taken;
+}
+
+void IoBudget::Release(size_t count) {
+  absl::MutexLock lock(&mutex_);
+  in_use_ -= count;
+}
+
+IoScheduler::IoScheduler(size_t queue_depth, IoBudget& budget,
+                         bool allow_io_uring)
+    : budget_(budget), reader_(queue_depth, allow_io_uring) {}
+
+IoScheduler::~IoScheduler() {
+  // Let the reads finish while their slots are still accounted.
+  while (reader_.in_flight() > 0) Wait();
+}
+
+void IoScheduler::Enqueue(const AsyncFileReader::Request& request) {
+  queue_.emplace(Position{request.fd, request.offset}, request);
+}
+
+void IoScheduler::Dispatch(absl::Duration wait) {
+  const size_t wanted =
+      std::min(queue_.size(), reader_.queue_depth() - reader_.in_flight());
+  if (wanted == 0) return;
+  size_t slots = budget_.TryAcquire(wanted);
+  if (slots == 0 && reader_.in_flight() == 0 && wait > absl::ZeroDuration() &&
+      budget_.AcquireWithTimeout(wait)) {
+    slots = 1 + budget_.TryAcquire(wanted - 1);
+  }
+  if (slots == 0) return;
+
+  std::vector<AsyncFileReader::Request> requests;
+  requests.reserve(slots);
+  auto it = queue_.lower_bound(head_);
+  while (requests.size() < slots) {
+    if (it == queue_.end()) it = queue_.begin();
+    const auto& request = it->second;
+    requests.push_back(request);
+    head_ = {request.fd,
+             request.offset + static_cast<off_t>(request.buffer.size())};
+    it = queue_.erase(it);
+  }
+  reader_.Submit(requests);
+}
+
+std::vector<AsyncFileReader::Completion> IoScheduler::Wait() {
+  auto completions = reader_.Wait();
+  budget_.Release(completions.size());
+  return completions;
+}
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <absl/base/thread_annotations.h>
+#include <absl/synchronization/mutex.h>
+#include <absl/time/time.h>
+#include <sys/types.h>
+
+#include <cstddef>
+#include <map>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "utils/async_file_reader.h"
+
+namespace lczero {
+namespace training {
+
+// Limit on the number of file reads in flight, shared by the stages of a
+// process so that together they don't oversubscribe the storage. A limit of 0
+// (the default) means unlimited. Thread-safe.
+class IoBudget {
+ public:
+  // Holds one slot of the budget for its lifetime.
+  class Lease {
+   public:
+    explicit Lease(IoBudget& budget) : budget_(budget) { budget_.Acquire(); }
+    ~Lease() { budget_.Release(1); }
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+
+   private:
+    IoBudget& budget_;
+  };
+
+  // The budget shared by all stages.
+  static IoBudget& Global();
+
+  // Takes effect for the following acquisitions; slots already held are kept.
+  void SetLimit(size_t limit);
+  size_t limit() const;
+  size_t in_use() const;
+
+  // Blocks until a slot is free and takes it.
+  void Acquire();
+  // Takes a slot if one frees up within `timeout`.
+  bool AcquireWithTimeout(absl::Duration timeout);
+  // Takes up to `count` slots without blocking. Returns the number taken.
+  size_t TryAcquire(size_t count);
+  void Release(size_t count);
+
+ private:
+  bool HasRoom() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  mutable absl::Mutex mutex_;
+  size_t limit_ ABSL_GUARDED_BY(mutex_) = 0;
+  size_t in_use_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+// Issues reads through an AsyncFileReader in elevator order. Queued reads are
+// kept sorted by (fd, offset), and every dispatch continues from the position
+// of the last issued read, wrapping around to the start once it passes the
+// last one (C-SCAN). This turns a batch of shuffled chunk reads into sweeps
+// over each file. Every read in flight holds a slot of the IoBudget. Not
+// thread-safe, like AsyncFileReader.
+class IoScheduler {
+ public:
+  IoScheduler(size_t queue_depth, IoBudget& budget = IoBudget::Global(),
+              bool allow_io_uring = true);
+  ~IoScheduler();
+
+  IoScheduler(const IoScheduler&) = delete;
+  IoScheduler& operator=(const IoScheduler&) = delete;
+
+  std::string_view backend_name() const { return reader_.backend_name(); }
+  size_t queued() const { return queue_.size(); }
+  size_t in_flight() const { return reader_.in_flight(); }
+
+  // Queues a read; it's issued by a later Dispatch().
+  void Enqueue(const AsyncFileReader::Request& request);
+  // Issues as many queued reads as the queue depth and the budget allow. If
+  // the budget is exhausted by others while nothing of ours is in flight,
+  // waits up to `wait` for a slot.
+  void Dispatch(absl::Duration wait = absl::ZeroDuration());
+  // Blocks until at least one read completes, and frees the budget slots of
+  // the completed reads. Must only be called with reads in flight.
+  std::vector<AsyncFileReader::Completion> Wait();
+
+ private:
+  using Position = std::pair<int, off_t>;
+
+  IoBudget& budget_;
+  AsyncFileReader reader_;
+  std::multimap<Position, AsyncFileReader::Request> queue_;
+  // Where the previous dispatch stopped.
+  Position head_ = {-1, 0};
+};
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,136 @@
+#include "utils/io_scheduler.h"
+
+#include <absl/time/time.h>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace lczero {
+namespace training {
+namespace {
+
+class IoSchedulerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    path_ = std::filesystem::temp_directory_path() /
+            ("io_scheduler_test_" +
+             std::to_string(
+                 std::chrono::steady_clock::now().time_since_epoch().count()));
+    contents_.resize(10000);
+    for (size_t i = 0; i < contents_.size(); ++i) {
+      contents_[i] = static_cast<char>(i % 251);
+    }
+    std::ofstream(path_, std::ios::binary) << contents_;
+    fd_ = open(path_.c_str(), O_RDONLY);
+    ASSERT_GE(fd_, 0);
+  }
+
+  void TearDown() override {
+    close(fd_);
+    std::filesystem::remove(path_);
+  }
+
+  // Queues a 10 byte read at `offset`, tagged with the offset.
+  void Enqueue(IoScheduler& scheduler, off_t offset) {
+    buffers_.emplace_back(10, '\0');
+    scheduler.Enqueue({.fd = fd_,
+                       .offset = offset,
+                       .buffer = buffers_.back(),
+                       .tag = static_cast<uint64_t>(offset)});
+  }
+
+  // Issues the queued reads one at a time and returns their tags in issue
+  // order.
+  std::vector<uint64_t> DrainOneByOne(IoScheduler& scheduler) {
+    std::vector<uint64_t> order;
+    while (scheduler.queued() > 0) {
+      scheduler.Dispatch();
+      EXPECT_EQ(scheduler.in_flight(), 1u);
+      for (const auto& completion : scheduler.Wait()) {
+        EXPECT_TRUE(completion.ok);
+        order.push_back(completion.tag);
+      }
+    }
+    return order;
+  }
+
+  std::filesystem::path path_;
+  std::string contents_;
+  std::list<std::string> buffers_;
+  int fd_ = -1;
+};
+
+TEST_F(IoSchedulerTest, IssuesReadsInElevatorOrder) {
+  IoBudget budget;
+  IoScheduler scheduler(1, budget, /*allow_io_uring=*/false);
+  for (off_t offset : {5000, 100, 3000, 7000}) Enqueue(scheduler, offset);
+  EXPECT_EQ(DrainOneByOne(scheduler),
+            (std::vector<uint64_t>{100, 3000, 5000, 7000}));
+
+  // The sweep continues from the last read, then wraps around.
+  for (off_t offset : {200, 8000, 6000}) Enqueue(scheduler, offset);
+  scheduler.Dispatch();
+  for (const auto& completion : scheduler.Wait()) {
+    EXPECT_EQ(completion.tag, 8000u);
+  }
+  Enqueue(scheduler, 9000);
+  EXPECT_EQ(DrainOneByOne(scheduler),
+            (std::vector<uint64_t>{9000, 200, 6000}));
+  for (const auto& buffer : buffers_) EXPECT_NE(buffer, std::string(10, '\0'));
+}
+
+TEST_F(IoSchedulerTest, RespectsBudget) {
+  IoBudget budget;
+  budget.SetLimit(3);
+  IoBudget::Lease lease(budget);
+  IoScheduler scheduler(8, budget, /*allow_io_uring=*/false);
+  for (off_t offset = 0; offset < 1000; offset += 100) {
+    Enqueue(scheduler, offset);
+  }
+  scheduler.Dispatch();
+  EXPECT_EQ(scheduler.in_flight(), 2u);
+  EXPECT_EQ(scheduler.queued(), 8u);
+  EXPECT_EQ(budget.in_use(), 3u);
+
+  size_t completed = 0;
+  while (completed < 10) {
+    if (scheduler.in_flight() == 0) scheduler.Dispatch();
+    completed += scheduler.Wait().size();
+    EXPECT_LE(budget.in_use(), 3u);
+  }
+  EXPECT_EQ(budget.in_use(), 1u);
+}
+
+TEST_F(IoSchedulerTest, WaitsForBudgetHeldByOthers) {
+  IoBudget budget;
+  budget.SetLimit(1);
+  IoScheduler scheduler(4, budget, /*allow_io_uring=*/false);
+  Enqueue(scheduler, 0);
+  {
+    IoBudget::Lease lease(budget);
+    scheduler.Dispatch(absl::Milliseconds(10));
+    EXPECT_EQ(scheduler.in_flight(), 0u);
+  }
+  std::thread holder([&budget]() {
+    IoBudget::Lease lease(budget);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  });
+  while (budget.in_use() == 0) std::this_thread::yield();
+  scheduler.Dispatch(absl::Seconds(10));
+  holder.join();
+  EXPECT_EQ(scheduler.in_flight(), 1u);
+  EXPECT_EQ(scheduler.Wait().size(), 1u);
+  EXPECT_EQ(budget.in_use(), 0u);
+}
+
+}  // namespace
+}  // namespace training
+}  // namespace lczero
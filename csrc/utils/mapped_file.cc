@@ -0,0 +1,64 @@
+#include "utils/mapped_file.h"
+
+#include <absl/strings/str_cat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace lczero {
+namespace training {
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::runtime_error(absl::StrCat("Failed to open ", path.string(),
+                                          ": ", strerror(errno)));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    const int error = errno;
+    close(fd);
+    throw std::runtime_error(absl::StrCat("Failed to stat ", path.string(),
+                                          ": ", strerror(error)));
+  }
+  size_ = static_cast<size_t>(st.st_size);
+  // mmap() rejects zero-length mappings; an empty file is an empty view.
+  if (size_ > 0) {
+    void* addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      const int error = errno;
+      close(fd);
+      throw std::runtime_error(absl::StrCat("Failed to mmap ", path.string(),
+                                            ": ", strerror(error)));
+    }
+    data_ = static_cast<const char*>(addr);
+  }
+  // The mapping keeps the file referenced, the descriptor is not needed.
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_) munmap(const_cast<char*>(data_), size_);
+}
+
+void MappedFile::Advise(int advice) const {
+  if (data_) madvise(const_cast<char*>(data_), size_, advice);
+}
+
+void MappedFile::Advise(size_t offset, size_t size, int advice) const {
+  if (!data_ || offset >= size_) return;
+  // madvise() requires a page-aligned start address.
+  static const size_t kPageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const size_t aligned = offset / kPageSize * kPageSize;
+  size = std::min(size, size_ - offset) + (offset - aligned);
+  madvise(const_cast<char*>(data_) + aligned, size, advice);
+}
+
+}  // namespace training
+}  // namespace lczero
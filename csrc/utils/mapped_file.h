@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string_view>
+
+namespace lczero {
+namespace training {
+
+// Read-only, shared memory mapping of a whole file. Mappings of the same file
+// share page cache pages, so several readers of one file do not duplicate its
+// contents in memory. Throws std::runtime_error if the file cannot be opened
+// or mapped.
+class MappedFile {
+ public:
+  explicit MappedFile(const std::filesystem::path& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Issues an madvise() hint (e.g. MADV_RANDOM) for the whole mapping.
+  void Advise(int advice) const;
+  // Issues an madvise() hint for a byte range of the mapping.
+  void Advise(size_t offset, size_t size, int advice) const;
+
+  std::string_view data() const { return {data_, size_}; }
+  size_t size() const { return size_; }
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <absl/base/thread_annotations.h>
+#include <absl/container/flat_hash_map.h>
+#include <absl/hash/hash.h>
+#include <absl/synchronization/mutex.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace lczero {
+namespace training {
+
+// Thread-safe LRU cache bounded by the total charge (e.g. bytes) of its
+// entries. Keys are spread over independently locked shards, each of which
+// evicts its least recently used entries once it exceeds an equal share of the
+// capacity. Values are returned by copy, so large values should be held
+// through a shared_ptr.
+template <typename Key, typename Value>
+class ShardedLruCache {
+ public:
+  explicit ShardedLruCache(size_t capacity, size_t num_shards = 16)
+      : capacity_(capacity),
+        shard_capacity_(capacity / std::max<size_t>(num_shards, 1)),
+        shards_(std::max<size_t>(num_shards, 1)) {}
+
+  // Returns the value for `key` and marks it most recently used.
+  std::optional<Value> Get(const Key& key) {
+    Shard& shard = GetShard(key);
+    absl::MutexLock lock(&shard.mutex);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) return std::nullopt;
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    return it->second->value;
+  }
+
+  // Inserts or replaces the value for `key`. Entries larger than a shard's
+  // share of the capacity are not cached.
+  void Insert(const Key& key, Value value, size_t charge) {
+    Shard& shard = GetShard(key);
+    absl::MutexLock lock(&shard.mutex);
+    if (auto it = shard.index.find(key); it != shard.index.end()) {
+      EraseLocked(shard, it);
+    }
+    if (charge > shard_capacity_) return;
+    shard.entries.push_front({key, std::move(value), charge});
+    shard.index.emplace(key, shard.entries.begin());
+    shard.charge += charge;
+    total_charge_ += charge;
+    ++total_entries_;
+    while (shard.charge > shard_capacity_) {
+      EraseLocked(shard, shard.index.find(shard.entries.back().key));
+    }
+  }
+
+  // Removes the entry for `key`, if cached.
+  void Erase(const Key& key) {
+    Shard& shard = GetShard(key);
+    absl::MutexLock lock(&shard.mutex);
+    if (auto it = shard.index.find(key); it != shard.index.end()) {
+      EraseLocked(shard, it);
+    }
+  }
+
+  size_t capacity() const { return capacity_; }
+  // Sum of the charges of all cached entries.
+  size_t charge() const { return total_charge_.load(); }
+  // Number of cached entries.
+  size_t size() const { return total_entries_.load(); }
+
+ private:
+  struct Entry {
+    Key key;
+    Value value;
+    size_t charge;
+  };
+  using EntryList = std::list<Entry>;
+
+  struct Shard {
+    absl::Mutex mutex;
+    // Most recently used first.
+    EntryList entries ABSL_GUARDED_BY(mutex);
+    absl::flat_hash_map<Key, typename EntryList::iterator> index
+        ABSL_GUARDED_BY(mutex);
+    size_t charge ABSL_GUARDED_BY(mutex) = 0;
+  };
+
+  Shard& GetShard(const Key& key) {
+    return shards_[absl::Hash<Key>{}(key) % shards_.size()];
+  }
+
+  void EraseLocked(Shard& shard, typename decltype(Shard::index)::iterator it)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(shard.mutex) {
+    shard.charge -= it->second->charge;
+    total_charge_ -= it->second->charge;
+    --total_entries_;
+    shard.entries.erase(it->second);
+    shard.index.erase(it);
+  }
+
+  const size_t capacity_;
+  const size_t shard_capacity_;
+  std::vector<Shard> shards_;
+  std::atomic<size_t> total_charge_{0};
+  std::atomic<size_t> total_entries_{0};
+};
+
+}  // namespace training
+}  // namespace lczero
@@ -0,0 +1,93 @@
+#include "utils/sharded_lru_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace lczero {
+namespace training {
+
+TEST(ShardedLruCacheTest, GetReturnsInsertedValue) {
+  ShardedLruCache<size_t, std::string> cache(100, 1);
+  EXPECT_EQ(cache.Get(1), std::nullopt);
+  cache.Insert(1, "one", 10);
+  cache.Insert(2, "two", 20);
+  EXPECT_EQ(cache.Get(1), "one");
+  EXPECT_EQ(cache.Get(2), "two");
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_EQ(cache.charge(), 30);
+}
+
+TEST(ShardedLruCacheTest, InsertReplacesExistingValue) {
+  ShardedLruCache<size_t, std::string> cache(100, 1);
+  cache.Insert(1, "one", 10);
+  cache.Insert(1, "uno", 15);
+  EXPECT_EQ(cache.Get(1), "uno");
+  EXPECT_EQ(cache.size(), 1);
+  EXPECT_EQ(cache.charge(), 15);
+}
+
+TEST(ShardedLruCacheTest, EvictsLeastRecentlyUsed) {
+  ShardedLruCache<size_t, std::string> cache(30, 1);
+  cache.Insert(1, "one", 10);
+  cache.Insert(2, "two", 10);
+  cache.Insert(3, "three", 10);
+  // Touch 1, so 2 becomes the least recently used.
+  EXPECT_TRUE(cache.Get(1));
+  cache.Insert(4, "four", 10);
+  EXPECT_TRUE(cache.Get(1));
+  EXPECT_EQ(cache.Get(2), std::nullopt);
+  EXPECT_TRUE(cache.Get(3));
+  EXPECT_TRUE(cache.Get(4));
+  EXPECT_EQ(cache.charge(), 30);
+}
+
+TEST(ShardedLruCacheTest, SkipsOversizedEntries) {
+  ShardedLruCache<size_t, std::string> cache(30, 1);
+  cache.Insert(1, "one", 10);
+  cache.Insert(2, "huge", 31);
+  EXPECT_EQ(cache.Get(2), std::nullopt);
+  EXPECT_EQ(cache.Get(1), "one");
+}
+
+TEST(ShardedLruCacheTest, EraseRemovesOnlyThatKey) {
+  ShardedLruCache<size_t, size_t> cache(1000, 4);
+  for (size_t i = 0; i < 20; ++i) cache.Insert(i, i * 10, 1);
+  cache.Erase(7);
+  cache.Erase(100);
+  EXPECT_EQ(cache.size(), 19);
+  EXPECT_EQ(cache.charge(), 19);
+  EXPECT_EQ(cache.Get(7), std::nullopt);
+  EXPECT_EQ(cache.Get(8), 80);
+}
+
+TEST(ShardedLruCacheTest, RespectsCapacityAcrossShards) {
+  ShardedLruCache<size_t, size_t> cache(64, 4);
+  for (size_t i = 0; i < 1000; ++i) cache.Insert(i, i, 1);
+  EXPECT_LE(cache.charge(), 64);
+  EXPECT_EQ(cache.charge(), cache.size());
+}
+
+TEST(ShardedLruCacheTest, ConcurrentAccess) {
+  ShardedLruCache<size_t, size_t> cache(256, 8);
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&cache, t]() {
+      for (size_t i = 0; i < 10000; ++i) {
+        const size_t key = (i * 7 + t) % 512;
+        if (auto value = cache.Get(key)) {
+          EXPECT_EQ(*value, key);
+        } else {
+          cache.Insert(key, key, 1);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  EXPECT_LE(cache.charge(), 256);
+}
+
+}  // namespace training
+}  // namespace lczero
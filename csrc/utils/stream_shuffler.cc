@@ -1,62 +1,157 @@
 #include "utils/stream_shuffler.h"
 
+#include <algorithm>
+#include <bit>
+
 namespace lczero {
 namespace training {
 
+void StreamShuffler::SetBlockSampling(size_t block_size, size_t open_blocks) {
+  assert(upper_bound_ == 0 && lower_bound_ == 0);
+  block_size_ = std::max<size_t>(block_size, 1);
+  max_open_blocks_ = std::max<size_t>(open_blocks, 1);
+  block_order_ = std::make_unique<StreamShuffler>();
+  block_order_->SetBucketSize(bucket_size_);
+}
+
 void StreamShuffler::SetUpperBound(size_t upper_bound) {
   assert(upper_bound >= upper_bound_);
+  if (block_order_) {
+    ExtendBlocks(upper_bound);
+    return;
+  }
   stream_size_ += upper_bound - upper_bound_;
   while (upper_bound_ < upper_bound) {
     if (buckets_.empty() || buckets_.back().GetRemainingCapacity() == 0) {
-      buckets_.emplace_back(upper_bound_, bucket_size_);
+      AppendBucket();
     }
-    upper_bound_ = std::min(
-        upper_bound, upper_bound_ + buckets_.back().GetRemainingCapacity());
-    buckets_.back().Extend(upper_bound_);
+    Bucket& bucket = buckets_.back();
+    const size_t new_upper_bound =
+        std::min(upper_bound, upper_bound_ + bucket.GetRemainingCapacity());
+    bucket.Extend(new_upper_bound);
+    UpdateBucketSize(buckets_.size() - 1, new_upper_bound - upper_bound_);
+    upper_bound_ = new_upper_bound;
   }
 }
 
 void StreamShuffler::SetLowerBound(size_t lower_bound) {
   assert(lower_bound >= lower_bound_);
   lower_bound_ = lower_bound;
+  if (block_order_) {
+    DropBlocksBelow(lower_bound);
+    return;
+  }
   if (lower_bound >= upper_bound_) {
     upper_bound_ = lower_bound;
     stream_size_ = 0;
     buckets_.clear();
+    RebuildTree(0);
     return;
   }
   while (!buckets_.empty() && buckets_.front().upper_bound() <= lower_bound_) {
-    stream_size_ -= buckets_.front().size();
-    buckets_.pop_front();
+    PopFrontBucket();
   }
   if (!buckets_.empty()) {
-    auto old_size = buckets_.front().size();
+    const size_t old_size = buckets_.front().size();
     buckets_.front().DeclareLowerBound(lower_bound_);
-    stream_size_ -= old_size - buckets_.front().size();
+    const size_t removed = old_size - buckets_.front().size();
+    if (removed > 0) {
+      stream_size_ -= removed;
+      UpdateBucketSize(0, -static_cast<ptrdiff_t>(removed));
+    }
   }
 }
 
 std::optional<size_t> StreamShuffler::GetNextItem() {
-  auto try_fetch = [&]() -> size_t {
+  if (block_order_) return GetNextBlockItem();
+  while (stream_size_ > 0) {
     size_t item_idx = absl::Uniform(gen_, size_t{0}, stream_size_);
+    const size_t bucket_idx = FindBucket(item_idx);
+    const size_t item = buckets_[bucket_idx].Fetch(item_idx);
     --stream_size_;
-    for (auto& bucket : buckets_) {
-      if (item_idx < bucket.size()) return bucket.Fetch(item_idx);
-      item_idx -= bucket.size();
-    }
-    throw std::logic_error("StreamShuffler: item index out of bounds");
-  };
+    UpdateBucketSize(bucket_idx, -1);
+    if (item >= lower_bound_) return item;
+  }
+  return std::nullopt;
+}
 
-  while (stream_size_ > 0) {
-    if (auto item = try_fetch(); item >= lower_bound_) return item;
+void StreamShuffler::AppendBucket() {
+  assert(bucket_size_ <= (size_t{1} << 32));
+  buckets_.emplace_back(upper_bound_, bucket_size_);
+  const size_t needed = tree_offset_ + buckets_.size();
+  if (needed >= tree_.size()) {
+    // Grow geometrically, and drop the positions of popped buckets.
+    RebuildTree(std::max<size_t>(2 * buckets_.size(), 4));
   }
+}
 
-  return std::nullopt;
+void StreamShuffler::PopFrontBucket() {
+  const size_t size = buckets_.front().size();
+  stream_size_ -= size;
+  UpdateBucketSize(0, -static_cast<ptrdiff_t>(size));
+  buckets_.pop_front();
+  ++tree_offset_;
+  if (tree_offset_ > buckets_.size()) RebuildTree(tree_.size() - 1);
+}
+
+void StreamShuffler::UpdateBucketSize(size_t index, ptrdiff_t delta) {
+  // Unsigned wraparound makes negative deltas work.
+  for (size_t pos = tree_offset_ + index + 1; pos < tree_.size();
+       pos += pos & -pos) {
+    tree_[pos] += static_cast<size_t>(delta);
+  }
+}
+
+void StreamShuffler::RebuildTree(size_t capacity) {
+  tree_offset_ = 0;
+  // A power of two, so that FindBucket() needs no bounds checks.
+  capacity = std::bit_ceil(std::max({capacity, buckets_.size(), size_t{1}}));
+  tree_.assign(capacity + 1, 0);
+  for (size_t i = 0; i < buckets_.size(); ++i) {
+    tree_[i + 1] = buckets_[i].size();
+  }
+  for (size_t pos = 1; pos < tree_.size(); ++pos) {
+    const size_t parent = pos + (pos & -pos);
+    if (parent < tree_.size()) tree_[parent] += tree_[pos];
+  }
+}
+
+size_t StreamShuffler::FindBucket(size_t& item_idx) const {
+  size_t pos = 0;
+  // The last position holds the total, so the search starts below it. The
+  // loop is branchless, as the comparisons are unpredictable.
+  for (size_t step = (tree_.size() - 1) / 2; step > 0; step /= 2) {
+    const size_t count = tree_[pos + step];
+    const bool skip = count <= item_idx;
+    pos += skip ? step : 0;
+    item_idx -= skip ? count : 0;
+  }
+  // pos is the number of positions before the bucket.
+  if (pos < tree_offset_ || pos - tree_offset_ >= buckets_.size()) {
+    throw std::logic_error("StreamShuffler: item index out of bounds");
+  }
+  return pos - tree_offset_;
 }
 
 void StreamShuffler::Reset(size_t lower_bound, size_t upper_bound) {
+  if (block_order_ && lower_bound >= lower_bound_ &&
+      upper_bound >= upper_bound_) {
+    // Keep the block layout, so that blocks still don't span extensions.
+    open_blocks_.clear();
+    SetLowerBound(lower_bound);
+    block_order_->Reset(first_block_id_, first_block_id_ + blocks_.size());
+    SetUpperBound(upper_bound);
+    return;
+  }
+  if (block_order_) {
+    open_blocks_.clear();
+    blocks_.clear();
+    first_block_id_ = 0;
+    block_order_->Reset(0, 0);
+  }
   // Reset all internal state
   buckets_.clear();
+  RebuildTree(0);
   stream_size_ = 0;
   upper_bound_ = lower_bound;
   lower_bound_ = lower_bound;
@@ -67,8 +162,55 @@ void StreamShuffler::Reset(size_t lower_bound, size_t upper_bound) {
   }
 }
 
+void StreamShuffler::ExtendBlocks(size_t upper_bound) {
+  for (size_t begin = upper_bound_; begin < upper_bound; begin += block_size_) {
+    blocks_.push_back({begin, std::min(upper_bound, begin + block_size_)});
+  }
+  upper_bound_ = upper_bound;
+  block_order_->SetUpperBound(first_block_id_ + blocks_.size());
+}
+
+void StreamShuffler::DropBlocksBelow(size_t lower_bound) {
+  if (lower_bound >= upper_bound_) upper_bound_ = lower_bound;
+  while (!blocks_.empty() && blocks_.front().end <= lower_bound) {
+    blocks_.pop_front();
+    ++first_block_id_;
+  }
+  block_order_->SetLowerBound(first_block_id_);
+  std::erase_if(open_blocks_,
+                [lower_bound](const Block& block) {
+                  return block.end <= lower_bound;
+                });
+  for (auto& block : open_blocks_) {
+    block.begin = std::max(block.begin, lower_bound);
+  }
+}
+
+std::optional<size_t> StreamShuffler::GetNextBlockItem() {
+  while (open_blocks_.size() < max_open_blocks_) {
+    const std::optional<size_t> id = block_order_->GetNextItem();
+    if (!id) break;
+    Block block = blocks_[*id - first_block_id_];
+    block.begin = std::max(block.begin, lower_bound_);
+    open_blocks_.push_back(block);
+  }
+  if (open_blocks_.empty()) return std::nullopt;
+
+  const size_t index = absl::Uniform(gen_, size_t{0}, open_blocks_.size());
+  Block& block = open_blocks_[index];
+  const size_t item = block.begin++;
+  if (block.begin == block.end) {
+    std::swap(block, open_blocks_.back());
+    open_blocks_.pop_back();
+  }
+  return item;
+}
+
 StreamShuffler::Bucket::Bucket(size_t lower_bound, size_t capacity)
-    : upper_bound_(lower_bound), items_(capacity) {}
+    : base_(lower_bound),
+      pruned_below_(lower_bound),
+      upper_bound_(lower_bound),
+      items_(capacity) {}
 
 size_t StreamShuffler::Bucket::GetRemainingCapacity() const {
   return items_.size() - items_count_;
@@ -79,30 +221,32 @@ void StreamShuffler::Bucket::Extend(size_t new_upper_bound) {
   const size_t increase = new_upper_bound - upper_bound_;
   assert(increase <= GetRemainingCapacity());
   std::iota(items_.begin() + items_count_,
-            items_.begin() + items_count_ + increase, upper_bound_);
+            items_.begin() + items_count_ + increase,
+            static_cast<uint32_t>(upper_bound_ - base_));
   items_count_ += increase;
   upper_bound_ = new_upper_bound;
 }
 
 size_t StreamShuffler::Bucket::Fetch(size_t item_idx) {
   assert(item_idx < items_count_);
-  size_t item = items_[item_idx];
+  const size_t item = base_ + items_[item_idx];
   std::swap(items_[item_idx], items_[--items_count_]);
   return item;
 }
 
-void DeclareLowerBound(size_t new_lower_bound);
 void StreamShuffler::Bucket::DeclareLowerBound(size_t new_lower_bound) {
-  if (upper_bound_ - new_lower_bound < 2 * items_count_) return;
-
-  // If the bucket has much more items that the allowed range, there are many
-  // items out of the range. It makes sense to sort and remove them.
-  std::sort(items_.begin(), items_.begin() + items_count_,
-            std::greater<size_t>());
-  // Find the first item that is under the new lower bound.
-  auto it = std::upper_bound(items_.begin(), items_.begin() + items_count_,
-                             new_lower_bound, std::greater<size_t>());
+  // Items below pruned_below_ are gone already, so at most
+  // new_lower_bound - pruned_below_ of the items are out of the range. Until
+  // they may be half of the bucket, leave them to be skipped when drawn.
+  if (new_lower_bound <= pruned_below_ ||
+      2 * (new_lower_bound - pruned_below_) < items_count_) {
+    return;
+  }
+  const uint32_t lower = static_cast<uint32_t>(new_lower_bound - base_);
+  auto it = std::partition(items_.begin(), items_.begin() + items_count_,
+                           [lower](uint32_t item) { return item >= lower; });
   items_count_ = it - items_.begin();
+  pruned_below_ = new_lower_bound;
 }
 
 }  // namespace training
@@ -4,9 +4,12 @@
 #include <absl/random/random.h>
 
 #include <cstddef>
+#include <cstdint>
 #include <deque>
+#include <memory>
 #include <numeric>
 #include <optional>
+#include <vector>
 
 namespace lczero {
 namespace training {
@@ -14,15 +17,32 @@ namespace training {
 // Returns a number between [lower_bound, upper_bound) in shuffled order.
 // Both bounds can be changed at any time, and the stream will adapt
 // accordingly. Not thread-safe.
+//
+// Items are kept in buckets of 32-bit offsets, and a Fenwick tree over the
+// bucket sizes finds the bucket of a drawn item in O(log buckets). Moving the
+// lower bound drops the buckets below it, and usually leaves the items below
+// it in the first bucket to be skipped when drawn. That bucket is only pruned
+// once they may be half of it, which is linear in the distance the bound
+// moved since the previous pruning.
+//
+// In block sampling mode, the range is cut into blocks of consecutive items
+// instead: every SetUpperBound() call starts a new block, so blocks never span
+// two extensions of the range. Blocks are opened in shuffled order, and each
+// item comes from a random one of the open blocks, in increasing order within
+// the block. Fewer and larger blocks make reads more sequential at the cost of
+// shuffle entropy.
 class StreamShuffler {
  public:
+  // Switches to block sampling mode. Must be called before any bounds are set.
+  void SetBlockSampling(size_t block_size, size_t open_blocks);
+
   // Sets the upper bound (exclusive). Can only be increased.
   void SetUpperBound(size_t upper_bound);
 
   // Sets the lower bound (inclusive). Can only be increased.
   void SetLowerBound(size_t lower_bound);
 
-  // Sets the bucket size for internal storage optimization.
+  // Sets the bucket size for internal storage optimization. At most 2^32.
   void SetBucketSize(size_t bucket_size) { bucket_size_ = bucket_size; }
 
   // Returns the next item in shuffled order, or nullopt if exhausted.
@@ -31,6 +51,10 @@ class StreamShuffler {
   // Resets the shuffler to restart iteration with specified bounds.
   void Reset(size_t lower_bound, size_t upper_bound);
 
+  // Returns the number of items left in item mode, which may include items
+  // below the lower bound that haven't been skipped yet.
+  size_t size() const { return stream_size_; }
+
  private:
   class Bucket {
    public:
@@ -44,17 +68,54 @@ class StreamShuffler {
     size_t size() const { return items_count_; }
 
    private:
-    size_t upper_bound_ = 0;
+    // Items are stored as offsets from base_.
+    size_t base_;
+    // No item is below this bound.
+    size_t pruned_below_;
+    size_t upper_bound_;
     size_t items_count_ = 0;
-    absl::FixedArray<size_t> items_;
+    absl::FixedArray<uint32_t> items_;
   };
 
+  void AppendBucket();
+  void PopFrontBucket();
+  // Adds `delta` (possibly negative) to the size of buckets_[index].
+  void UpdateBucketSize(size_t index, ptrdiff_t delta);
+  // Rebuilds tree_ from the bucket sizes, with room for `capacity` buckets.
+  void RebuildTree(size_t capacity);
+  // Returns the index of the bucket holding the item_idx-th remaining item,
+  // and turns item_idx into the index within that bucket.
+  size_t FindBucket(size_t& item_idx) const;
+
+  // Items [begin, end) of a block; `begin` advances as the block is consumed.
+  struct Block {
+    size_t begin;
+    size_t end;
+  };
+
+  void ExtendBlocks(size_t upper_bound);
+  void DropBlocksBelow(size_t lower_bound);
+  std::optional<size_t> GetNextBlockItem();
+
   absl::BitGen gen_;
   std::deque<Bucket> buckets_;
+  // Fenwick tree over bucket sizes, 1-based. buckets_[i] is at position
+  // tree_offset_ + i + 1; positions of popped buckets hold zero.
+  std::vector<size_t> tree_ = {0};
+  size_t tree_offset_ = 0;
   size_t stream_size_ = 0;
   size_t upper_bound_ = 0;
   size_t lower_bound_ = 0;
   size_t bucket_size_ = 524288;
+
+  // Block sampling mode, enabled when block_order_ is set.
+  size_t block_size_ = 0;
+  size_t max_open_blocks_ = 0;
+  // Shuffles the ids of blocks_, the first one being first_block_id_.
+  std::unique_ptr<StreamShuffler> block_order_;
+  std::deque<Block> blocks_;
+  size_t first_block_id_ = 0;
+  std::vector<Block> open_blocks_;
 };
 
 }  // namespace training
@@ -4,6 +4,7 @@
 #include <absl/random/random.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <set>
 #include <vector>
 
@@ -283,5 +284,96 @@ TEST_F(StreamShufflerTest, ResetAllowsIterationRestart) {
   EXPECT_EQ(first_round, second_round);
 }
 
+TEST_F(StreamShufflerTest, LongSlidingWindowOverManyBuckets) {
+  // Enough buckets come and go to grow and compact the bucket index.
+  std::set<size_t> received;
+  size_t upper = 0;
+  for (size_t step = 0; step < 500; ++step) {
+    upper += 1 + step % 7;
+    const size_t lower = upper > 50 ? upper - 50 : 0;
+    shuffler_.SetUpperBound(upper);
+    shuffler_.SetLowerBound(lower);
+    const auto item = shuffler_.GetNextItem();
+    ASSERT_TRUE(item.has_value());
+    EXPECT_GE(*item, lower);
+    EXPECT_LT(*item, upper);
+    EXPECT_TRUE(received.insert(*item).second);
+  }
+
+  // The rest of the window comes out exactly once.
+  while (auto item = shuffler_.GetNextItem()) {
+    EXPECT_GE(*item, upper - 50);
+    EXPECT_TRUE(received.insert(*item).second);
+  }
+  for (size_t item = upper - 50; item < upper; ++item) {
+    EXPECT_TRUE(received.contains(item)) << item;
+  }
+}
+
+TEST_F(StreamShufflerTest, BlockSamplingReturnsEachItemOnce) {
+  shuffler_.SetBlockSampling(5, 2);
+  shuffler_.SetUpperBound(7);
+  shuffler_.SetUpperBound(20);
+
+  // Blocks are [0, 5), [5, 7), [7, 12), [12, 17) and [17, 20).
+  const std::vector<size_t> block_starts = {0, 5, 7, 12, 17, 20};
+  auto block_of = [&](size_t item) {
+    return std::upper_bound(block_starts.begin(), block_starts.end(), item) -
+           block_starts.begin() - 1;
+  };
+  std::vector<size_t> next_in_block(block_starts.begin(),
+                                    block_starts.end() - 1);
+  std::set<size_t> open_blocks;
+  for (int i = 0; i < 20; ++i) {
+    const auto item = shuffler_.GetNextItem();
+    ASSERT_TRUE(item.has_value());
+    const size_t block = block_of(*item);
+    EXPECT_EQ(*item, next_in_block[block]++);
+    open_blocks.insert(block);
+    EXPECT_LE(open_blocks.size(), 2);
+    if (next_in_block[block] == block_starts[block + 1]) {
+      open_blocks.erase(block);
+    }
+  }
+  EXPECT_EQ(shuffler_.GetNextItem(), std::nullopt);
+}
+
+TEST_F(StreamShufflerTest, BlockSamplingRespectsLowerBound) {
+  shuffler_.SetBlockSampling(4, 3);
+  shuffler_.SetUpperBound(10);
+  const auto first = shuffler_.GetNextItem();
+  ASSERT_TRUE(first.has_value());
+  shuffler_.SetUpperBound(20);
+  shuffler_.SetLowerBound(9);
+
+  std::set<size_t> received;
+  while (auto item = shuffler_.GetNextItem()) {
+    EXPECT_GE(*item, 9);
+    EXPECT_LT(*item, 20);
+    EXPECT_TRUE(received.insert(*item).second);
+  }
+  if (*first >= 9) received.insert(*first);
+  EXPECT_EQ(received.size(), 11);
+}
+
+TEST_F(StreamShufflerTest, BlockSamplingResetKeepsBlocks) {
+  shuffler_.SetBlockSampling(3, 1);
+  shuffler_.SetUpperBound(2);
+  shuffler_.SetUpperBound(6);
+  while (shuffler_.GetNextItem()) {
+  }
+
+  // Blocks are still [0, 2), [2, 5) and [5, 6), plus the new [6, 8).
+  shuffler_.Reset(0, 8);
+  std::vector<size_t> items;
+  while (auto item = shuffler_.GetNextItem()) items.push_back(*item);
+  ASSERT_EQ(items.size(), 8);
+  for (size_t i = 1; i < items.size(); ++i) {
+    if (items[i] != 0 && items[i] != 2 && items[i] != 5 && items[i] != 6) {
+      EXPECT_EQ(items[i], items[i - 1] + 1);
+    }
+  }
+}
+
 }  // namespace training
-}  // namespace lczero
\ No newline at end of file
+}  // namespace lczero
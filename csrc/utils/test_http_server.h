@@ -0,0 +1,155 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace lczero {
+namespace training {
+
+// Serves files from memory like a static file server, for tests: HEAD, GET of
+// a whole file or of a single byte range, and keep-alive connections.
+class TestHttpServer {
+ public:
+  // Listens on 127.0.0.1, or on [::1] if `ipv6`.
+  explicit TestHttpServer(std::map<std::string, std::string> files = {},
+                          bool ipv6 = false)
+      : files_(std::move(files)), ipv6_(ipv6) {
+    sockaddr_storage address = {};
+    socklen_t length;
+    if (ipv6) {
+      auto* address6 = reinterpret_cast<sockaddr_in6*>(&address);
+      address6->sin6_family = AF_INET6;
+      address6->sin6_addr = in6addr_loopback;
+      length = sizeof(sockaddr_in6);
+    } else {
+      auto* address4 = reinterpret_cast<sockaddr_in*>(&address);
+      address4->sin_family = AF_INET;
+      address4->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      length = sizeof(sockaddr_in);
+    }
+    listen_fd_ = socket(address.ss_family, SOCK_STREAM, 0);
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), length) != 0 ||
+        listen(listen_fd_, 16) != 0 ||
+        getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address),
+                    &length) != 0) {
+      throw std::runtime_error("Failed to start the test server");
+    }
+    port_ = ntohs(ipv6 ? reinterpret_cast<sockaddr_in6*>(&address)->sin6_port
+                       : reinterpret_cast<sockaddr_in*>(&address)->sin_port);
+    accept_thread_ = std::thread([this] { Accept(); });
+  }
+
+  ~TestHttpServer() {
+    shutdown(listen_fd_, SHUT_RDWR);
+    accept_thread_.join();
+    close(listen_fd_);
+    for (int fd : connection_fds_) shutdown(fd, SHUT_RDWR);
+    for (auto& thread : connection_threads_) thread.join();
+    for (int fd : connection_fds_) close(fd);
+  }
+
+  std::string url(const std::string& path) const {
+    return (ipv6_ ? "http://[::1]:" : "http://127.0.0.1:") +
+           std::to_string(port_) + path;
+  }
+  size_t requests() const { return requests_.load(); }
+  size_t connections() const { return connections_.load(); }
+
+  // Adds or replaces the file served at `path`.
+  void SetFile(const std::string& path, std::string contents) {
+    std::lock_guard lock(files_mutex_);
+    files_[path] = std::move(contents);
+  }
+
+ private:
+  void Accept() {
+    while (true) {
+      const int fd = accept(listen_fd_, nullptr, nullptr);
+      if (fd < 0) return;
+      ++connections_;
+      connection_fds_.push_back(fd);
+      connection_threads_.emplace_back([this, fd] { Serve(fd); });
+    }
+  }
+
+  void Serve(int fd) {
+    std::string pending;
+    while (true) {
+      size_t head_end;
+      while ((head_end = pending.find("\r\n\r\n")) == std::string::npos) {
+        char buffer[4096];
+        const ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received <= 0) return;
+        pending.append(buffer, received);
+      }
+      const std::string head = pending.substr(0, head_end);
+      pending.erase(0, head_end + 4);
+      ++requests_;
+
+      char method[16] = {};
+      char target[256] = {};
+      std::sscanf(head.c_str(), "%15s %255s", method, target);
+      uint64_t first = 0;
+      uint64_t last = 0;
+      const size_t range = head.find("\r\nRange: bytes=");
+      const bool has_range =
+          range != std::string::npos &&
+          std::sscanf(head.c_str() + range, "\r\nRange: bytes=%" SCNu64
+                                            "-%" SCNu64,
+                      &first, &last) == 2;
+
+      std::string response;
+      std::lock_guard lock(files_mutex_);
+      const auto it = files_.find(target);
+      if (it == files_.end()) {
+        response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+      } else if (has_range) {
+        const std::string& file = it->second;
+        response = "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " +
+                   std::to_string(first) + "-" + std::to_string(last) + "/" +
+                   std::to_string(file.size()) + "\r\nContent-Length: " +
+                   std::to_string(last - first + 1) + "\r\n\r\n" +
+                   file.substr(first, last - first + 1);
+      } else {
+        response =
+            "HTTP/1.1 200 OK\r\nLast-Modified: Sun, 06 Nov 1994 08:49:37 GMT"
+            "\r\nContent-Length: " +
+            std::to_string(it->second.size()) + "\r\n\r\n";
+        if (std::strcmp(method, "GET") == 0) response += it->second;
+      }
+      if (send(fd, response.data(), response.size(), MSG_NOSIGNAL) !=
+          static_cast<ssize_t>(response.size())) {
+        return;
+      }
+    }
+  }
+
+  std::mutex files_mutex_;
+  std::map<std::string, std::string> files_;
+  int listen_fd_;
+  const bool ipv6_;
+  int port_;
+  std::atomic<size_t> requests_{0};
+  std::atomic<size_t> connections_{0};
+  std::thread accept_thread_;
+  // Only touched by the accept thread until it's joined.
+  std::vector<int> connection_fds_;
+  std::vector<std::thread> connection_threads_;
+};
+
+}  // namespace training
+}  // namespace lczero